@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <signal.h>
 #include <limits.h>
+#include <setjmp.h>
 #include <stdint.h>
 
 #include "libavformat/avformat.h"
@@ -37,6 +38,7 @@
 #include "libavutil/channel_layout.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/samplefmt.h"
+#include "libavutil/spscqueue.h"
 #include "libavutil/fifo.h"
 #include "libavutil/hwcontext.h"
 #include "libavutil/internal.h"
@@ -86,13 +88,32 @@ const int program_birth_year = 2000;
 
 static FILE *vstats_file;
 
-static int nb_frames_drop = 0;
-
 static int want_sdp = 1;
 
 #if HAVE_PTHREADS
 /* signal to input threads that they should exit; set by the main thread */
 static int transcoding_finished;
+
+/* set while the filtergraph and encoder threads are running */
+static int pipeline_active;
+static pthread_mutex_t vstats_lock;
+
+/* the jmp_buf a filtergraph or encoder thread returns through when it fails;
+ * NULL in the other threads */
+static pthread_key_t pipeline_abort_key;
+
+/* bumped whenever a pipeline thread made progress, for the main thread to
+ * check again whether output is still needed */
+static pthread_mutex_t pipeline_lock;
+static pthread_cond_t  pipeline_cond;
+static unsigned        pipeline_progress;
+
+/* set by a pipeline thread that hit a fatal error, for the main thread to
+ * exit with pipeline_exit_code */
+static atomic_int pipeline_failed;
+static int pipeline_exit_code;
+
+static void free_pipeline(int abort);
 #endif
 
 InputStream **input_streams = NULL;
@@ -140,10 +161,95 @@ static int decode_interrupt_cb(void *ctx)
 
 const AVIOInterruptCB int_cb = { decode_interrupt_cb, NULL };
 
+static void lock_output_file(OutputFile *of)
+{
+#if HAVE_PTHREADS
+    if (pipeline_active)
+        pthread_mutex_lock(&of->mux_lock);
+#endif
+}
+
+static void unlock_output_file(OutputFile *of)
+{
+#if HAVE_PTHREADS
+    if (pipeline_active)
+        pthread_mutex_unlock(&of->mux_lock);
+#endif
+}
+
+#if HAVE_PTHREADS
+static void frame_queue_signal(struct FrameQueue *q, int abort);
+
+static void signal_pipeline_progress(void)
+{
+    pthread_mutex_lock(&pipeline_lock);
+    pipeline_progress++;
+    pthread_cond_broadcast(&pipeline_cond);
+    pthread_mutex_unlock(&pipeline_lock);
+}
+
+/* wait until a pipeline thread made progress since the last call */
+static void wait_pipeline_progress(unsigned *seen)
+{
+    pthread_mutex_lock(&pipeline_lock);
+    while (pipeline_progress == *seen)
+        pthread_cond_wait(&pipeline_cond, &pipeline_lock);
+    *seen = pipeline_progress;
+    pthread_mutex_unlock(&pipeline_lock);
+}
+
+/*
+ * Called from exit_program() in a filtergraph or encoder thread. Abort the
+ * pipeline, release the locks this thread may hold (they are error checking
+ * mutexes, so unlocking the ones held by other threads fails harmlessly) and
+ * return from the thread function, for the main thread to join it.
+ */
+static void abort_pipeline_thread(int ret, jmp_buf *abort_jmp)
+{
+    int i;
+
+    pipeline_exit_code = ret;
+    atomic_store(&pipeline_failed, 1);
+
+    for (i = 0; i < nb_filtergraphs; i++)
+        if (filtergraphs[i]->queue)
+            frame_queue_signal(filtergraphs[i]->queue, 1);
+    for (i = 0; i < nb_output_streams; i++)
+        if (output_streams[i]->queue)
+            frame_queue_signal(output_streams[i]->queue, 1);
+
+    for (i = 0; i < nb_output_files; i++)
+        pthread_mutex_unlock(&output_files[i]->mux_lock);
+    pthread_mutex_unlock(&vstats_lock);
+
+    signal_pipeline_progress();
+    longjmp(*abort_jmp, 1);
+}
+
+/* exit from the main thread if one of the pipeline threads failed */
+static void check_pipeline_failure(void)
+{
+    if (atomic_load(&pipeline_failed))
+        exit_program(pipeline_exit_code);
+}
+#endif
+
 static void avconv_cleanup(int ret)
 {
     int i, j;
 
+#if HAVE_PTHREADS
+    if (pipeline_active) {
+        /* a fatal error in one of the pipeline threads; the other threads
+         * may still be using everything freed below, so stop this thread
+         * and let the main thread clean up and exit */
+        jmp_buf *abort_jmp = pthread_getspecific(pipeline_abort_key);
+        if (abort_jmp)
+            abort_pipeline_thread(ret, abort_jmp);
+        free_pipeline(1);
+    }
+#endif
+
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
         avfilter_graph_free(&fg->graph);
@@ -242,6 +348,8 @@ static void avconv_cleanup(int ret)
 
     uninit_opts();
 
+    av_buffer_unref(&thread_pool);
+
     avformat_network_deinit();
 
     if (received_sigterm) {
@@ -309,11 +417,11 @@ static void write_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost)
      * reordering, see do_video_out()
      */
     if (!(st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && ost->encoding_needed)) {
-        if (ost->frame_number >= ost->max_frames) {
+        if (atomic_load(&ost->frame_number) >= ost->max_frames) {
             av_packet_unref(pkt);
             return;
         }
-        ost->frame_number++;
+        atomic_fetch_add(&ost->frame_number, 1);
     }
     if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
         uint8_t *sd = av_packet_get_side_data(pkt, AV_PKT_DATA_QUALITY_FACTOR,
@@ -387,11 +495,17 @@ static void output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost)
                 if (ret < 0)
                     goto finish;
                 idx++;
-            } else
+            } else {
+                lock_output_file(of);
                 write_packet(of, pkt, ost);
+                unlock_output_file(of);
+            }
         }
-    } else
+    } else {
+        lock_output_file(of);
         write_packet(of, pkt, ost);
+        unlock_output_file(of);
+    }
 
 finish:
     if (ret < 0 && ret != AVERROR_EOF) {
@@ -408,7 +522,7 @@ static int check_recording_time(OutputStream *ost)
     if (of->recording_time != INT64_MAX &&
         av_compare_ts(ost->sync_opts - ost->first_pts, ost->enc_ctx->time_base, of->recording_time,
                       AV_TIME_BASE_Q) >= 0) {
-        ost->finished = 1;
+        atomic_store(&ost->finished, 1);
         return 0;
     }
     return 1;
@@ -537,13 +651,13 @@ static void do_video_out(OutputFile *of,
         format_video_sync = (of->ctx->oformat->flags & AVFMT_NOTIMESTAMPS) ? VSYNC_PASSTHROUGH :
                             (of->ctx->oformat->flags & AVFMT_VARIABLE_FPS) ? VSYNC_VFR : VSYNC_CFR;
     if (format_video_sync != VSYNC_PASSTHROUGH &&
-        ost->frame_number &&
+        atomic_load(&ost->frame_number) &&
         in_picture->pts != AV_NOPTS_VALUE &&
         in_picture->pts < ost->sync_opts) {
-        nb_frames_drop++;
+        atomic_fetch_add(&ost->frames_dropped, 1);
         av_log(NULL, AV_LOG_WARNING,
                "*** dropping frame %d from stream %d at ts %"PRId64"\n",
-               ost->frame_number, ost->st->index, in_picture->pts);
+               atomic_load(&ost->frame_number), ost->st->index, in_picture->pts);
         return;
     }
 
@@ -552,14 +666,14 @@ static void do_video_out(OutputFile *of,
     ost->sync_opts = in_picture->pts;
 
 
-    if (!ost->frame_number)
+    if (!atomic_load(&ost->frame_number))
         ost->first_pts = in_picture->pts;
 
     av_init_packet(&pkt);
     pkt.data = NULL;
     pkt.size = 0;
 
-    if (ost->frame_number >= ost->max_frames)
+    if (atomic_load(&ost->frame_number) >= ost->max_frames)
         return;
 
     if (enc->flags & (AV_CODEC_FLAG_INTERLACED_DCT | AV_CODEC_FLAG_INTERLACED_ME) &&
@@ -584,7 +698,7 @@ static void do_video_out(OutputFile *of,
      * For video, there may be reordering, so we can't throw away frames on
      * encoder flush, we need to limit them here, before they go into encoder.
      */
-    ost->frame_number++;
+    atomic_fetch_add(&ost->frame_number, 1);
 
     while (1) {
         ret = avcodec_receive_packet(enc, &pkt);
@@ -624,6 +738,11 @@ static void do_video_stats(OutputStream *ost, int frame_size)
     int frame_number;
     double ti1, bitrate, avg_bitrate;
 
+#if HAVE_PTHREADS
+    if (pipeline_active)
+        pthread_mutex_lock(&vstats_lock);
+#endif
+
     /* this is executed just the first time do_video_stats is called */
     if (!vstats_file) {
         vstats_file = fopen(vstats_filename, "w");
@@ -635,7 +754,7 @@ static void do_video_stats(OutputStream *ost, int frame_size)
 
     enc = ost->enc_ctx;
     if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
-        frame_number = ost->frame_number;
+        frame_number = atomic_load(&ost->frame_number);
         fprintf(vstats_file, "frame= %5d q= %2.1f ", frame_number,
                 ost->quality / (float)FF_QP2LAMBDA);
 
@@ -662,18 +781,171 @@ FF_DISABLE_DEPRECATION_WARNINGS
 FF_ENABLE_DEPRECATION_WARNINGS
 #endif
     }
+
+#if HAVE_PTHREADS
+    if (pipeline_active)
+        pthread_mutex_unlock(&vstats_lock);
+#endif
 }
 
 static int init_output_stream(OutputStream *ost, char *error, int error_len);
 
+#if HAVE_PTHREADS
+#define PIPELINE_QUEUE_SIZE 8
+
+typedef struct QueuedFrame {
+    AVFrame     *frame;     /* NULL signals EOF on ifilter */
+    InputFilter *ifilter;   /* destination of the frame in a filtergraph */
+} QueuedFrame;
+
+/* a bounded queue of frames between two threads of the pipeline */
+typedef struct FrameQueue {
+    AVFifoBuffer    *fifo;
+    pthread_mutex_t  lock;
+    pthread_cond_t   cond;      /* signalled on every change of the queue */
+    int              finished;  /* no more frames will be added */
+    int              abort;     /* both sides must stop as soon as possible */
+} FrameQueue;
+
+static FrameQueue *frame_queue_alloc(void)
+{
+    FrameQueue *q = av_mallocz(sizeof(*q));
+    if (!q)
+        return NULL;
+
+    q->fifo = av_fifo_alloc(PIPELINE_QUEUE_SIZE * sizeof(QueuedFrame));
+    if (!q->fifo) {
+        av_freep(&q);
+        return NULL;
+    }
+
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init (&q->cond, NULL);
+
+    return q;
+}
+
+static void frame_queue_free(FrameQueue **pq)
+{
+    FrameQueue *q = *pq;
+
+    if (!q)
+        return;
+
+    while (av_fifo_size(q->fifo)) {
+        QueuedFrame qf;
+        av_fifo_generic_read(q->fifo, &qf, sizeof(qf), NULL);
+        av_frame_free(&qf.frame);
+    }
+    av_fifo_free(q->fifo);
+
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy (&q->cond);
+    av_freep(pq);
+}
+
+/* move the reference in frame (if any) to the queue, waiting for free space */
+static int frame_queue_put(FrameQueue *q, AVFrame *frame, InputFilter *ifilter)
+{
+    QueuedFrame qf = { NULL, ifilter };
+    int ret = 0;
+
+    if (frame) {
+        qf.frame = av_frame_alloc();
+        if (!qf.frame)
+            return AVERROR(ENOMEM);
+        av_frame_move_ref(qf.frame, frame);
+    }
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->abort && !av_fifo_space(q->fifo))
+        pthread_cond_wait(&q->cond, &q->lock);
+
+    if (q->abort) {
+        ret = AVERROR_EXIT;
+    } else {
+        av_fifo_generic_write(q->fifo, &qf, sizeof(qf), NULL);
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    if (ret < 0)
+        av_frame_free(&qf.frame);
+    return ret;
+}
+
+/*
+ * Return
+ * - 0 -- qf was filled with the next frame
+ * - AVERROR(EAGAIN) -- the queue is empty and block is 0
+ * - AVERROR_EOF -- the queue is empty and finished
+ * - AVERROR_EXIT -- the queue was aborted
+ */
+static int frame_queue_get(FrameQueue *q, QueuedFrame *qf, int block)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&q->lock);
+    while (block && !q->abort && !q->finished && !av_fifo_size(q->fifo))
+        pthread_cond_wait(&q->cond, &q->lock);
+
+    if (q->abort) {
+        ret = AVERROR_EXIT;
+    } else if (av_fifo_size(q->fifo)) {
+        av_fifo_generic_read(q->fifo, qf, sizeof(*qf), NULL);
+        pthread_cond_broadcast(&q->cond);
+    } else {
+        ret = q->finished ? AVERROR_EOF : AVERROR(EAGAIN);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return ret;
+}
+
+static void frame_queue_signal(struct FrameQueue *q, int abort)
+{
+    pthread_mutex_lock(&q->lock);
+    if (abort)
+        q->abort = 1;
+    else
+        q->finished = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+#endif
+
+static void encode_frame(OutputStream *ost, AVFrame *frame)
+{
+    OutputFile *of = output_files[ost->file_index];
+    int frame_size;
+
+    switch (ost->enc_ctx->codec_type) {
+    case AVMEDIA_TYPE_VIDEO:
+        if (!ost->frame_aspect_ratio)
+            ost->enc_ctx->sample_aspect_ratio = frame->sample_aspect_ratio;
+
+        do_video_out(of, ost, frame, &frame_size);
+        if (vstats_filename && frame_size)
+            do_video_stats(ost, frame_size);
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        do_audio_out(of, ost, frame);
+        break;
+    default:
+        // TODO support subtitle filters
+        av_assert0(0);
+    }
+}
+
 /*
- * Read one frame for lavfi output for ost and encode it.
+ * Read one frame for lavfi output for ost and encode it, or pass it to the
+ * encoder thread of ost.
  */
 static int poll_filter(OutputStream *ost)
 {
     OutputFile    *of = output_files[ost->file_index];
     AVFrame *filtered_frame = NULL;
-    int frame_size, ret;
+    int ret;
 
     if (!ost->filtered_frame && !(ost->filtered_frame = av_frame_alloc())) {
         return AVERROR(ENOMEM);
@@ -710,22 +982,17 @@ static int poll_filter(OutputStream *ost)
                                            ost->enc_ctx->time_base);
     }
 
-    switch (ost->filter->filter->inputs[0]->type) {
-    case AVMEDIA_TYPE_VIDEO:
-        if (!ost->frame_aspect_ratio)
-            ost->enc_ctx->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
-
-        do_video_out(of, ost, filtered_frame, &frame_size);
-        if (vstats_filename && frame_size)
-            do_video_stats(ost, frame_size);
-        break;
-    case AVMEDIA_TYPE_AUDIO:
-        do_audio_out(of, ost, filtered_frame);
-        break;
-    default:
-        // TODO support subtitle filters
-        av_assert0(0);
+#if HAVE_PTHREADS
+    if (ost->thread_started) {
+        if (filtered_frame->pts != AV_NOPTS_VALUE)
+            ost->queued_pts = filtered_frame->pts +
+                              (ost->enc_ctx->codec_type == AVMEDIA_TYPE_AUDIO ?
+                               filtered_frame->nb_samples : 1);
+        return frame_queue_put(ost->queue, filtered_frame, NULL);
     }
+#endif
+
+    encode_frame(ost, filtered_frame);
 
     av_frame_unref(filtered_frame);
 
@@ -737,23 +1004,24 @@ static void finish_output_stream(OutputStream *ost)
     OutputFile *of = output_files[ost->file_index];
     int i;
 
-    ost->finished = 1;
+    atomic_store(&ost->finished, 1);
 
     if (of->shortest) {
         for (i = 0; i < of->ctx->nb_streams; i++)
-            output_streams[of->ost_index + i]->finished = 1;
+            atomic_store(&output_streams[of->ost_index + i]->finished, 1);
     }
 }
 
 /*
  * Read as many frames from possible from lavfi and encode them.
+ * Only the outputs of fg are considered, or all the filtergraphs if it is NULL.
  *
  * Always read from the active stream with the lowest timestamp. If no frames
  * are available for it then return EAGAIN and wait for more input. This way we
  * can use lavfi sources that generate unlimited amount of frames without memory
  * usage exploding.
  */
-static int poll_filters(void)
+static int poll_filters(FilterGraph *fg)
 {
     int i, ret = 0;
 
@@ -765,6 +1033,14 @@ static int poll_filters(void)
         for (i = 0; i < nb_output_streams; i++) {
             int64_t pts = output_streams[i]->sync_opts;
 
+            if (fg && (!output_streams[i]->filter ||
+                       output_streams[i]->filter->graph != fg))
+                continue;
+#if HAVE_PTHREADS
+            if (output_streams[i]->thread_started)
+                pts = output_streams[i]->queued_pts;
+#endif
+
             if (output_streams[i]->filter && !output_streams[i]->filter->graph->graph &&
                 !output_streams[i]->filter->graph->nb_inputs) {
                 ret = configure_filtergraph(output_streams[i]->filter->graph);
@@ -774,7 +1050,8 @@ static int poll_filters(void)
                 }
             }
 
-            if (!output_streams[i]->filter || output_streams[i]->finished ||
+            if (!output_streams[i]->filter ||
+                atomic_load(&output_streams[i]->finished) ||
                 !output_streams[i]->filter->graph->graph)
                 continue;
 
@@ -910,6 +1187,7 @@ static void print_report(int is_last_report, int64_t timer_start)
     OutputStream *ost;
     AVFormatContext *oc;
     int64_t total_size = 0;
+    uint64_t nb_frames_drop = 0;
     AVCodecContext *enc;
     int frame_number, vid, i;
     double bitrate, ti1, pts;
@@ -935,9 +1213,11 @@ static void print_report(int is_last_report, int64_t timer_start)
 
     oc = output_files[0]->ctx;
     if (oc->pb) {
+        lock_output_file(output_files[0]);
         total_size = avio_size(oc->pb);
         if (total_size <= 0) // FIXME improve avio_size() so it works with non seekable output too
             total_size = avio_tell(oc->pb);
+        unlock_output_file(output_files[0]);
         if (total_size < 0) {
             char errbuf[128];
             av_strerror(total_size, errbuf, sizeof(errbuf));
@@ -952,10 +1232,19 @@ static void print_report(int is_last_report, int64_t timer_start)
     vid = 0;
     for (i = 0; i < nb_output_streams; i++) {
         float q = -1;
+        int quality;
+        int64_t last_mux_dts;
         ost = output_streams[i];
         enc = ost->enc_ctx;
+
+        /* updated by write_packet() */
+        lock_output_file(output_files[ost->file_index]);
+        quality      = ost->quality;
+        last_mux_dts = ost->last_mux_dts;
+        unlock_output_file(output_files[ost->file_index]);
+
         if (!ost->stream_copy)
-            q = ost->quality / (float) FF_QP2LAMBDA;
+            q = quality / (float) FF_QP2LAMBDA;
 
         if (vid && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "q=%2.1f ", q);
@@ -963,7 +1252,7 @@ static void print_report(int is_last_report, int64_t timer_start)
         if (!vid && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
             float t = (av_gettime_relative() - timer_start) / 1000000.0;
 
-            frame_number = ost->frame_number;
+            frame_number = atomic_load(&ost->frame_number);
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "frame=%5d fps=%3d q=%3.1f ",
                      frame_number, (t > 1) ? (int)(frame_number / t + 0.5) : 0, q);
             if (is_last_report)
@@ -1006,9 +1295,11 @@ FF_ENABLE_DEPRECATION_WARNINGS
             vid = 1;
         }
         /* compute min output value */
-        pts = (double)ost->last_mux_dts * av_q2d(ost->mux_timebase);
+        pts = (double)last_mux_dts * av_q2d(ost->mux_timebase);
         if ((pts < ti1) && (pts > 0))
             ti1 = pts;
+
+        nb_frames_drop += atomic_load(&ost->frames_dropped);
     }
     if (ti1 < 0.01)
         ti1 = 0.01;
@@ -1020,7 +1311,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
             (double)total_size / 1024, ti1, bitrate);
 
     if (nb_frames_drop)
-        snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " drop=%d",
+        snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " drop=%"PRIu64,
                  nb_frames_drop);
 
     av_log(NULL, AV_LOG_INFO, "%s    \r", buf);
@@ -1121,13 +1412,13 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
 
     av_init_packet(&opkt);
 
-    if ((!ost->frame_number && !(pkt->flags & AV_PKT_FLAG_KEY)) &&
+    if ((!atomic_load(&ost->frame_number) && !(pkt->flags & AV_PKT_FLAG_KEY)) &&
         !ost->copy_initial_nonkeyframes)
         return;
 
     if (of->recording_time != INT64_MAX &&
         ist->last_dts >= of->recording_time + start_time) {
-        ost->finished = 1;
+        atomic_store(&ost->finished, 1);
         return;
     }
 
@@ -1136,7 +1427,7 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
         if (f->start_time != AV_NOPTS_VALUE)
             start_time += f->start_time;
         if (ist->last_dts >= f->recording_time + start_time) {
-            ost->finished = 1;
+            atomic_store(&ost->finished, 1);
             return;
         }
     }
@@ -1228,7 +1519,7 @@ static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame)
             }
         }
 
-        ret = poll_filters();
+        ret = poll_filters(fg);
         if (ret < 0 && ret != AVERROR_EOF) {
             char errbuf[128];
             av_strerror(ret, errbuf, sizeof(errbuf));
@@ -1281,6 +1572,251 @@ static int ifilter_send_eof(InputFilter *ifilter)
     return 0;
 }
 
+#if HAVE_PTHREADS
+/* return 1 if no more frames can be expected from the filtergraph inputs and
+ * its outputs still need polling */
+static int filtergraph_draining(FilterGraph *fg)
+{
+    int i;
+
+    for (i = 0; i < fg->nb_inputs; i++)
+        if (!fg->inputs[i]->eof)
+            return 0;
+    for (i = 0; i < fg->nb_outputs; i++)
+        if (fg->outputs[i]->ost && !atomic_load(&fg->outputs[i]->ost->finished))
+            return 1;
+    return 0;
+}
+
+/*
+ * Feed the decoded frames to the filtergraph and pass its output to the
+ * encoder threads. Once all the inputs are finished (or if there are none),
+ * the graph is polled until all its outputs are finished.
+ */
+static void *filter_thread(void *arg)
+{
+    FilterGraph *fg = arg;
+    jmp_buf abort_jmp;
+    QueuedFrame qf;
+    int draining, ret;
+
+    /* exit_program() called from this thread returns here */
+    if (setjmp(abort_jmp))
+        return NULL;
+    pthread_setspecific(pipeline_abort_key, &abort_jmp);
+
+    do {
+        draining = filtergraph_draining(fg);
+
+        if (!draining) {
+            ret = frame_queue_get(fg->queue, &qf, 1);
+            if (ret < 0)
+                break;
+
+            if (qf.frame)
+                ret = ifilter_send_frame(qf.ifilter, qf.frame);
+            else
+                ret = ifilter_send_eof(qf.ifilter);
+            av_frame_free(&qf.frame);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_FATAL, "Error while processing the decoded "
+                       "data for stream #%d:%d\n", qf.ifilter->ist->file_index,
+                       qf.ifilter->ist->st->index);
+                exit_program(1);
+            }
+        }
+
+        ret = poll_filters(fg);
+        if (ret < 0 && ret != AVERROR_EOF && ret != AVERROR_EXIT) {
+            char errbuf[128];
+            av_strerror(ret, errbuf, sizeof(errbuf));
+
+            av_log(NULL, AV_LOG_FATAL, "Error while filtering: %s\n", errbuf);
+            exit_program(1);
+        }
+        signal_pipeline_progress();
+    } while (!draining);
+
+    /* poll_filters() only returns early when the graph cannot make progress
+     * anymore, so there is nothing left to do but to wait for the pipeline
+     * to be stopped; discard anything sent after EOF meanwhile */
+    while (draining && frame_queue_get(fg->queue, &qf, 1) >= 0)
+        av_frame_free(&qf.frame);
+
+    signal_pipeline_progress();
+    return NULL;
+}
+
+static void *encoder_thread(void *arg)
+{
+    OutputStream *ost = arg;
+    jmp_buf abort_jmp;
+    QueuedFrame qf;
+
+    /* exit_program() called from this thread returns here */
+    if (setjmp(abort_jmp))
+        return NULL;
+    pthread_setspecific(pipeline_abort_key, &abort_jmp);
+
+    while (frame_queue_get(ost->queue, &qf, 1) >= 0) {
+        encode_frame(ost, qf.frame);
+        av_frame_free(&qf.frame);
+
+        /* stop the filtergraphs from feeding the other streams of the file */
+        if (atomic_load(&ost->frame_number) >= ost->max_frames) {
+            OutputFile *of = output_files[ost->file_index];
+            int i;
+            for (i = 0; i < of->ctx->nb_streams; i++)
+                atomic_store(&output_streams[of->ost_index + i]->finished, 1);
+        }
+        signal_pipeline_progress();
+    }
+
+    signal_pipeline_progress();
+    return NULL;
+}
+
+/*
+ * Stop the pipeline threads, either after they processed all the frames
+ * sent to them, or as soon as possible if abort is set.
+ */
+static void free_pipeline(int abort)
+{
+    int i;
+
+    if (!pipeline_active)
+        return;
+
+    for (i = 0; i < nb_filtergraphs; i++)
+        if (filtergraphs[i]->queue)
+            frame_queue_signal(filtergraphs[i]->queue, abort);
+    for (i = 0; abort && i < nb_output_streams; i++)
+        if (output_streams[i]->queue)
+            frame_queue_signal(output_streams[i]->queue, 1);
+
+    /* the filtergraphs are joined first, so that everything they output
+     * reaches the encoders */
+    for (i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+
+        if (fg->thread_started)
+            pthread_join(fg->thread, NULL);
+        fg->thread_started = 0;
+    }
+
+    for (i = 0; i < nb_output_streams; i++)
+        if (output_streams[i]->queue)
+            frame_queue_signal(output_streams[i]->queue, 0);
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (ost->thread_started)
+            pthread_join(ost->thread, NULL);
+        ost->thread_started = 0;
+    }
+
+    /* a failing thread may signal any queue until it is joined */
+    for (i = 0; i < nb_filtergraphs; i++)
+        frame_queue_free(&filtergraphs[i]->queue);
+    for (i = 0; i < nb_output_streams; i++)
+        frame_queue_free(&output_streams[i]->queue);
+
+    for (i = 0; i < nb_output_files; i++)
+        pthread_mutex_destroy(&output_files[i]->mux_lock);
+    pthread_mutex_destroy(&vstats_lock);
+    pthread_mutex_destroy(&pipeline_lock);
+    pthread_cond_destroy(&pipeline_cond);
+    pthread_key_delete(pipeline_abort_key);
+
+    pipeline_active = 0;
+}
+
+/*
+ * Run each filtergraph and each of the encoders fed by them in a separate
+ * thread, connected by bounded frame queues.
+ */
+static int init_pipeline(void)
+{
+    pthread_mutexattr_t attr;
+    int i, ret;
+
+    if (!use_pipeline || !nb_filtergraphs || hw_device_ctx)
+        return 0;
+
+    /* hardware decoders may have a fixed number of surfaces, do not hold
+     * any of them in the queues */
+    for (i = 0; i < nb_input_streams; i++)
+        if (input_streams[i]->hwaccel_id != HWACCEL_NONE)
+            return 0;
+
+    /* error checking, so that a failing thread can release the locks it
+     * holds without knowing which ones they are */
+    if ((ret = pthread_key_create(&pipeline_abort_key, NULL)))
+        return AVERROR(ret);
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+    for (i = 0; i < nb_output_files; i++)
+        pthread_mutex_init(&output_files[i]->mux_lock, &attr);
+    pthread_mutex_init(&vstats_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_mutex_init(&pipeline_lock, NULL);
+    pthread_cond_init(&pipeline_cond, NULL);
+    pipeline_active = 1;
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (!ost->filter)
+            continue;
+
+        if (!(ost->queue = frame_queue_alloc()))
+            return AVERROR(ENOMEM);
+        if ((ret = pthread_create(&ost->thread, NULL, encoder_thread, ost)))
+            return AVERROR(ret);
+        ost->thread_started = 1;
+    }
+
+    for (i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+
+        if (!(fg->queue = frame_queue_alloc()))
+            return AVERROR(ENOMEM);
+        if ((ret = pthread_create(&fg->thread, NULL, filter_thread, fg)))
+            return AVERROR(ret);
+        fg->thread_started = 1;
+    }
+
+    return 0;
+}
+#endif
+
+static int ifilter_submit_frame(InputFilter *ifilter, AVFrame *frame)
+{
+#if HAVE_PTHREADS
+    if (ifilter->graph->thread_started) {
+        int ret = frame_queue_put(ifilter->graph->queue, frame, ifilter);
+        if (ret == AVERROR_EXIT)
+            check_pipeline_failure();
+        return ret;
+    }
+#endif
+    return ifilter_send_frame(ifilter, frame);
+}
+
+static int ifilter_submit_eof(InputFilter *ifilter)
+{
+#if HAVE_PTHREADS
+    if (ifilter->graph->thread_started) {
+        int ret = frame_queue_put(ifilter->graph->queue, NULL, ifilter);
+        if (ret == AVERROR_EXIT)
+            check_pipeline_failure();
+        return ret;
+    }
+#endif
+    return ifilter_send_eof(ifilter);
+}
+
 // This does not quite work like avcodec_decode_audio4/avcodec_decode_video2.
 // There is the following difference: if you got a frame, you must call
 // it again with pkt=NULL. pkt==NULL is treated differently from pkt.size==0
@@ -1370,7 +1906,7 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
         } else
             f = decoded_frame;
 
-        err = ifilter_send_frame(ist->filters[i], f);
+        err = ifilter_submit_frame(ist->filters[i], f);
         if (err < 0)
             break;
     }
@@ -1424,7 +1960,7 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output,
         } else
             f = decoded_frame;
 
-        err = ifilter_send_frame(ist->filters[i], f);
+        err = ifilter_submit_frame(ist->filters[i], f);
         if (err < 0)
             break;
     }
@@ -1467,7 +2003,7 @@ static int send_filter_eof(InputStream *ist)
 {
     int i, ret;
     for (i = 0; i < ist->nb_filters; i++) {
-        ret = ifilter_send_eof(ist->filters[i]);
+        ret = ifilter_submit_eof(ist->filters[i]);
         if (ret < 0)
             return ret;
     }
@@ -1703,6 +2239,11 @@ static int init_input_stream(int ist_index, char *error, int error_len)
 
         if (!av_dict_get(ist->decoder_opts, "threads", NULL, 0))
             av_dict_set(&ist->decoder_opts, "threads", "auto", 0);
+        if (thread_pool && !ist->dec_ctx->thread_pool) {
+            ist->dec_ctx->thread_pool = av_buffer_ref(thread_pool);
+            if (!ist->dec_ctx->thread_pool)
+                return AVERROR(ENOMEM);
+        }
         if ((ret = avcodec_open2(ist->dec_ctx, codec, &ist->decoder_opts)) < 0) {
             char errbuf[128];
             if (ret == AVERROR_EXPERIMENTAL)
@@ -2038,6 +2579,11 @@ static int init_output_stream(OutputStream *ost, char *error, int error_len)
         }
         if (!av_dict_get(ost->encoder_opts, "threads", NULL, 0))
             av_dict_set(&ost->encoder_opts, "threads", "auto", 0);
+        if (thread_pool && !ost->enc_ctx->thread_pool) {
+            ost->enc_ctx->thread_pool = av_buffer_ref(thread_pool);
+            if (!ost->enc_ctx->thread_pool)
+                return AVERROR(ENOMEM);
+        }
 
         if (ost->filter && ost->filter->filter->inputs[0]->hw_frames_ctx &&
             ((AVHWFramesContext*)ost->filter->filter->inputs[0]->hw_frames_ctx->data)->format ==
@@ -2116,7 +2662,9 @@ static int init_output_stream(OutputStream *ost, char *error, int error_len)
 
     ost->initialized = 1;
 
+    lock_output_file(output_files[ost->file_index]);
     ret = check_init_output_file(output_files[ost->file_index], ost->file_index);
+    unlock_output_file(output_files[ost->file_index]);
     if (ret < 0)
         return ret;
 
@@ -2272,14 +2820,22 @@ static int need_output(void)
         OutputStream *ost    = output_streams[i];
         OutputFile *of       = output_files[ost->file_index];
         AVFormatContext *os  = output_files[ost->file_index]->ctx;
+        int64_t size;
 
-        if (ost->finished ||
-            (os->pb && avio_tell(os->pb) >= of->limit_filesize))
+        if (atomic_load(&ost->finished))
             continue;
-        if (ost->frame_number >= ost->max_frames) {
+
+        if (os->pb) {
+            lock_output_file(of);
+            size = avio_tell(os->pb);
+            unlock_output_file(of);
+            if (size >= of->limit_filesize)
+                continue;
+        }
+        if (atomic_load(&ost->frame_number) >= ost->max_frames) {
             int j;
             for (j = 0; j < of->ctx->nb_streams; j++)
-                output_streams[of->ost_index + j]->finished = 1;
+                atomic_store(&output_streams[of->ost_index + j]->finished, 1);
             continue;
         }
 
@@ -2329,19 +2885,20 @@ static void *input_thread(void *arg)
         } else if (ret < 0)
             break;
 
-        pthread_mutex_lock(&f->fifo_lock);
-        while (!av_fifo_space(f->fifo))
-            pthread_cond_wait(&f->fifo_cond, &f->fifo_lock);
-
-        av_fifo_generic_write(f->fifo, &pkt, sizeof(pkt), NULL);
-
-        pthread_mutex_unlock(&f->fifo_lock);
+        ret = av_spsc_queue_send(f->in_queue, &pkt, 0);
+        if (ret < 0)
+            av_packet_unref(&pkt);
     }
 
-    f->finished = 1;
+    av_spsc_queue_set_err_recv(f->in_queue, AVERROR_EOF);
     return NULL;
 }
 
+static void free_input_packet(void *pkt)
+{
+    av_packet_unref(pkt);
+}
+
 static void free_input_threads(void)
 {
     int i;
@@ -2353,27 +2910,17 @@ static void free_input_threads(void)
 
     for (i = 0; i < nb_input_files; i++) {
         InputFile *f = input_files[i];
-        AVPacket pkt;
 
-        if (!f->fifo || f->joined)
+        if (!f->in_queue || f->joined)
             continue;
 
-        pthread_mutex_lock(&f->fifo_lock);
-        while (av_fifo_size(f->fifo)) {
-            av_fifo_generic_read(f->fifo, &pkt, sizeof(pkt), NULL);
-            av_packet_unref(&pkt);
-        }
-        pthread_cond_signal(&f->fifo_cond);
-        pthread_mutex_unlock(&f->fifo_lock);
+        /* wake the thread up if it is waiting for free space */
+        av_spsc_queue_set_err_send(f->in_queue, AVERROR_EOF);
 
         pthread_join(f->thread, NULL);
         f->joined = 1;
 
-        while (av_fifo_size(f->fifo)) {
-            av_fifo_generic_read(f->fifo, &pkt, sizeof(pkt), NULL);
-            av_packet_unref(&pkt);
-        }
-        av_fifo_free(f->fifo);
+        av_spsc_queue_free(&f->in_queue);
     }
 }
 
@@ -2387,11 +2934,10 @@ static int init_input_threads(void)
     for (i = 0; i < nb_input_files; i++) {
         InputFile *f = input_files[i];
 
-        if (!(f->fifo = av_fifo_alloc(8*sizeof(AVPacket))))
-            return AVERROR(ENOMEM);
-
-        pthread_mutex_init(&f->fifo_lock, NULL);
-        pthread_cond_init (&f->fifo_cond, NULL);
+        ret = av_spsc_queue_alloc(&f->in_queue, 8, sizeof(AVPacket),
+                                  free_input_packet);
+        if (ret < 0)
+            return ret;
 
         if ((ret = pthread_create(&f->thread, NULL, input_thread, f)))
             return AVERROR(ret);
@@ -2401,23 +2947,7 @@ static int init_input_threads(void)
 
 static int get_input_packet_mt(InputFile *f, AVPacket *pkt)
 {
-    int ret = 0;
-
-    pthread_mutex_lock(&f->fifo_lock);
-
-    if (av_fifo_size(f->fifo)) {
-        av_fifo_generic_read(f->fifo, pkt, sizeof(*pkt), NULL);
-        pthread_cond_signal(&f->fifo_cond);
-    } else {
-        if (f->finished)
-            ret = AVERROR_EOF;
-        else
-            ret = AVERROR(EAGAIN);
-    }
-
-    pthread_mutex_unlock(&f->fifo_lock);
-
-    return ret;
+    return av_spsc_queue_recv(f->in_queue, pkt, AV_SPSC_QUEUE_FLAG_NONBLOCK);
 }
 #endif
 
@@ -2702,6 +3232,9 @@ static int transcode(void)
     OutputStream *ost;
     InputStream *ist;
     int64_t timer_start;
+#if HAVE_PTHREADS
+    unsigned pipeline_seen = 0;
+#endif
 
     ret = transcode_init();
     if (ret < 0)
@@ -2715,6 +3248,8 @@ static int transcode(void)
 #if HAVE_PTHREADS
     if ((ret = init_input_threads()) < 0)
         goto fail;
+    if ((ret = init_pipeline()) < 0)
+        goto fail;
 #endif
 
     while (!received_sigterm) {
@@ -2731,7 +3266,18 @@ static int transcode(void)
                 need_input = 0;
         }
 
-        ret = poll_filters();
+#if HAVE_PTHREADS
+        /* the filtergraphs are polled by their own threads */
+        if (pipeline_active) {
+            check_pipeline_failure();
+            if (!need_input)
+                wait_pipeline_progress(&pipeline_seen);
+            print_report(0, timer_start);
+            continue;
+        }
+#endif
+
+        ret = poll_filters(NULL);
         if (ret < 0 && ret != AVERROR_EOF) {
             char errbuf[128];
             av_strerror(ret, errbuf, sizeof(errbuf));
@@ -2754,7 +3300,12 @@ static int transcode(void)
             process_input_packet(ist, NULL, 0);
         }
     }
-    poll_filters();
+#if HAVE_PTHREADS
+    /* wait for the frames still in the pipeline to be encoded */
+    free_pipeline(0);
+    check_pipeline_failure();
+#endif
+    poll_filters(NULL);
     flush_encoders();
 
     term_exit();
@@ -2801,6 +3352,7 @@ static int transcode(void)
  fail:
 #if HAVE_PTHREADS
     free_input_threads();
+    free_pipeline(1);
 #endif
 
     if (output_streams) {
@@ -21,6 +21,7 @@
 
 #include "config.h"
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -42,6 +43,7 @@
 #include "libavutil/fifo.h"
 #include "libavutil/pixfmt.h"
 #include "libavutil/rational.h"
+#include "libavutil/spscqueue.h"
 
 #define VSYNC_AUTO       -1
 #define VSYNC_PASSTHROUGH 0
@@ -251,6 +253,12 @@ typedef struct FilterGraph {
     int          nb_inputs;
     OutputFilter **outputs;
     int         nb_outputs;
+
+#if HAVE_PTHREADS
+    pthread_t thread;           /* thread running this filtergraph */
+    int thread_started;
+    struct FrameQueue *queue;   /* decoded frames waiting to be filtered */
+#endif
 } FilterGraph;
 
 typedef struct InputStream {
@@ -333,11 +341,8 @@ typedef struct InputFile {
 
 #if HAVE_PTHREADS
     pthread_t thread;           /* thread reading from this file */
-    int finished;               /* the thread has exited */
     int joined;                 /* the thread has been joined */
-    pthread_mutex_t fifo_lock;  /* lock for access to fifo */
-    pthread_cond_t  fifo_cond;  /* the main thread will signal on this cond after reading from fifo */
-    AVFifoBuffer *fifo;         /* demuxed packets are stored here; freed by the main thread */
+    AVSPSCQueue *in_queue;      /* demuxed packets are sent here; freed by the main thread */
 #endif
 } InputFile;
 
@@ -347,7 +352,7 @@ typedef struct OutputStream {
     int source_index;        /* InputStream index */
     AVStream *st;            /* stream in the output file */
     int encoding_needed;     /* true if encoding needed for this stream */
-    int frame_number;
+    atomic_int frame_number;
     /* input pts and corresponding output pts
        for A/V sync */
     // double sync_ipts;        /* dts from the AVPacket of the demuxer in second units */
@@ -396,7 +401,7 @@ typedef struct OutputStream {
     int64_t sws_flags;
     AVDictionary *encoder_opts;
     AVDictionary *resample_opts;
-    int finished;        /* no more packets should be written for this stream */
+    atomic_int finished; /* no more packets should be written for this stream */
     int stream_copy;
 
     // init_output_stream() has been called for this stream
@@ -421,6 +426,9 @@ typedef struct OutputStream {
     uint64_t frames_encoded;
     uint64_t samples_encoded;
 
+    // number of frames dropped by the video sync code
+    atomic_int frames_dropped;
+
     /* packet quality factor */
     int quality;
 
@@ -428,6 +436,16 @@ typedef struct OutputStream {
 
     /* the packets are buffered here until the muxer is ready to be initialized */
     AVFifoBuffer *muxing_queue;
+
+    /* end timestamp of the last frame sent to the encoder thread,
+     * in the encoder time base */
+    int64_t queued_pts;
+
+#if HAVE_PTHREADS
+    pthread_t thread;           /* thread encoding and muxing this stream */
+    int thread_started;
+    struct FrameQueue *queue;   /* filtered frames waiting to be encoded */
+#endif
 } OutputStream;
 
 typedef struct OutputFile {
@@ -441,6 +459,10 @@ typedef struct OutputFile {
     int shortest;
 
     int header_written;
+
+#if HAVE_PTHREADS
+    pthread_mutex_t mux_lock;   /* serializes muxing between the encoding threads */
+#endif
 } OutputFile;
 
 extern InputStream **input_streams;
@@ -471,8 +493,10 @@ extern int do_pkt_dump;
 extern int copy_ts;
 extern int copy_tb;
 extern int exit_on_error;
+extern int use_pipeline;
 extern int print_stats;
 extern int qp_hist;
+extern int filter_nb_threads;
 
 extern const AVIOInterruptCB int_cb;
 
@@ -481,6 +505,7 @@ extern const OptionDef options[];
 extern const HWAccel hwaccels[];
 extern int hwaccel_lax_profile_check;
 extern AVBufferRef *hw_device_ctx;
+extern AVBufferRef *thread_pool;
 
 void reset_options(OptionsContext *o);
 void show_usage(void);
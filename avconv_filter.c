@@ -689,6 +689,9 @@ int configure_filtergraph(FilterGraph *fg)
     avfilter_graph_free(&fg->graph);
     if (!(fg->graph = avfilter_graph_alloc()))
         return AVERROR(ENOMEM);
+    fg->graph->nb_threads = filter_nb_threads;
+    if (thread_pool && !(fg->graph->thread_pool = av_buffer_ref(thread_pool)))
+        return AVERROR(ENOMEM);
 
     if (simple) {
         OutputStream *ost = fg->outputs[0]->ost;
@@ -40,6 +40,7 @@
 #include "libavutil/parseutils.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/pixfmt.h"
+#include "libavutil/threadpool.h"
 
 #define DEFAULT_PASS_LOGFILENAME_PREFIX "av2pass"
 
@@ -75,6 +76,7 @@ const HWAccel hwaccels[] = {
 };
 int hwaccel_lax_profile_check = 0;
 AVBufferRef *hw_device_ctx;
+AVBufferRef *thread_pool;
 
 char *vstats_filename;
 
@@ -90,8 +92,13 @@ int do_pkt_dump       = 0;
 int copy_ts           = 0;
 int copy_tb           = 1;
 int exit_on_error     = 0;
+int use_pipeline      = 0;
 int print_stats       = 1;
 int qp_hist           = 0;
+int filter_nb_threads = 0;
+
+static int thread_pool_size   = -1;
+static int thread_affinity    = 0;
 
 static int file_overwrite     = 0;
 static int file_skip          = 0;
@@ -1399,7 +1406,7 @@ static OutputStream *new_attachment_stream(OptionsContext *o, AVFormatContext *o
 {
     OutputStream *ost = new_output_stream(o, oc, AVMEDIA_TYPE_ATTACHMENT);
     ost->stream_copy = 1;
-    ost->finished    = 1;
+    atomic_store(&ost->finished, 1);
     return ost;
 }
 
@@ -2450,6 +2457,16 @@ int avconv_parse_options(int argc, char **argv)
         goto fail;
     }
 
+    /* start the thread pool shared by all the codecs and filtergraphs */
+    if (thread_pool_size >= 0) {
+        ret = av_thread_pool_create(&thread_pool, thread_pool_size,
+                                    thread_affinity ? AV_THREAD_POOL_FLAG_AFFINITY : 0);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_FATAL, "Error creating the thread pool: ");
+            goto fail;
+        }
+    }
+
     /* open input files */
     ret = open_files(&octx.groups[GROUP_INFILE], "input", open_input_file);
     if (ret < 0) {
@@ -2565,6 +2582,15 @@ const OptionDef options[] = {
         "timestamp discontinuity delta threshold", "threshold" },
     { "xerror",         OPT_BOOL | OPT_EXPERT,                       { &exit_on_error },
         "exit on error", "error" },
+    { "pipeline",       OPT_BOOL | OPT_EXPERT,                       { &use_pipeline },
+        "run each filtergraph and each encoder in its own thread" },
+    { "thread_pool",    HAS_ARG | OPT_INT | OPT_EXPERT,              { &thread_pool_size },
+        "run the slice threads of all codecs and filters on one pool of threads "
+        "(0 for one thread per CPU)", "number" },
+    { "thread_affinity", OPT_BOOL | OPT_EXPERT,                      { &thread_affinity },
+        "pin the threads of the thread pool to CPUs" },
+    { "filter_threads", HAS_ARG | OPT_INT | OPT_EXPERT,              { &filter_nb_threads },
+        "number of threads used by each filtergraph (0 for automatic)", "number" },
     { "copyinkf",       OPT_BOOL | OPT_EXPERT | OPT_SPEC |
                         OPT_OUTPUT,                                  { .off = OFFSET(copy_initial_nonkeyframes) },
         "copy initial non-keyframes" },
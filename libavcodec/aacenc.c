@@ -45,8 +45,6 @@
 
 #include "psymodel.h"
 
-#define AAC_MAX_CHANNELS 6
-
 #define ERROR_IF(cond, ...) \
     if (cond) { \
         av_log(avctx, AV_LOG_ERROR, __VA_ARGS__); \
@@ -502,16 +500,137 @@ static void copy_input_samples(AACEncContext *s, const AVFrame *frame)
     }
 }
 
+/**
+ * Select the window sequence of the channels of one channel element and
+ * transform them. Slice threading job, called once per channel element.
+ */
+static int window_and_mdct_job(AVCodecContext *avctx, void *arg,
+                               int el, int threadnr)
+{
+    AACEncContext *s       = avctx->priv_data;
+    const AVFrame *frame   = arg;
+    const int start_ch     = s->chan_offsets[el];
+    const int tag          = s->chan_map[el + 1];
+    const int chans        = tag == TYPE_CPE ? 2 : 1;
+    ChannelElement *cpe    = &s->cpe[el];
+    FFPsyWindowInfo *wi    = s->windows + start_ch;
+    int ch, w;
+
+    for (ch = 0; ch < chans; ch++) {
+        IndividualChannelStream *ics = &cpe->ch[ch].ics;
+        int cur_channel = start_ch + ch;
+        float *overlap  = &s->planar_samples[cur_channel][0];
+        float *samples2 = overlap + 1024;
+        float *la       = samples2 + (448+64);
+        if (!frame)
+            la = NULL;
+        if (tag == TYPE_LFE) {
+            wi[ch].window_type[0] = ONLY_LONG_SEQUENCE;
+            wi[ch].window_shape   = 0;
+            wi[ch].num_windows    = 1;
+            wi[ch].grouping[0]    = 1;
+
+            /* Only the lowest 12 coefficients are used in a LFE channel.
+             * The expression below results in only the bottom 8 coefficients
+             * being used for 11.025kHz to 16kHz sample rates.
+             */
+            ics->num_swb = s->samplerate_index >= 8 ? 1 : 3;
+        } else {
+            wi[ch] = s->psy.model->window(&s->psy, samples2, la, cur_channel,
+                                          ics->window_sequence[0]);
+        }
+        ics->window_sequence[1] = ics->window_sequence[0];
+        ics->window_sequence[0] = wi[ch].window_type[0];
+        ics->use_kb_window[1]   = ics->use_kb_window[0];
+        ics->use_kb_window[0]   = wi[ch].window_shape;
+        ics->num_windows        = wi[ch].num_windows;
+        ics->swb_sizes          = s->psy.bands    [ics->num_windows == 8];
+        ics->num_swb            = tag == TYPE_LFE ? ics->num_swb : s->psy.num_bands[ics->num_windows == 8];
+        for (w = 0; w < ics->num_windows; w++)
+            ics->group_len[w] = wi[ch].grouping[w];
+
+        apply_window_and_mdct(s, &cpe->ch[ch], overlap);
+    }
+    return 0;
+}
+
+/**
+ * Run the part of the psychoacoustic analysis of one channel element that
+ * does not depend on the other elements. Slice threading job.
+ */
+static int psy_prepare_job(AVCodecContext *avctx, void *arg,
+                           int el, int threadnr)
+{
+    AACEncContext *s    = avctx->priv_data;
+    const int start_ch  = s->chan_offsets[el];
+    const int chans     = s->chan_map[el + 1] == TYPE_CPE ? 2 : 1;
+    ChannelElement *cpe = &s->cpe[el];
+    const float *coeffs[2];
+    int ch;
+
+    for (ch = 0; ch < chans; ch++)
+        coeffs[ch] = cpe->ch[ch].coeffs;
+    s->psy.model->prepare_analysis(&s->psy, start_ch, coeffs,
+                                   s->windows + start_ch);
+    return 0;
+}
+
+/**
+ * Search the quantizers and the stereo coding of one channel element.
+ * Slice threading job. Each thread uses its own copy of the encoder context
+ * for the quantization scratch buffers.
+ */
+static int search_element_job(AVCodecContext *avctx, void *arg,
+                              int el, int threadnr)
+{
+    AACEncContext *s    = avctx->priv_data;
+    AACEncContext *ts   = threadnr ? &s->thread_ctx[threadnr - 1] : s;
+    const int start_ch  = s->chan_offsets[el];
+    const int chans     = s->chan_map[el + 1] == TYPE_CPE ? 2 : 1;
+    ChannelElement *cpe = &s->cpe[el];
+    FFPsyWindowInfo *wi = s->windows + start_ch;
+    int ch, w, g;
+
+    for (ch = 0; ch < chans; ch++) {
+        ts->cur_channel = start_ch + ch;
+        s->coder->search_for_quantizers(avctx, ts, &cpe->ch[ch], s->lambda);
+    }
+    cpe->common_window = 0;
+    if (chans > 1
+        && wi[0].window_type[0] == wi[1].window_type[0]
+        && wi[0].window_shape   == wi[1].window_shape) {
+
+        cpe->common_window = 1;
+        for (w = 0; w < wi[0].num_windows; w++) {
+            if (wi[0].grouping[w] != wi[1].grouping[w]) {
+                cpe->common_window = 0;
+                break;
+            }
+        }
+    }
+    ts->cur_channel = start_ch;
+    if (s->options.stereo_mode && cpe->common_window) {
+        if (s->options.stereo_mode > 0) {
+            IndividualChannelStream *ics = &cpe->ch[0].ics;
+            for (w = 0; w < ics->num_windows; w += ics->group_len[w])
+                for (g = 0;  g < ics->num_swb; g++)
+                    cpe->ms_mask[w*16+g] = 1;
+        } else if (s->coder->search_for_ms) {
+            s->coder->search_for_ms(ts, cpe, s->lambda);
+        }
+    }
+    adjust_frame_information(cpe, chans);
+    return 0;
+}
+
 static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                             const AVFrame *frame, int *got_packet_ptr)
 {
     AACEncContext *s = avctx->priv_data;
-    float **samples = s->planar_samples, *samples2, *la, *overlap;
     ChannelElement *cpe;
-    int i, ch, w, g, chans, tag, start_ch, ret;
+    int i, ch, chans, tag, start_ch, ret;
     int chan_el_counter[4];
     int frame_bits;
-    FFPsyWindowInfo windows[AAC_MAX_CHANNELS];
 
     if (s->last_frame == 2)
         return 0;
@@ -529,101 +648,46 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
     if (!avctx->frame_number)
         return 0;
 
-    start_ch = 0;
-    for (i = 0; i < s->chan_map[0]; i++) {
-        FFPsyWindowInfo* wi = windows + start_ch;
-        tag      = s->chan_map[i+1];
-        chans    = tag == TYPE_CPE ? 2 : 1;
-        cpe      = &s->cpe[i];
-        for (ch = 0; ch < chans; ch++) {
-            IndividualChannelStream *ics = &cpe->ch[ch].ics;
-            int cur_channel = start_ch + ch;
-            overlap  = &samples[cur_channel][0];
-            samples2 = overlap + 1024;
-            la       = samples2 + (448+64);
-            if (!frame)
-                la = NULL;
-            if (tag == TYPE_LFE) {
-                wi[ch].window_type[0] = ONLY_LONG_SEQUENCE;
-                wi[ch].window_shape   = 0;
-                wi[ch].num_windows    = 1;
-                wi[ch].grouping[0]    = 1;
-
-                /* Only the lowest 12 coefficients are used in a LFE channel.
-                 * The expression below results in only the bottom 8 coefficients
-                 * being used for 11.025kHz to 16kHz sample rates.
-                 */
-                ics->num_swb = s->samplerate_index >= 8 ? 1 : 3;
-            } else {
-                wi[ch] = s->psy.model->window(&s->psy, samples2, la, cur_channel,
-                                              ics->window_sequence[0]);
-            }
-            ics->window_sequence[1] = ics->window_sequence[0];
-            ics->window_sequence[0] = wi[ch].window_type[0];
-            ics->use_kb_window[1]   = ics->use_kb_window[0];
-            ics->use_kb_window[0]   = wi[ch].window_shape;
-            ics->num_windows        = wi[ch].num_windows;
-            ics->swb_sizes          = s->psy.bands    [ics->num_windows == 8];
-            ics->num_swb            = tag == TYPE_LFE ? ics->num_swb : s->psy.num_bands[ics->num_windows == 8];
-            for (w = 0; w < ics->num_windows; w++)
-                ics->group_len[w] = wi[ch].grouping[w];
-
-            apply_window_and_mdct(s, &cpe->ch[ch], overlap);
-        }
-        start_ch += chans;
-    }
+    avctx->execute2(avctx, window_and_mdct_job, (void *)frame, NULL,
+                    s->chan_map[0]);
+
     if ((ret = ff_alloc_packet(avpkt, 768 * s->channels))) {
         av_log(avctx, AV_LOG_ERROR, "Error getting output packet\n");
         return ret;
     }
 
     do {
+        /* The bit reservoir state of the psychoacoustic model is carried
+         * from element to element, so only the part of the analysis before
+         * it runs in parallel. */
+        if (s->psy.model->prepare_analysis)
+            avctx->execute2(avctx, psy_prepare_job, NULL, NULL, s->chan_map[0]);
+        for (i = 0; i < s->chan_map[0]; i++) {
+            const float *coeffs[2];
+            start_ch = s->chan_offsets[i];
+            chans    = s->chan_map[i+1] == TYPE_CPE ? 2 : 1;
+            cpe      = &s->cpe[i];
+            for (ch = 0; ch < chans; ch++)
+                coeffs[ch] = cpe->ch[ch].coeffs;
+            s->psy.model->analyze(&s->psy, start_ch, coeffs, s->windows + start_ch);
+        }
+
+        for (i = 0; i < avctx->thread_count - 1; i++)
+            memcpy(&s->thread_ctx[i], s, offsetof(AACEncContext, qcoefs));
+        avctx->execute2(avctx, search_element_job, NULL, NULL, s->chan_map[0]);
+
         init_put_bits(&s->pb, avpkt->data, avpkt->size);
 
         if ((avctx->frame_number & 0xFF)==1 && !(avctx->flags & AV_CODEC_FLAG_BITEXACT))
             put_bitstream_info(s, LIBAVCODEC_IDENT);
-        start_ch = 0;
         memset(chan_el_counter, 0, sizeof(chan_el_counter));
         for (i = 0; i < s->chan_map[0]; i++) {
-            FFPsyWindowInfo* wi = windows + start_ch;
-            const float *coeffs[2];
             tag      = s->chan_map[i+1];
             chans    = tag == TYPE_CPE ? 2 : 1;
+            start_ch = s->chan_offsets[i];
             cpe      = &s->cpe[i];
             put_bits(&s->pb, 3, tag);
             put_bits(&s->pb, 4, chan_el_counter[tag]++);
-            for (ch = 0; ch < chans; ch++)
-                coeffs[ch] = cpe->ch[ch].coeffs;
-            s->psy.model->analyze(&s->psy, start_ch, coeffs, wi);
-            for (ch = 0; ch < chans; ch++) {
-                s->cur_channel = start_ch + ch;
-                s->coder->search_for_quantizers(avctx, s, &cpe->ch[ch], s->lambda);
-            }
-            cpe->common_window = 0;
-            if (chans > 1
-                && wi[0].window_type[0] == wi[1].window_type[0]
-                && wi[0].window_shape   == wi[1].window_shape) {
-
-                cpe->common_window = 1;
-                for (w = 0; w < wi[0].num_windows; w++) {
-                    if (wi[0].grouping[w] != wi[1].grouping[w]) {
-                        cpe->common_window = 0;
-                        break;
-                    }
-                }
-            }
-            s->cur_channel = start_ch;
-            if (s->options.stereo_mode && cpe->common_window) {
-                if (s->options.stereo_mode > 0) {
-                    IndividualChannelStream *ics = &cpe->ch[0].ics;
-                    for (w = 0; w < ics->num_windows; w += ics->group_len[w])
-                        for (g = 0;  g < ics->num_swb; g++)
-                            cpe->ms_mask[w*16+g] = 1;
-                } else if (s->coder->search_for_ms) {
-                    s->coder->search_for_ms(s, cpe, s->lambda);
-                }
-            }
-            adjust_frame_information(cpe, chans);
             if (chans == 2) {
                 put_bits(&s->pb, 1, cpe->common_window);
                 if (cpe->common_window) {
@@ -635,7 +699,6 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                 s->cur_channel = start_ch + ch;
                 encode_individual_channel(avctx, s, &cpe->ch[ch], cpe->common_window);
             }
-            start_ch += chans;
         }
 
         frame_bits = put_bits_count(&s->pb);
@@ -686,6 +749,7 @@ static av_cold int aac_encode_end(AVCodecContext *avctx)
         ff_psy_preprocess_end(s->psypp);
     av_freep(&s->buffer.samples);
     av_freep(&s->cpe);
+    av_freep(&s->thread_ctx);
     ff_af_queue_close(&s->afq);
     return 0;
 }
@@ -716,6 +780,8 @@ static av_cold int alloc_buffers(AVCodecContext *avctx, AACEncContext *s)
     FF_ALLOCZ_OR_GOTO(avctx, s->buffer.samples, 3 * 1024 * s->channels * sizeof(s->buffer.samples[0]), alloc_fail);
     FF_ALLOCZ_OR_GOTO(avctx, s->cpe, sizeof(ChannelElement) * s->chan_map[0], alloc_fail);
     FF_ALLOCZ_OR_GOTO(avctx, avctx->extradata, 5 + AV_INPUT_BUFFER_PADDING_SIZE, alloc_fail);
+    if (avctx->thread_count > 1)
+        FF_ALLOCZ_OR_GOTO(avctx, s->thread_ctx, sizeof(*s->thread_ctx) * (avctx->thread_count - 1), alloc_fail);
 
     for(ch = 0; ch < s->channels; ch++)
         s->planar_samples[ch] = s->buffer.samples + 3 * 1024 * ch;
@@ -769,8 +835,10 @@ static av_cold int aac_encode_init(AVCodecContext *avctx)
     sizes[1]   = swb_size_128[i];
     lengths[0] = ff_aac_num_swb_1024[i];
     lengths[1] = ff_aac_num_swb_128[i];
-    for (i = 0; i < s->chan_map[0]; i++)
+    for (i = 0; i < s->chan_map[0]; i++) {
         grouping[i] = s->chan_map[i + 1] == TYPE_CPE;
+        s->chan_offsets[i] = i ? s->chan_offsets[i - 1] + 1 + grouping[i - 1] : 0;
+    }
     if ((ret = ff_psy_init(&s->psy, avctx, 2, sizes, lengths,
                            s->chan_map[0], grouping)) < 0)
         goto fail;
@@ -819,7 +887,7 @@ AVCodec ff_aac_encoder = {
     .encode2        = aac_encode_frame,
     .close          = aac_encode_end,
     .capabilities   = AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_EXPERIMENTAL,
+                      AV_CODEC_CAP_EXPERIMENTAL | AV_CODEC_CAP_SLICE_THREADS,
     .sample_fmts    = (const enum AVSampleFormat[]){ AV_SAMPLE_FMT_FLTP,
                                                      AV_SAMPLE_FMT_NONE },
     .priv_class     = &aacenc_class,
@@ -30,6 +30,8 @@
 #include "audio_frame_queue.h"
 #include "psymodel.h"
 
+#define AAC_MAX_CHANNELS 6
+
 typedef struct AACEncOptions {
     int stereo_mode;
 } AACEncOptions;
@@ -63,8 +65,10 @@ typedef struct AACEncContext {
     int samplerate_index;                        ///< MPEG-4 samplerate index
     int channels;                                ///< channel count
     const uint8_t *chan_map;                     ///< channel configuration map
+    int chan_offsets[AAC_MAX_CHANNELS];          ///< first channel of each channel element
 
     ChannelElement *cpe;                         ///< channel elements
+    FFPsyWindowInfo windows[AAC_MAX_CHANNELS];   ///< window information of the current frame
     FFPsyContext psy;
     struct FFPsyPreprocessContext* psypp;
     const AACCoefficientsEncoder *coder;
@@ -72,6 +76,7 @@ typedef struct AACEncContext {
     int last_frame;
     float lambda;
     AudioFrameQueue afq;
+    struct AACEncContext *thread_ctx;            ///< copies used by the slice threads other than the first
     DECLARE_ALIGNED(16, int,   qcoefs)[96];      ///< quantized coefficients
     DECLARE_ALIGNED(32, float, scoefs)[1024];    ///< scaled coefficients
 
@@ -119,6 +119,10 @@ typedef struct AacPsyChannel{
     AacPsyBand band[128];               ///< bands information
     AacPsyBand prev_band[128];          ///< bands information from the previous frame
 
+    float       pe;                      ///< perceptual entropy of the current frame
+    float       pe_const;                ///< constant part of the perceptual entropy
+    float       active_lines;            ///< number of active spectral lines
+
     float       win_energy;              ///< sliding average of channel energy
     float       iir_state[2];            ///< hi-pass IIR filter state
     uint8_t     next_grouping;           ///< stored grouping scheme for the next frame (in case of 8 short window sequence)
@@ -562,21 +566,23 @@ static float calc_reduced_thr_3gpp(AacPsyBand *band, float min_snr,
 }
 
 /**
- * Calculate band thresholds as suggested in 3GPP TS26.403
+ * Calculate the initial band thresholds and the perceptual entropy of
+ * a channel as suggested in 3GPP TS26.403. This only depends on the channel
+ * itself.
  */
-static void psy_3gpp_analyze_channel(FFPsyContext *ctx, int channel,
+static void psy_3gpp_calc_thresholds(FFPsyContext *ctx, int channel,
                                      const float *coefs, const FFPsyWindowInfo *wi)
 {
     AacPsyContext *pctx = (AacPsyContext*) ctx->model_priv_data;
     AacPsyChannel *pch  = &pctx->ch[channel];
     int start = 0;
     int i, w, g;
-    float desired_bits, desired_pe, delta_pe, reduction, spread_en[128] = {0};
-    float a = 0.0f, active_lines = 0.0f, norm_fac = 0.0f;
+    float spread_en[128] = {0};
+    float a = 0.0f, active_lines = 0.0f;
     float pe = pctx->chan_bitrate > 32000 ? 0.0f : FFMAX(50.0f, 100.0f - pctx->chan_bitrate * 100.0f / 32000.0f);
     const int      num_bands   = ctx->num_bands[wi->num_windows == 8];
     const uint8_t *band_sizes  = ctx->bands[wi->num_windows == 8];
-    AacPsyCoeffs  *coeffs      = pctx->psy_coef[wi->num_windows == 8];
+    const AacPsyCoeffs *coeffs = pctx->psy_coef[wi->num_windows == 8];
     const float avoid_hole_thr = wi->num_windows == 8 ? PSY_3GPP_AH_THR_SHORT : PSY_3GPP_AH_THR_LONG;
 
     //calculate energies, initial thresholds and related values - 5.4.2 "Threshold Calculation"
@@ -633,6 +639,30 @@ static void psy_3gpp_analyze_channel(FFPsyContext *ctx, int channel,
         }
     }
 
+    pch->pe           = pe;
+    pch->pe_const     = a;
+    pch->active_lines = active_lines;
+}
+
+/**
+ * Reduce the band thresholds of a channel to the bit demand as suggested in
+ * 3GPP TS26.403. The bit reservoir state is carried from channel to channel,
+ * so the channels must be processed in order.
+ */
+static void psy_3gpp_analyze_channel(FFPsyContext *ctx, int channel,
+                                     const FFPsyWindowInfo *wi)
+{
+    AacPsyContext *pctx = (AacPsyContext*) ctx->model_priv_data;
+    AacPsyChannel *pch  = &pctx->ch[channel];
+    int i, w, g;
+    float desired_bits, desired_pe, delta_pe, reduction;
+    float a            = pch->pe_const;
+    float active_lines = pch->active_lines;
+    float pe           = pch->pe;
+    float norm_fac     = 0.0f;
+    const int      num_bands   = ctx->num_bands[wi->num_windows == 8];
+    AacPsyCoeffs  *coeffs      = pctx->psy_coef[wi->num_windows == 8];
+
     /* 5.6.1.3.2 "Calculation of the desired perceptual entropy" */
     ctx->ch[channel].entropy = pe;
     desired_bits = calc_bit_demand(pctx, pe, ctx->bitres.bits, ctx->bitres.size, wi->num_windows == 8);
@@ -748,6 +778,16 @@ static void psy_3gpp_analyze_channel(FFPsyContext *ctx, int channel,
     memcpy(pch->prev_band, pch->band, sizeof(pch->band));
 }
 
+static void psy_3gpp_prepare_analysis(FFPsyContext *ctx, int channel,
+                                      const float **coeffs, const FFPsyWindowInfo *wi)
+{
+    int ch;
+    FFPsyChannelGroup *group = ff_psy_find_group(ctx, channel);
+
+    for (ch = 0; ch < group->num_ch; ch++)
+        psy_3gpp_calc_thresholds(ctx, channel + ch, coeffs[ch], &wi[ch]);
+}
+
 static void psy_3gpp_analyze(FFPsyContext *ctx, int channel,
                                    const float **coeffs, const FFPsyWindowInfo *wi)
 {
@@ -755,7 +795,7 @@ static void psy_3gpp_analyze(FFPsyContext *ctx, int channel,
     FFPsyChannelGroup *group = ff_psy_find_group(ctx, channel);
 
     for (ch = 0; ch < group->num_ch; ch++)
-        psy_3gpp_analyze_channel(ctx, channel + ch, coeffs[ch], &wi[ch]);
+        psy_3gpp_analyze_channel(ctx, channel + ch, &wi[ch]);
 }
 
 static av_cold void psy_3gpp_end(FFPsyContext *apc)
@@ -935,6 +975,7 @@ const FFPsyModel ff_aac_psy_model =
     .name    = "3GPP TS 26.403-inspired model",
     .init    = psy_3gpp_init,
     .window  = psy_lame_window,
+    .prepare_analysis = psy_3gpp_prepare_analysis,
     .analyze = psy_3gpp_analyze,
     .end     = psy_3gpp_end,
 };
@@ -3139,6 +3139,22 @@ typedef struct AVCodecContext {
      * (with the display dimensions being determined by the crop_* fields).
      */
     int apply_cropping;
+
+    /**
+     * A reference to an AVThreadPool (see libavutil/threadpool.h) to run the
+     * slice threading jobs of this context on, instead of starting threads
+     * for it. The pool may be shared with other codec contexts, filter
+     * graphs and scalers. The reference is set by the caller and afterwards
+     * owned (and freed) by libavcodec.
+     *
+     * When set, thread_count limits the number of jobs of this context
+     * running at the same time; zero means as many as the pool has threads,
+     * plus the calling thread. Frame threading still uses its own threads.
+     *
+     * - encoding: May be set by the caller before avcodec_open2().
+     * - decoding: May be set by the caller before avcodec_open2().
+     */
+    AVBufferRef *thread_pool;
 } AVCodecContext;
 
 /**
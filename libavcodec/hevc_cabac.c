@@ -375,6 +375,16 @@ static void cabac_init_state(HEVCContext *s)
     }
 }
 
+void ff_hevc_cabac_init_substream(HEVCContext *s, const uint8_t *buf, int size,
+                                  const uint8_t *states)
+{
+    ff_init_cabac_decoder(&s->HEVClc.cc, buf, size);
+    if (states)
+        memcpy(s->HEVClc.cabac_state, states, HEVC_CONTEXTS);
+    else
+        cabac_init_state(s);
+}
+
 void ff_hevc_cabac_init(HEVCContext *s, int ctb_addr_ts)
 {
     if (ctb_addr_ts == s->ps.pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs]) {
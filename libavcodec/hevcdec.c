@@ -128,6 +128,7 @@ static void pic_arrays_free(HEVCContext *s)
     av_freep(&s->qp_y_tab);
     av_freep(&s->tab_slice_address);
     av_freep(&s->filter_slice_edges);
+    av_freep(&s->wpp_states);
 
     av_freep(&s->horizontal_bs);
     av_freep(&s->vertical_bs);
@@ -174,6 +175,10 @@ static int pic_arrays_init(HEVCContext *s, const HEVCSPS *sps)
     if (!s->qp_y_tab || !s->filter_slice_edges || !s->tab_slice_address)
         goto fail;
 
+    s->wpp_states = av_malloc_array(sps->ctb_height, sizeof(*s->wpp_states));
+    if (!s->wpp_states)
+        goto fail;
+
     s->horizontal_bs = av_mallocz(2 * s->bs_width * (s->bs_height + 1));
     s->vertical_bs   = av_mallocz(2 * s->bs_width * (s->bs_height + 1));
     if (!s->horizontal_bs || !s->vertical_bs)
@@ -454,6 +459,25 @@ fail:
     return ret;
 }
 
+static int alloc_entry_points(HEVCContext *s, int nb_entries)
+{
+    int ret;
+
+    if (nb_entries <= s->nb_entries_allocated)
+        return 0;
+
+    if ((ret = av_reallocp_array(&s->entry_point_offset, nb_entries, sizeof(*s->entry_point_offset))) < 0 ||
+        (ret = av_reallocp_array(&s->entry_pos,          nb_entries, sizeof(*s->entry_pos)))          < 0 ||
+        (ret = av_reallocp_array(&s->entry_size,         nb_entries, sizeof(*s->entry_size)))         < 0 ||
+        (ret = av_reallocp_array(&s->entry_ret,          nb_entries, sizeof(*s->entry_ret)))          < 0) {
+        s->nb_entries_allocated = 0;
+        return ret;
+    }
+    s->nb_entries_allocated = nb_entries;
+
+    return 0;
+}
+
 static int hls_slice_header(HEVCContext *s)
 {
     GetBitContext *gb = &s->HEVClc.gb;
@@ -759,12 +783,37 @@ static int hls_slice_header(HEVCContext *s)
 
     sh->num_entry_point_offsets = 0;
     if (s->ps.pps->tiles_enabled_flag || s->ps.pps->entropy_coding_sync_enabled_flag) {
+        unsigned int max_entries = s->ps.sps->ctb_height;
+        if (s->ps.pps->tiles_enabled_flag)
+            max_entries = s->ps.pps->num_tile_columns *
+                          (s->ps.pps->entropy_coding_sync_enabled_flag ?
+                           s->ps.sps->ctb_height : s->ps.pps->num_tile_rows);
+
         sh->num_entry_point_offsets = get_ue_golomb_long(gb);
+        if (sh->num_entry_point_offsets >= max_entries) {
+            av_log(s->avctx, AV_LOG_ERROR, "Invalid number of entry points: %d.\n",
+                   sh->num_entry_point_offsets);
+            sh->num_entry_point_offsets = 0;
+            return AVERROR_INVALIDDATA;
+        }
         if (sh->num_entry_point_offsets > 0) {
             int offset_len = get_ue_golomb_long(gb) + 1;
 
+            if (offset_len > 32) {
+                av_log(s->avctx, AV_LOG_ERROR, "Invalid entry point offset length: %d.\n",
+                       offset_len);
+                sh->num_entry_point_offsets = 0;
+                return AVERROR_INVALIDDATA;
+            }
+
+            ret = alloc_entry_points(s, sh->num_entry_point_offsets + 1);
+            if (ret < 0) {
+                sh->num_entry_point_offsets = 0;
+                return ret;
+            }
+
             for (i = 0; i < sh->num_entry_point_offsets; i++)
-                skip_bits(gb, offset_len);
+                s->entry_point_offset[i] = get_bits_long(gb, offset_len) + 1;
         }
     }
 
@@ -2329,6 +2378,243 @@ static int hls_slice_data(HEVCContext *s)
     return ctb_addr_ts;
 }
 
+/*
+ * Locate the substreams of the slice segment in the unescaped NAL unit. The
+ * entry point offsets count the emulation prevention bytes, so they are
+ * applied to the escaped data.
+ */
+static int hls_entry_points(HEVCContext *s, const H2645NAL *nal)
+{
+    const uint8_t *raw = nal->raw_data;
+    int nb_entries     = s->sh.num_entry_point_offsets + 1;
+    int data_start     = (get_bits_count(&s->HEVClc.gb) + 1 + 7) / 8;
+    int64_t raw_next   = 0;
+    int raw_pos = 0, pos = 0, zeros = 0, i = 0;
+
+    while (i < nb_entries) {
+        if (i ? raw_pos == raw_next : pos == data_start) {
+            s->entry_pos[i] = pos;
+            if (i < nb_entries - 1)
+                raw_next = raw_pos + s->entry_point_offset[i];
+            i++;
+            continue;
+        }
+        if (raw_pos >= nal->raw_size || (i && raw_pos > raw_next))
+            return AVERROR_INVALIDDATA;
+
+        if (zeros >= 2 && raw[raw_pos] == 3) {
+            zeros = 0;
+        } else {
+            zeros = raw[raw_pos] ? 0 : zeros + 1;
+            pos++;
+        }
+        raw_pos++;
+    }
+
+    for (i = 0; i < nb_entries; i++) {
+        int end = i < nb_entries - 1 ? s->entry_pos[i + 1] : nal->size;
+        s->entry_size[i] = end - s->entry_pos[i];
+        if (s->entry_size[i] <= 0)
+            return AVERROR_INVALIDDATA;
+    }
+
+    return 0;
+}
+
+/*
+ * Decode one substream of the slice segment: a CTB row with WPP, which waits
+ * for the row above to be two CTBs ahead, or a tile. Each slice thread works
+ * on its own copy of the context, so that it has its own HEVCLocalContext.
+ */
+static int hls_decode_entry(AVCodecContext *avctx, void *arg, int job, int thread)
+{
+    HEVCContext       *s = avctx->priv_data;
+    HEVCContext      *s1 = &s->slice_ctx[thread];
+    HEVCLocalContext *lc = &s1->HEVClc;
+    const uint8_t *data  = arg;
+    int ctb_size         = 1 << s->ps.sps->log2_ctb_size;
+    int ctb_width        = s->ps.sps->ctb_width;
+    int wpp              = s->ps.pps->entropy_coding_sync_enabled_flag;
+    int last             = job == s->sh.num_entry_point_offsets;
+    int more_data        = 1;
+    int row = 0, start_ts, ctb_addr_ts, ret;
+
+    memcpy(lc, &s->HEVClc, sizeof(*lc));
+
+    if (wpp) {
+        row      = s->sh.slice_ctb_addr_rs / ctb_width + job;
+        start_ts = row * ctb_width;
+    } else {
+        start_ts = s->ps.pps->ctb_addr_rs_to_ts[s->ps.pps->tile_pos_rs[job]];
+    }
+
+    for (ctb_addr_ts = start_ts; more_data && ctb_addr_ts < s->ps.sps->ctb_size; ) {
+        int ctb_addr_rs = s->ps.pps->ctb_addr_ts_to_rs[ctb_addr_ts];
+        int x_ctb       = (ctb_addr_rs % ctb_width) << s->ps.sps->log2_ctb_size;
+        int y_ctb       = (ctb_addr_rs / ctb_width) << s->ps.sps->log2_ctb_size;
+
+        if (wpp ? ctb_addr_rs / ctb_width != row :
+                  s->ps.pps->tile_id[ctb_addr_ts] != s->ps.pps->tile_id[start_ts])
+            break;
+
+        if (wpp && job) {
+            ff_thread_await_progress2(avctx, job - 1,
+                                      FFMIN(ctb_addr_rs % ctb_width + 2, ctb_width));
+            if (atomic_load(&s->entry_error)) {
+                ret = AVERROR_INVALIDDATA;
+                goto fail;
+            }
+        }
+
+        hls_decode_neighbour(s1, x_ctb, y_ctb, ctb_addr_ts);
+
+        if (job && ctb_addr_ts == start_ts) {
+            const uint8_t *states = NULL;
+            if (wpp && ctb_width > 1) {
+                states = s->wpp_states[row - 1];
+                memcpy(s1->cabac_state, states, HEVC_CONTEXTS);
+            }
+            ff_hevc_cabac_init_substream(s1, data + s->entry_pos[job],
+                                         s->entry_size[job], states);
+        } else {
+            ff_hevc_cabac_init(s1, ctb_addr_ts);
+        }
+
+        hls_sao_param(s1, x_ctb >> s->ps.sps->log2_ctb_size, y_ctb >> s->ps.sps->log2_ctb_size);
+
+        s->deblock[ctb_addr_rs].beta_offset = s->sh.beta_offset;
+        s->deblock[ctb_addr_rs].tc_offset   = s->sh.tc_offset;
+        s->filter_slice_edges[ctb_addr_rs]  = s->sh.slice_loop_filter_across_slices_enabled_flag;
+
+        ret = hls_coding_quadtree(s1, x_ctb, y_ctb, s->ps.sps->log2_ctb_size, 0);
+        if (ret < 0)
+            goto fail;
+        more_data = !ff_hevc_end_of_slice_flag_decode(s1);
+
+        ctb_addr_ts++;
+        ff_hevc_save_states(s1, ctb_addr_ts);
+
+        if (wpp) {
+            if (ctb_addr_rs % ctb_width == 1)
+                memcpy(s->wpp_states[row], lc->cabac_state, HEVC_CONTEXTS);
+            ff_hevc_hls_filters(s1, x_ctb, y_ctb, ctb_size);
+            ff_thread_report_progress2(avctx, job, ctb_addr_rs % ctb_width + 1);
+        }
+    }
+
+    /* only the last substream may end the slice segment, and it must */
+    if (more_data == last) {
+        ret = AVERROR_INVALIDDATA;
+        goto fail;
+    }
+
+    if (last)
+        s->last_entry_thread = thread;
+    if (wpp)
+        ff_thread_report_progress2(avctx, job, INT_MAX);
+
+    return last ? ctb_addr_ts : 0;
+
+fail:
+    atomic_store(&s->entry_error, 1);
+    if (wpp)
+        ff_thread_report_progress2(avctx, job, INT_MAX);
+    return ret;
+}
+
+/*
+ * Return 1 if the substreams of the current slice segment can be decoded in
+ * parallel: CTB rows of a WPP slice segment starting at a row boundary, or
+ * all the tiles of a picture made of a single slice, if the loop filters do
+ * not cross the tile boundaries (they are applied once all the tiles are
+ * decoded).
+ */
+static int use_entry_threads(const HEVCContext *s)
+{
+    const HEVCPPS *pps = s->ps.pps;
+
+    if (!(s->avctx->active_thread_type & FF_THREAD_SLICE) ||
+        s->sh.num_entry_point_offsets <= 0)
+        return 0;
+
+    if (pps->entropy_coding_sync_enabled_flag)
+        return !pps->tiles_enabled_flag &&
+               !(s->sh.slice_ctb_addr_rs % s->ps.sps->ctb_width);
+
+    return !s->sh.slice_ctb_addr_rs &&
+           !pps->loop_filter_across_tiles_enabled_flag &&
+           s->sh.num_entry_point_offsets == pps->num_tile_columns * pps->num_tile_rows - 1;
+}
+
+static int hls_slice_data_entries(HEVCContext *s, const H2645NAL *nal)
+{
+    AVCodecContext *avctx = s->avctx;
+    HEVCContext *last;
+    int ctb_size   = 1 << s->ps.sps->log2_ctb_size;
+    int nb_entries = s->sh.num_entry_point_offsets + 1;
+    int wpp        = s->ps.pps->entropy_coding_sync_enabled_flag;
+    int x_ctb, y_ctb, ctb_addr_ts, ctb_addr_rs, i, ret;
+
+    ret = hls_entry_points(s, nal);
+    if (ret < 0) {
+        av_log(avctx, AV_LOG_ERROR, "Invalid entry point offsets.\n");
+        return ret;
+    }
+
+    if (!s->slice_ctx) {
+        s->slice_ctx = av_malloc_array(avctx->thread_count, sizeof(*s->slice_ctx));
+        if (!s->slice_ctx)
+            return AVERROR(ENOMEM);
+        s->nb_slice_ctx = avctx->thread_count;
+    }
+
+    ret = ff_slice_thread_init_progress(avctx, nb_entries);
+    if (ret < 0)
+        return ret;
+
+    /* the tiles are decoded out of order, the slice covers the whole
+     * picture anyway */
+    if (!wpp) {
+        for (i = 0; i < s->ps.sps->ctb_size; i++)
+            s->tab_slice_address[i] = s->sh.slice_addr;
+    }
+
+    atomic_init(&s->entry_error, 0);
+    for (i = 0; i < s->nb_slice_ctx; i++)
+        memcpy(&s->slice_ctx[i], s, sizeof(*s));
+
+    avctx->execute2(avctx, hls_decode_entry, (void *)nal->data,
+                    s->entry_ret, nb_entries);
+
+    for (i = 0; i < nb_entries; i++)
+        if (s->entry_ret[i] < 0)
+            return s->entry_ret[i];
+
+    /* continue from the state at the end of the slice segment, as for a
+     * serially decoded one */
+    last = &s->slice_ctx[s->last_entry_thread];
+    memcpy(&s->HEVClc, &last->HEVClc, sizeof(s->HEVClc));
+    memcpy(s->cabac_state, last->cabac_state, HEVC_CONTEXTS);
+    ctb_addr_ts = s->entry_ret[nb_entries - 1];
+
+    if (!wpp) {
+        for (ctb_addr_rs = 0; ctb_addr_rs < s->ps.sps->ctb_size; ctb_addr_rs++) {
+            x_ctb = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+            y_ctb = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+            ff_hevc_hls_filters(s, x_ctb, y_ctb, ctb_size);
+        }
+    }
+
+    ctb_addr_rs = s->ps.pps->ctb_addr_ts_to_rs[ctb_addr_ts - 1];
+    x_ctb       = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+    y_ctb       = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+    if (x_ctb + ctb_size >= s->ps.sps->width &&
+        y_ctb + ctb_size >= s->ps.sps->height)
+        ff_hevc_hls_filter(s, x_ctb, y_ctb);
+
+    return ctb_addr_ts;
+}
+
 static void restore_tqb_pixels(HEVCContext *s)
 {
     int min_pu_size = 1 << s->ps.sps->log2_min_pu_size;
@@ -2563,7 +2849,10 @@ static int decode_nal_unit(HEVCContext *s, const H2645NAL *nal)
             if (ret < 0)
                 goto fail;
         } else {
-            ctb_addr_ts = hls_slice_data(s);
+            if (use_entry_threads(s))
+                ctb_addr_ts = hls_slice_data_entries(s, nal);
+            else
+                ctb_addr_ts = hls_slice_data(s);
             if (ctb_addr_ts >= (s->ps.sps->ctb_width * s->ps.sps->ctb_height)) {
                 s->is_decoded = 1;
                 if ((s->ps.pps->transquant_bypass_enable_flag ||
@@ -2888,6 +3177,14 @@ static av_cold int hevc_decode_free(AVCodecContext *avctx)
 
     pic_arrays_free(s);
 
+    av_freep(&s->entry_point_offset);
+    av_freep(&s->entry_pos);
+    av_freep(&s->entry_size);
+    av_freep(&s->entry_ret);
+    s->nb_entries_allocated = 0;
+    av_freep(&s->slice_ctx);
+    s->nb_slice_ctx = 0;
+
     av_freep(&s->md5_ctx);
 
     av_frame_free(&s->tmp_frame);
@@ -3090,7 +3387,7 @@ AVCodec ff_hevc_decoder = {
     .update_thread_context = hevc_update_thread_context,
     .init_thread_copy      = hevc_init_thread_copy,
     .capabilities          = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                             AV_CODEC_CAP_FRAME_THREADS,
+                             AV_CODEC_CAP_SLICE_THREADS | AV_CODEC_CAP_FRAME_THREADS,
     .profiles              = NULL_IF_CONFIG_SMALL(ff_hevc_profiles),
     .caps_internal         = FF_CODEC_CAP_EXPORTS_CROPPING | FF_CODEC_CAP_INIT_THREADSAFE,
 };
@@ -23,6 +23,7 @@
 #ifndef AVCODEC_HEVCDEC_H
 #define AVCODEC_HEVCDEC_H
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -507,6 +508,29 @@ typedef struct HEVCContext {
     // CTB-level flags affecting loop filter operation
     uint8_t *filter_slice_edges;
 
+    /** CABAC states saved in each CTB row, for parallel WPP decoding */
+    uint8_t (*wpp_states)[HEVC_CONTEXTS];
+
+    /**
+     * Substreams (tiles or CTB rows) of the current slice segment.
+     * entry_point_offset holds the offsets coded in the slice header,
+     * entry_pos/entry_size the position of each substream in the unescaped
+     * NAL unit data.
+     */
+    unsigned int *entry_point_offset;
+    int *entry_pos;
+    int *entry_size;
+    int *entry_ret;
+    int  nb_entries_allocated;
+
+    /** copies of the context for each slice thread */
+    struct HEVCContext *slice_ctx;
+    int nb_slice_ctx;
+    /** slice thread which decoded the last substream of the slice segment */
+    int last_entry_thread;
+    /** set when a substream failed to decode, to stop the dependent rows */
+    atomic_int entry_error;
+
     /** used on BE to byteswap the lines for checksumming */
     uint8_t *checksum_buf;
     int      checksum_buf_size;
@@ -579,6 +603,12 @@ int ff_hevc_slice_rpl(HEVCContext *s);
 
 void ff_hevc_save_states(HEVCContext *s, int ctb_addr_ts);
 void ff_hevc_cabac_init(HEVCContext *s, int ctb_addr_ts);
+/**
+ * Start decoding a substream (a tile or a WPP CTB row) at its entry point,
+ * with the given CABAC states or the initial ones of the slice if NULL.
+ */
+void ff_hevc_cabac_init_substream(HEVCContext *s, const uint8_t *buf, int size,
+                                  const uint8_t *states);
 int ff_hevc_sao_merge_flag_decode(HEVCContext *s);
 int ff_hevc_sao_type_idx_decode(HEVCContext *s);
 int ff_hevc_sao_band_position_decode(HEVCContext *s);
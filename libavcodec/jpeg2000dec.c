@@ -62,6 +62,14 @@ typedef struct Jpeg2000Tile {
     uint16_t tp_idx;                    // Tile-part index
 } Jpeg2000Tile;
 
+typedef struct Jpeg2000CblkJob {
+    Jpeg2000Cblk        *cblk;
+    Jpeg2000Component   *comp;
+    Jpeg2000CodingStyle *codsty;
+    Jpeg2000Band        *band;
+    int                 bandpos;
+} Jpeg2000CblkJob;
+
 typedef struct Jpeg2000DecoderContext {
     AVClass         *class;
     AVCodecContext  *avctx;
@@ -89,6 +97,15 @@ typedef struct Jpeg2000DecoderContext {
     Jpeg2000Tile    *tile;
     Jpeg2000DSPContext dsp;
 
+    /* slice threading */
+    Jpeg2000CblkJob *cblk_jobs;
+    unsigned int    cblk_jobs_size;
+    int             nb_cblk_jobs;
+    uint8_t         *dwt_linebuf;
+    unsigned int    dwt_linebuf_size;
+    int             dwt_linebuf_stride;
+    int             nb_slices;  // number of row slices per tile on output
+
     /*options parameters*/
     int             reduction_factor;
 } Jpeg2000DecoderContext;
@@ -1062,84 +1079,200 @@ static void dequantization_int(int x, int y, Jpeg2000Cblk *cblk,
     }
 }
 
-static inline void mct_decode(Jpeg2000DecoderContext *s, Jpeg2000Tile *tile)
+static void *comp_data(Jpeg2000Component *comp, Jpeg2000CodingStyle *codsty)
+{
+    return codsty->transform == FF_DWT97 ? (void *)comp->f_data
+                                         : (void *)comp->i_data;
+}
+
+/* inverse MCT transformation of one slice of the tile rows */
+static inline void mct_decode(Jpeg2000DecoderContext *s, Jpeg2000Tile *tile,
+                              int slice)
 {
-    int i, csize = 1;
+    int i, offset, csize;
+    int w      = tile->comp[0].coord[0][1] - tile->comp[0].coord[0][0];
+    int h      = tile->comp[0].coord[1][1] - tile->comp[0].coord[1][0];
+    int start  = h *  slice      / s->nb_slices;
+    int end    = h * (slice + 1) / s->nb_slices;
     void *src[3];
 
+    offset = start * w;
+    csize  = (end - start) * w;
+
     for (i = 0; i < 3; i++)
         if (tile->codsty[0].transform == FF_DWT97)
-            src[i] = tile->comp[i].f_data;
+            src[i] = tile->comp[i].f_data + offset;
         else
-            src[i] = tile->comp[i].i_data;
-
-    for (i = 0; i < 2; i++)
-        csize *= tile->comp[0].coord[i][1] - tile->comp[0].coord[i][0];
+            src[i] = tile->comp[i].i_data + offset;
 
     s->dsp.mct_decode[tile->codsty[0].transform](src[0], src[1], src[2], csize);
 }
 
-static inline void tile_codeblocks(Jpeg2000DecoderContext *s, Jpeg2000Tile *tile)
+/* Collect the codeblocks of all the tiles, so that Tier-1 decoding can be
+ * spread over the threads. */
+static int collect_codeblocks(Jpeg2000DecoderContext *s)
+{
+    int tileno, compno, reslevelno, bandno, nb_cblks = 0, pass;
+
+    for (pass = 0; pass < 2; pass++) {
+        for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++) {
+            Jpeg2000Tile *tile = s->tile + tileno;
+
+            for (compno = 0; compno < s->ncomponents; compno++) {
+                Jpeg2000Component *comp     = tile->comp + compno;
+                Jpeg2000CodingStyle *codsty = tile->codsty + compno;
+
+                for (reslevelno = 0; reslevelno < codsty->nreslevels2decode; reslevelno++) {
+                    Jpeg2000ResLevel *rlevel = comp->reslevel + reslevelno;
+
+                    for (bandno = 0; bandno < rlevel->nbands; bandno++) {
+                        Jpeg2000Band *band = rlevel->band + bandno;
+                        int nb_precincts, precno, cblkno;
+
+                        if (band->coord[0][0] == band->coord[0][1] ||
+                            band->coord[1][0] == band->coord[1][1])
+                            continue;
+
+                        nb_precincts = rlevel->num_precincts_x * rlevel->num_precincts_y;
+                        for (precno = 0; precno < nb_precincts; precno++) {
+                            Jpeg2000Prec *prec = band->prec + precno;
+                            int nb_cblks_prec  = prec->nb_codeblocks_width *
+                                                 prec->nb_codeblocks_height;
+
+                            if (!pass) {
+                                nb_cblks += nb_cblks_prec;
+                                continue;
+                            }
+                            for (cblkno = 0; cblkno < nb_cblks_prec; cblkno++) {
+                                Jpeg2000CblkJob *job = &s->cblk_jobs[s->nb_cblk_jobs++];
+
+                                job->cblk    = prec->cblk + cblkno;
+                                job->comp    = comp;
+                                job->codsty  = codsty;
+                                job->band    = band;
+                                job->bandpos = bandno + (reslevelno > 0);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        if (!pass) {
+            av_fast_malloc(&s->cblk_jobs, &s->cblk_jobs_size,
+                           nb_cblks * sizeof(*s->cblk_jobs));
+            if (!s->cblk_jobs)
+                return AVERROR(ENOMEM);
+            s->nb_cblk_jobs = 0;
+        }
+    }
+
+    return 0;
+}
+
+static int decode_cblk_job(AVCodecContext *avctx, void *arg,
+                           int jobnr, int threadnr)
 {
+    Jpeg2000DecoderContext *s = avctx->priv_data;
+    Jpeg2000CblkJob *job      = &s->cblk_jobs[jobnr];
+    Jpeg2000Cblk *cblk        = job->cblk;
     Jpeg2000T1Context t1;
+    int x = cblk->coord[0][0];
+    int y = cblk->coord[1][0];
 
-    int compno, reslevelno, bandno;
+    decode_cblk(s, job->codsty, &t1, cblk,
+                cblk->coord[0][1] - x, cblk->coord[1][1] - y,
+                job->bandpos);
 
-    /* Loop on tile components */
+    if (job->codsty->transform == FF_DWT97)
+        dequantization_float(x, y, cblk, job->comp, &t1, job->band);
+    else
+        dequantization_int(x, y, cblk, job->comp, &t1, job->band);
 
-    for (compno = 0; compno < s->ncomponents; compno++) {
-        Jpeg2000Component *comp     = tile->comp + compno;
-        Jpeg2000CodingStyle *codsty = tile->codsty + compno;
-        /* Loop on resolution levels */
-        for (reslevelno = 0; reslevelno < codsty->nreslevels2decode; reslevelno++) {
-            Jpeg2000ResLevel *rlevel = comp->reslevel + reslevelno;
-            /* Loop on bands */
-            for (bandno = 0; bandno < rlevel->nbands; bandno++) {
-                uint16_t nb_precincts, precno;
-                Jpeg2000Band *band = rlevel->band + bandno;
-                int cblkno = 0, bandpos;
-                bandpos = bandno + (reslevelno > 0);
-
-                if (band->coord[0][0] == band->coord[0][1] ||
-                    band->coord[1][0] == band->coord[1][1])
-                    continue;
+    return 0;
+}
 
-                nb_precincts = rlevel->num_precincts_x * rlevel->num_precincts_y;
-                /* Loop on precincts */
-                for (precno = 0; precno < nb_precincts; precno++) {
-                    Jpeg2000Prec *prec = band->prec + precno;
-
-                    /* Loop on codeblocks */
-                    for (cblkno = 0;
-                         cblkno < prec->nb_codeblocks_width * prec->nb_codeblocks_height;
-                         cblkno++) {
-                        int x, y;
-                        Jpeg2000Cblk *cblk = prec->cblk + cblkno;
-                        decode_cblk(s, codsty, &t1, cblk,
-                                    cblk->coord[0][1] - cblk->coord[0][0],
-                                    cblk->coord[1][1] - cblk->coord[1][0],
-                                    bandpos);
-
-                        x = cblk->coord[0][0];
-                        y = cblk->coord[1][0];
-
-                        if (codsty->transform == FF_DWT97)
-                            dequantization_float(x, y, cblk, comp, &t1, band);
-                        else
-                            dequantization_int(x, y, cblk, comp, &t1, band);
-                   } /* end cblk */
-                } /*end prec */
-            } /* end band */
-        } /* end reslevel */
-
-        /* inverse DWT */
-        ff_dwt_decode(&comp->dwt, codsty->transform == FF_DWT97 ? (void*)comp->f_data : (void*)comp->i_data);
-    } /*end comp */
+/* inverse DWT of a whole tile component */
+static int dwt_comp_job(AVCodecContext *avctx, void *arg,
+                        int jobnr, int threadnr)
+{
+    Jpeg2000DecoderContext *s   = avctx->priv_data;
+    Jpeg2000Tile *tile          = s->tile + jobnr / s->ncomponents;
+    Jpeg2000Component *comp     = tile->comp   + jobnr % s->ncomponents;
+    Jpeg2000CodingStyle *codsty = tile->codsty + jobnr % s->ncomponents;
+
+    ff_dwt_decode(&comp->dwt, &s->dsp, comp_data(comp, codsty));
+
+    return 0;
+}
+
+typedef struct DWTLinesJob {
+    DWTContext *dwt;
+    void *data;
+    int lev, dir;
+    int nb_jobs;
+} DWTLinesJob;
+
+/* one pass of one decomposition level over a range of lines */
+static int dwt_lines_job(AVCodecContext *avctx, void *arg,
+                         int jobnr, int threadnr)
+{
+    Jpeg2000DecoderContext *s = avctx->priv_data;
+    DWTLinesJob *job          = arg;
+    int nb_lines              = job->dwt->linelen[job->lev][!job->dir];
+
+    ff_dwt_decode_lines(job->dwt, &s->dsp, job->data, job->lev, job->dir,
+                        nb_lines *  jobnr      / job->nb_jobs,
+                        nb_lines * (jobnr + 1) / job->nb_jobs,
+                        s->dwt_linebuf + threadnr * s->dwt_linebuf_stride);
+
+    return 0;
+}
+
+static int dwt_decode_lines(Jpeg2000DecoderContext *s, int nb_threads)
+{
+    AVCodecContext *avctx = s->avctx;
+    int tileno, compno, stride = 0;
+
+    for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++)
+        for (compno = 0; compno < s->ncomponents; compno++)
+            stride = FFMAX(stride,
+                           ff_dwt_linebuf_size(&s->tile[tileno].comp[compno].dwt));
+
+    s->dwt_linebuf_stride = FFALIGN(stride, 64);
+    av_fast_malloc(&s->dwt_linebuf, &s->dwt_linebuf_size,
+                   s->dwt_linebuf_stride * nb_threads);
+    if (!s->dwt_linebuf)
+        return AVERROR(ENOMEM);
+
+    for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++) {
+        Jpeg2000Tile *tile = s->tile + tileno;
+
+        for (compno = 0; compno < s->ncomponents; compno++) {
+            DWTLinesJob job = {
+                .dwt  = &tile->comp[compno].dwt,
+                .data = comp_data(tile->comp + compno, tile->codsty + compno),
+            };
+
+            /* the levels and passes depend on each other, so only the
+             * lines of a single pass are decoded in parallel */
+            for (job.lev = 0; job.lev < job.dwt->ndeclevels; job.lev++)
+                for (job.dir = 0; job.dir < 2; job.dir++) {
+                    job.nb_jobs = FFMIN(nb_threads,
+                                        job.dwt->linelen[job.lev][!job.dir]);
+                    if (job.nb_jobs > 0)
+                        avctx->execute2(avctx, dwt_lines_job, &job, NULL,
+                                        job.nb_jobs);
+                }
+        }
+    }
+
+    return 0;
 }
 
 #define WRITE_FRAME(D, PIXEL)                                                                     \
     static inline void write_frame_ ## D(Jpeg2000DecoderContext * s, Jpeg2000Tile * tile,         \
-                                         AVFrame * picture)                                       \
+                                         AVFrame * picture, int slice)                            \
     {                                                                                             \
         int linesize = picture->linesize[0] / sizeof(PIXEL);                                      \
         int compno;                                                                               \
@@ -1149,35 +1282,36 @@ static inline void tile_codeblocks(Jpeg2000DecoderContext *s, Jpeg2000Tile *tile
             Jpeg2000Component *comp     = tile->comp + compno;                                    \
             Jpeg2000CodingStyle *codsty = tile->codsty + compno;                                  \
             PIXEL *line;                                                                          \
-            float *datap     = comp->f_data;                                                      \
-            int32_t *i_datap = comp->i_data;                                                      \
-            int cbps         = s->cbps[compno];                                                   \
-            int w            = tile->comp[compno].coord[0][1] - s->image_offset_x;                \
+            int cbps  = s->cbps[compno];                                                          \
+            int x0    = comp->coord[0][0] - s->image_offset_x;                                    \
+            int y0    = comp->coord[1][0] - s->image_offset_y;                                    \
+            int w     = comp->coord[0][1] - s->image_offset_x;                                    \
+            int h     = comp->coord[1][1] - s->image_offset_y;                                    \
+            int ncols = w > x0 ? (w - x0 + s->cdx[compno] - 1) / s->cdx[compno] : 0;              \
+            int nrows = h > y0 ? (h - y0 + s->cdy[compno] - 1) / s->cdy[compno] : 0;              \
+            int start = nrows *  slice      / s->nb_slices;                                       \
+            int end   = nrows * (slice + 1) / s->nb_slices;                                       \
                                                                                                   \
-            y    = tile->comp[compno].coord[1][0] - s->image_offset_y;                            \
-            line = (PIXEL *)picture->data[0] + y * linesize;                                      \
-            for (; y < tile->comp[compno].coord[1][1] - s->image_offset_y; y += s->cdy[compno]) { \
-                PIXEL *dst;                                                                       \
-                                                                                                  \
-                x   = tile->comp[compno].coord[0][0] - s->image_offset_x;                         \
-                dst = line + x * s->ncomponents + compno;                                         \
+            line = (PIXEL *)picture->data[0] + (y0 + start) * linesize;                           \
+            for (y = start; y < end; y++) {                                                       \
+                PIXEL *dst = line + x0 * s->ncomponents + compno;                                 \
                                                                                                   \
                 if (codsty->transform == FF_DWT97) {                                              \
-                    for (; x < w; x += s->cdx[compno]) {                                          \
-                        int val = lrintf(*datap) + (1 << (cbps - 1));                             \
+                    float *datap = comp->f_data + y * ncols;                                      \
+                    for (x = 0; x < ncols; x++) {                                                 \
+                        int val = lrintf(datap[x]) + (1 << (cbps - 1));                           \
                         /* DC level shift and clip see ISO 15444-1:2002 G.1.2 */                  \
                         val  = av_clip(val, 0, (1 << cbps) - 1);                                  \
                         *dst = val << (8 * sizeof(PIXEL) - cbps);                                 \
-                        datap++;                                                                  \
                         dst += s->ncomponents;                                                    \
                     }                                                                             \
                 } else {                                                                          \
-                    for (; x < w; x += s->cdx[compno]) {                                          \
-                        int val = *i_datap + (1 << (cbps - 1));                                   \
+                    int32_t *i_datap = comp->i_data + y * ncols;                                  \
+                    for (x = 0; x < ncols; x++) {                                                 \
+                        int val = i_datap[x] + (1 << (cbps - 1));                                 \
                         /* DC level shift and clip see ISO 15444-1:2002 G.1.2 */                  \
                         val  = av_clip(val, 0, (1 << cbps) - 1);                                  \
                         *dst = val << (8 * sizeof(PIXEL) - cbps);                                 \
-                        i_datap++;                                                                \
                         dst += s->ncomponents;                                                    \
                     }                                                                             \
                 }                                                                                 \
@@ -1192,24 +1326,64 @@ WRITE_FRAME(16, uint16_t)
 
 #undef WRITE_FRAME
 
-static int jpeg2000_decode_tile(Jpeg2000DecoderContext *s, Jpeg2000Tile *tile,
-                                AVFrame *picture)
+/* inverse MCT and output of one slice of the rows of a tile */
+static int output_job(AVCodecContext *avctx, void *arg,
+                      int jobnr, int threadnr)
 {
-    tile_codeblocks(s, tile);
+    Jpeg2000DecoderContext *s = avctx->priv_data;
+    Jpeg2000Tile *tile        = s->tile + jobnr / s->nb_slices;
+    AVFrame *picture          = arg;
+    int slice                 = jobnr % s->nb_slices;
 
-    /* inverse MCT transformation */
     if (tile->codsty[0].mct)
-        mct_decode(s, tile);
+        mct_decode(s, tile, slice);
 
     if (s->precision <= 8) {
-        write_frame_8(s, tile, picture);
+        write_frame_8(s, tile, picture, slice);
     } else {
-        write_frame_16(s, tile, picture);
+        write_frame_16(s, tile, picture, slice);
     }
 
     return 0;
 }
 
+static int jpeg2000_decode_tiles(Jpeg2000DecoderContext *s, AVFrame *picture)
+{
+    AVCodecContext *avctx = s->avctx;
+    int nb_tiles   = s->numXtiles * s->numYtiles;
+    int nb_threads = avctx->active_thread_type & FF_THREAD_SLICE ?
+                     avctx->thread_count : 1;
+    int tileno, compno, ret;
+
+    /* Tier-1 decoding and dequantization of every codeblock */
+    if ((ret = collect_codeblocks(s)) < 0)
+        return ret;
+    if (s->nb_cblk_jobs)
+        avctx->execute2(avctx, decode_cblk_job, NULL, NULL, s->nb_cblk_jobs);
+
+    /* inverse DWT, component by component when there are enough of them to
+     * keep the threads busy, line by line otherwise */
+    if (nb_tiles * s->ncomponents >= nb_threads) {
+        avctx->execute2(avctx, dwt_comp_job, NULL, NULL,
+                        nb_tiles * s->ncomponents);
+    } else if ((ret = dwt_decode_lines(s, nb_threads)) < 0) {
+        return ret;
+    }
+
+    /* the tile rows can be split into slices as long as the MCT works on
+     * components of identical layout */
+    s->nb_slices = nb_tiles < nb_threads ? nb_threads : 1;
+    for (tileno = 0; tileno < nb_tiles; tileno++)
+        if (s->tile[tileno].codsty[0].mct)
+            for (compno = 0; compno < 3; compno++)
+                if (s->cdx[compno] != 1 || s->cdy[compno] != 1)
+                    s->nb_slices = 1;
+
+    avctx->execute2(avctx, output_job, picture, NULL, nb_tiles * s->nb_slices);
+
+    return 0;
+}
+
 static void jpeg2000_dec_cleanup(Jpeg2000DecoderContext *s)
 {
     int tileno, compno;
@@ -1384,7 +1558,7 @@ static int jpeg2000_decode_frame(AVCodecContext *avctx, void *data,
     Jpeg2000DecoderContext *s = avctx->priv_data;
     ThreadFrame frame = { .f = data };
     AVFrame *picture = data;
-    int tileno, ret;
+    int ret;
 
     s->avctx     = avctx;
     bytestream2_init(&s->g, avpkt->data, avpkt->size);
@@ -1428,9 +1602,8 @@ static int jpeg2000_decode_frame(AVCodecContext *avctx, void *data,
 
     if (ret = jpeg2000_read_bitstream_packets(s))
         goto end;
-    for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++)
-        if (ret = jpeg2000_decode_tile(s, s->tile + tileno, picture))
-            goto end;
+    if (ret = jpeg2000_decode_tiles(s, picture))
+        goto end;
 
     jpeg2000_dec_cleanup(s);
 
@@ -1443,6 +1616,18 @@ end:
     return ret;
 }
 
+static av_cold int jpeg2000_decode_close(AVCodecContext *avctx)
+{
+    Jpeg2000DecoderContext *s = avctx->priv_data;
+
+    av_freep(&s->cblk_jobs);
+    s->cblk_jobs_size = 0;
+    av_freep(&s->dwt_linebuf);
+    s->dwt_linebuf_size = 0;
+
+    return 0;
+}
+
 static av_cold void jpeg2000_init_static_data(AVCodec *codec)
 {
     ff_jpeg2000_init_tier1_luts();
@@ -1470,11 +1655,13 @@ AVCodec ff_jpeg2000_decoder = {
     .long_name        = NULL_IF_CONFIG_SMALL("JPEG 2000"),
     .type             = AVMEDIA_TYPE_VIDEO,
     .id               = AV_CODEC_ID_JPEG2000,
-    .capabilities     = AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_DR1,
+    .capabilities     = AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS |
+                        AV_CODEC_CAP_DR1,
     .priv_data_size   = sizeof(Jpeg2000DecoderContext),
     .init_static_data = jpeg2000_init_static_data,
     .init             = jpeg2000_decode_init,
     .decode           = jpeg2000_decode_frame,
+    .close            = jpeg2000_decode_close,
     .priv_class       = &class,
     .profiles         = NULL_IF_CONFIG_SMALL(ff_jpeg2000_profiles)
 };
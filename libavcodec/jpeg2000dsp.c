@@ -90,9 +90,40 @@ static void rct_int(void *_src0, void *_src1, void *_src2, int csize)
     }
 }
 
+static void dwt97_lift_float(float *dst, const float *src0, const float *src1,
+                             float coef, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        dst[i] += coef * (src0[i] + src1[i]);
+}
+
+static void dwt53_lift_low(int32_t *dst, const int32_t *src0,
+                           const int32_t *src1, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        dst[i] -= (src0[i] + src1[i] + 2) >> 2;
+}
+
+static void dwt53_lift_high(int32_t *dst, const int32_t *src0,
+                            const int32_t *src1, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        dst[i] += (src0[i] + src1[i]) >> 1;
+}
+
 av_cold void ff_jpeg2000dsp_init(Jpeg2000DSPContext *c)
 {
     c->mct_decode[FF_DWT97]     = ict_float;
     c->mct_decode[FF_DWT53]     = rct_int;
     c->mct_decode[FF_DWT97_INT] = ict_int;
+
+    c->dwt97_lift_float = dwt97_lift_float;
+    c->dwt53_lift_low   = dwt53_lift_low;
+    c->dwt53_lift_high  = dwt53_lift_high;
 }
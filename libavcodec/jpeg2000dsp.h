@@ -28,6 +28,27 @@
 
 typedef struct Jpeg2000DSPContext {
     void (*mct_decode[FF_DWT_NB])(void *src0, void *src1, void *src2, int csize);
+
+    /**
+     * Lifting step of the inverse 9/7 float DWT:
+     * dst[i] += coef * (src0[i] + src1[i])
+     */
+    void (*dwt97_lift_float)(float *dst, const float *src0, const float *src1,
+                             float coef, int len);
+
+    /**
+     * Low pass lifting step of the inverse 5/3 DWT:
+     * dst[i] -= (src0[i] + src1[i] + 2) >> 2
+     */
+    void (*dwt53_lift_low)(int32_t *dst, const int32_t *src0,
+                           const int32_t *src1, int len);
+
+    /**
+     * High pass lifting step of the inverse 5/3 DWT:
+     * dst[i] += (src0[i] + src1[i]) >> 1
+     */
+    void (*dwt53_lift_high)(int32_t *dst, const int32_t *src0,
+                            const int32_t *src1, int len);
 } Jpeg2000DSPContext;
 
 void ff_jpeg2000dsp_init(Jpeg2000DSPContext *c);
@@ -25,8 +25,11 @@
  * Discrete wavelet transform
  */
 
+#include <string.h>
+
 #include "libavutil/common.h"
 #include "libavutil/mem.h"
+#include "jpeg2000dsp.h"
 #include "jpeg2000dwt.h"
 #include "internal.h"
 
@@ -52,238 +55,295 @@
 #define I_LFTG_X      106544
 
 
-static inline void extend53(int *p, int i0, int i1)
+/* Number of columns transformed together by the vertical passes. */
+#define DWT_STRIP 16
+
+/* The samples of an interleaved line are stored apart, the even (low pass)
+ * ones in l and the odd (high pass) ones in h, so that the lifting steps
+ * run on contiguous data. Each sample is a group of n values from
+ * parallel lines: 1 for the horizontal passes, the width of a strip of
+ * columns for the vertical ones. */
+static inline void *sample(void *l, void *h, int x, int n)
+{
+    return (x & 1 ? (int32_t *)h : (int32_t *)l) + (x >> 1) * n;
+}
+
+#define COPY_SAMPLE(dst, src) \
+    memcpy(sample(l, h, dst, n), sample(l, h, src, n), n * sizeof(int32_t))
+
+static void extend53(int32_t *l, int32_t *h, int i0, int i1, int n)
 {
-    p[i0 - 1] = p[i0 + 1];
-    p[i1]     = p[i1 - 2];
-    p[i0 - 2] = p[i0 + 2];
-    p[i1 + 1] = p[i1 - 3];
+    COPY_SAMPLE(i0 - 1, i0 + 1);
+    COPY_SAMPLE(i1,     i1 - 2);
+    COPY_SAMPLE(i0 - 2, i0 + 2);
+    COPY_SAMPLE(i1 + 1, i1 - 3);
 }
 
-static inline void extend97_float(float *p, int i0, int i1)
+static void extend97(void *l, void *h, int i0, int i1, int n)
 {
     int i;
 
     for (i = 1; i <= 4; i++) {
-        p[i0 - i]     = p[i0 + i];
-        p[i1 + i - 1] = p[i1 - i - 1];
+        COPY_SAMPLE(i0 - i,     i0 + i);
+        COPY_SAMPLE(i1 + i - 1, i1 - i - 1);
     }
 }
 
-static inline void extend97_int(int32_t *p, int i0, int i1)
+/* Low or high pass half of the line buffer, with room for the symmetric
+ * extension on both sides. */
+static void *line_half(DWTContext *s, void *linebuf, int n, int high)
 {
-    int i;
+    int half = (FFMAX(s->linelen[s->ndeclevels - 1][0],
+                      s->linelen[s->ndeclevels - 1][1]) >> 1) + 8;
 
-    for (i = 1; i <= 4; i++) {
-        p[i0 - i]     = p[i0 + i];
-        p[i1 + i - 1] = p[i1 - i - 1];
-    }
+    return (int32_t *)linebuf + (4 + high * half) * n;
 }
 
-static void sr_1d53(int *p, int i0, int i1)
+static void sr_1d53(const Jpeg2000DSPContext *dsp, int32_t *l, int32_t *h,
+                    int i0, int i1, int n)
 {
     int i;
 
     if (i1 == i0 + 1)
         return;
 
-    extend53(p, i0, i1);
+    extend53(l, h, i0, i1, n);
 
-    for (i = i0 / 2; i < i1 / 2 + 1; i++)
-        p[2 * i] -= (p[2 * i - 1] + p[2 * i + 1] + 2) >> 2;
-    for (i = i0 / 2; i < i1 / 2; i++)
-        p[2 * i + 1] += (p[2 * i] + p[2 * i + 2]) >> 1;
+    // p[2 * i] -= (p[2 * i - 1] + p[2 * i + 1] + 2) >> 2
+    i = i0 / 2;
+    dsp->dwt53_lift_low(l + i * n, h + (i - 1) * n, h + i * n,
+                        (i1 / 2 + 1 - i) * n);
+    // p[2 * i + 1] += (p[2 * i] + p[2 * i + 2]) >> 1
+    dsp->dwt53_lift_high(h + i * n, l + i * n, l + (i + 1) * n,
+                         (i1 / 2 - i) * n);
 }
 
-static void dwt_decode53(DWTContext *s, int *t)
+static void dwt_decode53(DWTContext *s, const Jpeg2000DSPContext *dsp,
+                         int *t, int lev, int dir, int start, int end,
+                         void *linebuf)
 {
-    int lev;
-    int w     = s->linelen[s->ndeclevels - 1][0];
-    int32_t *line = s->i_linebuf;
-    line += 3;
-
-    for (lev = 0; lev < s->ndeclevels; lev++) {
-        int lh = s->linelen[lev][0],
-            lv = s->linelen[lev][1],
-            mh = s->mod[lev][0],
-            mv = s->mod[lev][1],
-            lp;
-        int *l;
-
+    int w  = s->linelen[s->ndeclevels - 1][0];
+    int lh = s->linelen[lev][0],
+        lv = s->linelen[lev][1],
+        mh = s->mod[lev][0],
+        mv = s->mod[lev][1],
+        lp;
+    int32_t *l, *h;
+
+    if (!dir) {
         // HOR_SD
-        l = line + mh;
-        for (lp = 0; lp < lv; lp++) {
-            int i, j = 0;
-            // copy with interleaving
-            for (i = mh; i < lh; i += 2, j++)
-                l[i] = t[w * lp + j];
-            for (i = 1 - mh; i < lh; i += 2, j++)
-                l[i] = t[w * lp + j];
+        int nl = (lh - mh + 1) >> 1;
+
+        l = line_half(s, linebuf, 1, 0);
+        h = line_half(s, linebuf, 1, 1);
+        for (lp = start; lp < end; lp++) {
+            int *data = t + w * lp;
+            int i;
+            // copy with deinterleaving
+            memcpy(l + mh, data,      nl        * sizeof(*l));
+            memcpy(h,      data + nl, (lh - nl) * sizeof(*h));
 
-            sr_1d53(line, mh, mh + lh);
+            sr_1d53(dsp, l, h, mh, mh + lh, 1);
 
             for (i = 0; i < lh; i++)
-                t[w * lp + i] = l[i];
+                data[i] = *(int32_t *)sample(l, h, mh + i, 1);
         }
-
+    } else {
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
-            int i, j = 0;
-            // copy with interleaving
-            for (i = mv; i < lv; i += 2, j++)
-                l[i] = t[w * j + lp];
-            for (i = 1 - mv; i < lv; i += 2, j++)
-                l[i] = t[w * j + lp];
+        int nl = (lv - mv + 1) >> 1;
 
-            sr_1d53(line, mv, mv + lv);
+        for (lp = start; lp < end; lp += DWT_STRIP) {
+            int n = FFMIN(DWT_STRIP, end - lp);
+            int i;
 
+            l = line_half(s, linebuf, n, 0);
+            h = line_half(s, linebuf, n, 1);
+            // copy with deinterleaving
             for (i = 0; i < lv; i++)
-                t[w * i + lp] = l[i];
+                memcpy(i < nl ? l + (mv + i) * n : h + (i - nl) * n,
+                       t + w * i + lp, n * sizeof(*l));
+
+            sr_1d53(dsp, l, h, mv, mv + lv, n);
+
+            for (i = 0; i < lv; i++)
+                memcpy(t + w * i + lp, sample(l, h, mv + i, n),
+                       n * sizeof(*l));
         }
     }
 }
 
-static void sr_1d97_float(float *p, int i0, int i1)
+static void sr_1d97_float(const Jpeg2000DSPContext *dsp, float *l, float *h,
+                          int i0, int i1, int n)
 {
-    int i;
+    int i = i0 / 2;
 
     if (i1 == i0 + 1)
         return;
 
-    extend97_float(p, i0, i1);
+    extend97(l, h, i0, i1, n);
 
-    for (i = i0 / 2 - 1; i < i1 / 2 + 2; i++)
-        p[2 * i]     -= F_LFTG_DELTA * (p[2 * i - 1] + p[2 * i + 1]);
+    // p[2 * i] -= F_LFTG_DELTA * (p[2 * i - 1] + p[2 * i + 1])
+    dsp->dwt97_lift_float(l + (i - 1) * n, h + (i - 2) * n, h + (i - 1) * n,
+                          -F_LFTG_DELTA, (i1 / 2 + 3 - i) * n);
     /* step 4 */
-    for (i = i0 / 2 - 1; i < i1 / 2 + 1; i++)
-        p[2 * i + 1] -= F_LFTG_GAMMA * (p[2 * i]     + p[2 * i + 2]);
+    dsp->dwt97_lift_float(h + (i - 1) * n, l + (i - 1) * n, l + i * n,
+                          -F_LFTG_GAMMA, (i1 / 2 + 2 - i) * n);
     /*step 5*/
-    for (i = i0 / 2; i < i1 / 2 + 1; i++)
-        p[2 * i]     += F_LFTG_BETA  * (p[2 * i - 1] + p[2 * i + 1]);
+    dsp->dwt97_lift_float(l + i * n, h + (i - 1) * n, h + i * n,
+                          F_LFTG_BETA, (i1 / 2 + 1 - i) * n);
     /* step 6 */
-    for (i = i0 / 2; i < i1 / 2; i++)
-        p[2 * i + 1] += F_LFTG_ALPHA * (p[2 * i]     + p[2 * i + 2]);
+    dsp->dwt97_lift_float(h + i * n, l + i * n, l + (i + 1) * n,
+                          F_LFTG_ALPHA, (i1 / 2 - i) * n);
 }
 
-static void dwt_decode97_float(DWTContext *s, float *t)
+static void dwt_decode97_float(DWTContext *s, const Jpeg2000DSPContext *dsp,
+                               float *t, int lev, int dir,
+                               int start, int end, void *linebuf)
 {
-    int lev;
-    int w       = s->linelen[s->ndeclevels - 1][0];
-    float *line = s->f_linebuf;
-    float *data = t;
-    /* position at index O of line range [0-5,w+5] cf. extend function */
-    line += 5;
-
-    for (lev = 0; lev < s->ndeclevels; lev++) {
-        int lh = s->linelen[lev][0],
-            lv = s->linelen[lev][1],
-            mh = s->mod[lev][0],
-            mv = s->mod[lev][1],
-            lp;
-        float *l;
+    int w  = s->linelen[s->ndeclevels - 1][0];
+    int lh = s->linelen[lev][0],
+        lv = s->linelen[lev][1],
+        mh = s->mod[lev][0],
+        mv = s->mod[lev][1],
+        lp;
+    float *l, *h;
+
+    if (!dir) {
         // HOR_SD
-        l = line + mh;
-        for (lp = 0; lp < lv; lp++) {
-            int i, j = 0;
-            // copy with interleaving
-            for (i = mh; i < lh; i += 2, j++)
-                l[i] = data[w * lp + j] * F_LFTG_K;
-            for (i = 1 - mh; i < lh; i += 2, j++)
-                l[i] = data[w * lp + j] * F_LFTG_X;
+        int nl = (lh - mh + 1) >> 1;
+
+        l = line_half(s, linebuf, 1, 0);
+        h = line_half(s, linebuf, 1, 1);
+        for (lp = start; lp < end; lp++) {
+            float *data = t + w * lp;
+            int i;
+            // copy with deinterleaving
+            for (i = 0; i < nl; i++)
+                l[mh + i] = data[i] * F_LFTG_K;
+            for (i = nl; i < lh; i++)
+                h[i - nl] = data[i] * F_LFTG_X;
 
-            sr_1d97_float(line, mh, mh + lh);
+            sr_1d97_float(dsp, l, h, mh, mh + lh, 1);
 
             for (i = 0; i < lh; i++)
-                data[w * lp + i] = l[i];
+                data[i] = *(float *)sample(l, h, mh + i, 1);
         }
-
+    } else {
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
-            int i, j = 0;
-            // copy with interleaving
-            for (i = mv; i < lv; i += 2, j++)
-                l[i] = data[w * j + lp] * F_LFTG_K;
-            for (i = 1 - mv; i < lv; i += 2, j++)
-                l[i] = data[w * j + lp] * F_LFTG_X;
+        int nl = (lv - mv + 1) >> 1;
 
-            sr_1d97_float(line, mv, mv + lv);
+        for (lp = start; lp < end; lp += DWT_STRIP) {
+            int n = FFMIN(DWT_STRIP, end - lp);
+            int i, j;
+
+            l = line_half(s, linebuf, n, 0);
+            h = line_half(s, linebuf, n, 1);
+            // copy with deinterleaving
+            for (i = 0; i < nl; i++)
+                for (j = 0; j < n; j++)
+                    l[(mv + i) * n + j] = t[w * i + lp + j] * F_LFTG_K;
+            for (i = nl; i < lv; i++)
+                for (j = 0; j < n; j++)
+                    h[(i - nl) * n + j] = t[w * i + lp + j] * F_LFTG_X;
+
+            sr_1d97_float(dsp, l, h, mv, mv + lv, n);
 
             for (i = 0; i < lv; i++)
-                data[w * i + lp] = l[i];
+                memcpy(t + w * i + lp, sample(l, h, mv + i, n),
+                       n * sizeof(*l));
         }
     }
 }
 
-static void sr_1d97_int(int32_t *p, int i0, int i1)
+static void lift97_int(int32_t *dst, const int32_t *src0, const int32_t *src1,
+                       int coef, int sub, int len)
 {
     int i;
 
+    if (sub)
+        for (i = 0; i < len; i++)
+            dst[i] -= (coef * (src0[i] + src1[i]) + (1 << 15)) >> 16;
+    else
+        for (i = 0; i < len; i++)
+            dst[i] += (coef * (src0[i] + src1[i]) + (1 << 15)) >> 16;
+}
+
+static void sr_1d97_int(int32_t *l, int32_t *h, int i0, int i1, int n)
+{
+    int i = i0 / 2;
+
     if (i1 == i0 + 1)
         return;
 
-    extend97_int(p, i0, i1);
+    extend97(l, h, i0, i1, n);
 
-    for (i = i0 / 2 - 1; i < i1 / 2 + 2; i++)
-        p[2 * i]     -= (I_LFTG_DELTA * (p[2 * i - 1] + p[2 * i + 1]) + (1 << 15)) >> 16;
+    lift97_int(l + (i - 1) * n, h + (i - 2) * n, h + (i - 1) * n,
+               I_LFTG_DELTA, 1, (i1 / 2 + 3 - i) * n);
     /* step 4 */
-    for (i = i0 / 2 - 1; i < i1 / 2 + 1; i++)
-        p[2 * i + 1] -= (I_LFTG_GAMMA * (p[2 * i]     + p[2 * i + 2]) + (1 << 15)) >> 16;
+    lift97_int(h + (i - 1) * n, l + (i - 1) * n, l + i * n,
+               I_LFTG_GAMMA, 1, (i1 / 2 + 2 - i) * n);
     /*step 5*/
-    for (i = i0 / 2; i < i1 / 2 + 1; i++)
-        p[2 * i]     += (I_LFTG_BETA  * (p[2 * i - 1] + p[2 * i + 1]) + (1 << 15)) >> 16;
+    lift97_int(l + i * n, h + (i - 1) * n, h + i * n,
+               I_LFTG_BETA, 0, (i1 / 2 + 1 - i) * n);
     /* step 6 */
-    for (i = i0 / 2; i < i1 / 2; i++)
-        p[2 * i + 1] += (I_LFTG_ALPHA * (p[2 * i]     + p[2 * i + 2]) + (1 << 15)) >> 16;
+    lift97_int(h + i * n, l + i * n, l + (i + 1) * n,
+               I_LFTG_ALPHA, 0, (i1 / 2 - i) * n);
 }
 
-static void dwt_decode97_int(DWTContext *s, int32_t *t)
+static void dwt_decode97_int(DWTContext *s, int32_t *t, int lev, int dir,
+                             int start, int end, void *linebuf)
 {
-    int lev;
-    int w       = s->linelen[s->ndeclevels - 1][0];
-    int32_t *line = s->i_linebuf;
-    int32_t *data = t;
-    /* position at index O of line range [0-5,w+5] cf. extend function */
-    line += 5;
-
-    for (lev = 0; lev < s->ndeclevels; lev++) {
-        int lh = s->linelen[lev][0],
-            lv = s->linelen[lev][1],
-            mh = s->mod[lev][0],
-            mv = s->mod[lev][1],
-            lp;
-        int32_t *l;
+    int w  = s->linelen[s->ndeclevels - 1][0];
+    int lh = s->linelen[lev][0],
+        lv = s->linelen[lev][1],
+        mh = s->mod[lev][0],
+        mv = s->mod[lev][1],
+        lp;
+    int32_t *l, *h;
+
+    if (!dir) {
         // HOR_SD
-        l = line + mh;
-        for (lp = 0; lp < lv; lp++) {
-            int i, j = 0;
-            // rescale with interleaving
-            for (i = mh; i < lh; i += 2, j++)
-                l[i] = ((data[w * lp + j] * I_LFTG_K) + (1 << 15)) >> 16;
-            for (i = 1 - mh; i < lh; i += 2, j++)
-                l[i] = ((data[w * lp + j] * I_LFTG_X) + (1 << 15)) >> 16;
+        int nl = (lh - mh + 1) >> 1;
+
+        l = line_half(s, linebuf, 1, 0);
+        h = line_half(s, linebuf, 1, 1);
+        for (lp = start; lp < end; lp++) {
+            int32_t *data = t + w * lp;
+            int i;
+            // rescale with deinterleaving
+            for (i = 0; i < nl; i++)
+                l[mh + i] = ((data[i] * I_LFTG_K) + (1 << 15)) >> 16;
+            for (i = nl; i < lh; i++)
+                h[i - nl] = ((data[i] * I_LFTG_X) + (1 << 15)) >> 16;
 
-            sr_1d97_int(line, mh, mh + lh);
+            sr_1d97_int(l, h, mh, mh + lh, 1);
 
             for (i = 0; i < lh; i++)
-                data[w * lp + i] = l[i];
+                data[i] = *(int32_t *)sample(l, h, mh + i, 1);
         }
-
+    } else {
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
-            int i, j = 0;
-            // rescale with interleaving
-            for (i = mv; i < lv; i += 2, j++)
-                l[i] = ((data[w * j + lp] * I_LFTG_K) + (1 << 15)) >> 16;
-            for (i = 1 - mv; i < lv; i += 2, j++)
-                l[i] = ((data[w * j + lp] * I_LFTG_X) + (1 << 15)) >> 16;
+        int nl = (lv - mv + 1) >> 1;
 
-            sr_1d97_int(line, mv, mv + lv);
+        for (lp = start; lp < end; lp += DWT_STRIP) {
+            int n = FFMIN(DWT_STRIP, end - lp);
+            int i, j;
+
+            l = line_half(s, linebuf, n, 0);
+            h = line_half(s, linebuf, n, 1);
+            // rescale with deinterleaving
+            for (i = 0; i < nl; i++)
+                for (j = 0; j < n; j++)
+                    l[(mv + i) * n + j] = ((t[w * i + lp + j] * I_LFTG_K) + (1 << 15)) >> 16;
+            for (i = nl; i < lv; i++)
+                for (j = 0; j < n; j++)
+                    h[(i - nl) * n + j] = ((t[w * i + lp + j] * I_LFTG_X) + (1 << 15)) >> 16;
+
+            sr_1d97_int(l, h, mv, mv + lv, n);
 
             for (i = 0; i < lv; i++)
-                data[w * i + lp] = l[i];
+                memcpy(t + w * i + lp, sample(l, h, mv + i, n),
+                       n * sizeof(*l));
         }
     }
 }
@@ -291,8 +351,7 @@ static void dwt_decode97_int(DWTContext *s, int32_t *t)
 int ff_jpeg2000_dwt_init(DWTContext *s, uint16_t border[2][2],
                          int decomp_levels, int type)
 {
-    int i, j, lev = decomp_levels, maxlen,
-        b[2][2];
+    int i, j, lev = decomp_levels, b[2][2];
 
     s->ndeclevels = decomp_levels;
     s->type       = type;
@@ -301,8 +360,6 @@ int ff_jpeg2000_dwt_init(DWTContext *s, uint16_t border[2][2],
         for (j = 0; j < 2; j++)
             b[i][j] = border[i][j];
 
-    maxlen = FFMAX(b[0][1] - b[0][0],
-                   b[1][1] - b[1][0]);
     while (--lev >= 0)
         for (i = 0; i < 2; i++) {
             s->linelen[lev][i] = b[i][1] - b[i][0];
@@ -310,39 +367,38 @@ int ff_jpeg2000_dwt_init(DWTContext *s, uint16_t border[2][2],
             for (j = 0; j < 2; j++)
                 b[i][j] = (b[i][j] + 1) >> 1;
         }
-    switch (type) {
-    case FF_DWT97:
-        s->f_linebuf = av_malloc((maxlen + 12) * sizeof(*s->f_linebuf));
-        if (!s->f_linebuf)
-            return AVERROR(ENOMEM);
-        break;
-     case FF_DWT97_INT:
-        s->i_linebuf = av_malloc((maxlen + 12) * sizeof(*s->i_linebuf));
-        if (!s->i_linebuf)
-            return AVERROR(ENOMEM);
-        break;
-    case FF_DWT53:
-        s->i_linebuf = av_malloc((maxlen +  6) * sizeof(*s->i_linebuf));
-        if (!s->i_linebuf)
-            return AVERROR(ENOMEM);
-        break;
-    default:
+    if (type != FF_DWT97 && type != FF_DWT97_INT && type != FF_DWT53)
         return -1;
-    }
+
+    s->linebuf = av_malloc(ff_dwt_linebuf_size(s));
+    if (!s->linebuf)
+        return AVERROR(ENOMEM);
     return 0;
 }
 
-int ff_dwt_decode(DWTContext *s, void *t)
+int ff_dwt_linebuf_size(DWTContext *s)
+{
+    int maxlen = 0;
+
+    if (s->ndeclevels)
+        maxlen = FFMAX(s->linelen[s->ndeclevels - 1][0],
+                       s->linelen[s->ndeclevels - 1][1]);
+
+    return 2 * ((maxlen >> 1) + 8) * DWT_STRIP * sizeof(int32_t);
+}
+
+int ff_dwt_decode_lines(DWTContext *s, const Jpeg2000DSPContext *dsp, void *t,
+                        int lev, int dir, int start, int end, void *linebuf)
 {
     switch (s->type) {
     case FF_DWT97:
-        dwt_decode97_float(s, t);
+        dwt_decode97_float(s, dsp, t, lev, dir, start, end, linebuf);
         break;
     case FF_DWT97_INT:
-        dwt_decode97_int(s, t);
+        dwt_decode97_int(s, t, lev, dir, start, end, linebuf);
         break;
     case FF_DWT53:
-        dwt_decode53(s, t);
+        dwt_decode53(s, dsp, t, lev, dir, start, end, linebuf);
         break;
     default:
         return -1;
@@ -350,8 +406,20 @@ int ff_dwt_decode(DWTContext *s, void *t)
     return 0;
 }
 
+int ff_dwt_decode(DWTContext *s, const Jpeg2000DSPContext *dsp, void *t)
+{
+    int lev, dir, ret;
+
+    for (lev = 0; lev < s->ndeclevels; lev++)
+        for (dir = 0; dir < 2; dir++)
+            if ((ret = ff_dwt_decode_lines(s, dsp, t, lev, dir, 0,
+                                           s->linelen[lev][!dir],
+                                           s->linebuf)) < 0)
+                return ret;
+    return 0;
+}
+
 void ff_dwt_destroy(DWTContext *s)
 {
-    av_freep(&s->f_linebuf);
-    av_freep(&s->i_linebuf);
+    av_freep(&s->linebuf);
 }
@@ -44,10 +44,11 @@ typedef struct DWTContext {
     uint8_t mod[FF_DWT_MAX_DECLVLS][2];  ///< coordinates (x0, y0) of decomp. levels mod 2
     uint8_t ndeclevels;                  ///< number of decomposition levels
     uint8_t type;                        ///< 0 for 9/7; 1 for 5/3
-    int32_t *i_linebuf;                  ///< int buffer used by transform
-    float   *f_linebuf;                  ///< float buffer used by transform
+    void *linebuf;                       ///< buffer used by transform
 } DWTContext;
 
+struct Jpeg2000DSPContext;
+
 /**
  * Initialize DWT.
  * @param s                 DWT context
@@ -58,7 +59,29 @@ typedef struct DWTContext {
 int ff_jpeg2000_dwt_init(DWTContext *s, uint16_t border[2][2],
                          int decomp_levels, int type);
 
-int ff_dwt_decode(DWTContext *s, void *t);
+int ff_dwt_decode(DWTContext *s, const struct Jpeg2000DSPContext *dsp, void *t);
+
+/**
+ * Run one pass of one decomposition level of the inverse transform on a
+ * range of lines only, so that the lines can be split across threads.
+ * @param s                 DWT context
+ * @param dsp               DSP functions used for the lifting steps
+ * @param t                 transformed data
+ * @param lev               decomposition level, 0 being the lowest resolution
+ * @param dir               0 for the horizontal pass, 1 for the vertical one
+ * @param start             first line to transform
+ * @param end               line after the last one, at most
+ *                          s->linelen[lev][!dir]
+ * @param linebuf           scratch buffer of ff_dwt_linebuf_size() bytes
+ */
+int ff_dwt_decode_lines(DWTContext *s, const struct Jpeg2000DSPContext *dsp,
+                        void *t, int lev, int dir, int start, int end,
+                        void *linebuf);
+
+/**
+ * @return size in bytes of the scratch buffer needed by ff_dwt_decode_lines()
+ */
+int ff_dwt_linebuf_size(DWTContext *s);
 
 void ff_dwt_destroy(DWTContext *s);
 
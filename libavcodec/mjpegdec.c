@@ -856,119 +856,240 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
     return 0;
 }
 
-static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
-                             int Al, const uint8_t *mb_bitmask,
-                             const AVFrame *reference)
+/**
+ * Decode the MCUs mcu_start to mcu_end - 1 of a sequential or progressive DC
+ * scan, reading the bitstream from s->gb.
+ */
+static int decode_scan_mcus(MJpegDecodeContext *s, int nb_components, int Ah,
+                            int Al, GetBitContext *mb_bitmask_gb,
+                            const AVFrame *reference,
+                            int mcu_start, int mcu_end)
 {
-    int i, mb_x, mb_y;
+    int i, mcu;
+    int mb_x = mcu_start % s->mb_width;
+    int mb_y = mcu_start / s->mb_width;
     uint8_t *data[MAX_COMPONENTS];
     const uint8_t *reference_data[MAX_COMPONENTS];
     int linesize[MAX_COMPONENTS];
-    GetBitContext mb_bitmask_gb;
-
-    if (mb_bitmask)
-        init_get_bits(&mb_bitmask_gb, mb_bitmask, s->mb_width * s->mb_height);
 
     for (i = 0; i < nb_components; i++) {
         int c   = s->comp_index[i];
         data[c] = s->picture_ptr->data[c];
         reference_data[c] = reference ? reference->data[c] : NULL;
         linesize[c] = s->linesize[c];
-        s->coefs_finished[c] |= 1;
     }
 
-    for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
-        for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
-            const int copy_mb = mb_bitmask && !get_bits1(&mb_bitmask_gb);
+    for (mcu = mcu_start; mcu < mcu_end; mcu++) {
+        const int copy_mb = mb_bitmask_gb && !get_bits1(mb_bitmask_gb);
 
-            if (s->restart_interval && !s->restart_count)
-                s->restart_count = s->restart_interval;
+        if (s->restart_interval && !s->restart_count)
+            s->restart_count = s->restart_interval;
 
-            if (get_bits_left(&s->gb) < 0) {
-                av_log(s->avctx, AV_LOG_ERROR, "overread %d\n",
-                       -get_bits_left(&s->gb));
-                return AVERROR_INVALIDDATA;
-            }
-            for (i = 0; i < nb_components; i++) {
-                uint8_t *ptr;
-                int n, h, v, x, y, c, j;
-                int block_offset;
-                n = s->nb_blocks[i];
-                c = s->comp_index[i];
-                h = s->h_scount[i];
-                v = s->v_scount[i];
-                x = 0;
-                y = 0;
-                for (j = 0; j < n; j++) {
-                    block_offset = ((linesize[c] * (v * mb_y + y) * 8) +
-                                    (h * mb_x + x) * 8);
-
-                    if (s->interlaced && s->bottom_field)
-                        block_offset += linesize[c] >> 1;
-                    ptr = data[c] + block_offset;
-                    if (!s->progressive) {
-                        if (copy_mb)
-                            s->hdsp.put_pixels_tab[1][0](ptr,
-                                reference_data[c] + block_offset,
-                                linesize[c], 8);
-                        else {
-                            s->bdsp.clear_block(s->block);
-                            if (decode_block(s, s->block, i,
-                                             s->dc_index[i], s->ac_index[i],
-                                             s->quant_matrixes[s->quant_index[c]]) < 0) {
-                                av_log(s->avctx, AV_LOG_ERROR,
-                                       "error y=%d x=%d\n", mb_y, mb_x);
-                                return AVERROR_INVALIDDATA;
-                            }
-                            s->idsp.idct_put(ptr, linesize[c], s->block);
-                        }
-                    } else {
-                        int block_idx  = s->block_stride[c] * (v * mb_y + y) +
-                                         (h * mb_x + x);
-                        int16_t *block = s->blocks[c][block_idx];
-                        if (Ah)
-                            block[0] += get_bits1(&s->gb) *
-                                        s->quant_matrixes[s->quant_index[c]][0] << Al;
-                        else if (decode_dc_progressive(s, block, i, s->dc_index[i],
-                                                       s->quant_matrixes[s->quant_index[c]],
-                                                       Al) < 0) {
+        if (get_bits_left(&s->gb) < 0) {
+            av_log(s->avctx, AV_LOG_ERROR, "overread %d\n",
+                   -get_bits_left(&s->gb));
+            return AVERROR_INVALIDDATA;
+        }
+        for (i = 0; i < nb_components; i++) {
+            uint8_t *ptr;
+            int n, h, v, x, y, c, j;
+            int block_offset;
+            n = s->nb_blocks[i];
+            c = s->comp_index[i];
+            h = s->h_scount[i];
+            v = s->v_scount[i];
+            x = 0;
+            y = 0;
+            for (j = 0; j < n; j++) {
+                block_offset = ((linesize[c] * (v * mb_y + y) * 8) +
+                                (h * mb_x + x) * 8);
+
+                if (s->interlaced && s->bottom_field)
+                    block_offset += linesize[c] >> 1;
+                ptr = data[c] + block_offset;
+                if (!s->progressive) {
+                    if (copy_mb)
+                        s->hdsp.put_pixels_tab[1][0](ptr,
+                            reference_data[c] + block_offset,
+                            linesize[c], 8);
+                    else {
+                        s->bdsp.clear_block(s->block);
+                        if (decode_block(s, s->block, i,
+                                         s->dc_index[i], s->ac_index[i],
+                                         s->quant_matrixes[s->quant_index[c]]) < 0) {
                             av_log(s->avctx, AV_LOG_ERROR,
                                    "error y=%d x=%d\n", mb_y, mb_x);
                             return AVERROR_INVALIDDATA;
                         }
+                        s->idsp.idct_put(ptr, linesize[c], s->block);
                     }
-                    ff_dlog(s->avctx, "mb: %d %d processed\n", mb_y, mb_x);
-                    ff_dlog(s->avctx, "%d %d %d %d %d %d %d %d \n",
-                            mb_x, mb_y, x, y, c, s->bottom_field,
-                            (v * mb_y + y) * 8, (h * mb_x + x) * 8);
-                    if (++x == h) {
-                        x = 0;
-                        y++;
+                } else {
+                    int block_idx  = s->block_stride[c] * (v * mb_y + y) +
+                                     (h * mb_x + x);
+                    int16_t *block = s->blocks[c][block_idx];
+                    if (Ah)
+                        block[0] += get_bits1(&s->gb) *
+                                    s->quant_matrixes[s->quant_index[c]][0] << Al;
+                    else if (decode_dc_progressive(s, block, i, s->dc_index[i],
+                                                   s->quant_matrixes[s->quant_index[c]],
+                                                   Al) < 0) {
+                        av_log(s->avctx, AV_LOG_ERROR,
+                               "error y=%d x=%d\n", mb_y, mb_x);
+                        return AVERROR_INVALIDDATA;
                     }
                 }
+                ff_dlog(s->avctx, "mb: %d %d processed\n", mb_y, mb_x);
+                ff_dlog(s->avctx, "%d %d %d %d %d %d %d %d \n",
+                        mb_x, mb_y, x, y, c, s->bottom_field,
+                        (v * mb_y + y) * 8, (h * mb_x + x) * 8);
+                if (++x == h) {
+                    x = 0;
+                    y++;
+                }
             }
+        }
 
-            if (s->restart_interval) {
-                s->restart_count--;
-                i = 8 + ((-get_bits_count(&s->gb)) & 7);
-                /* skip RSTn */
-                if (show_bits(&s->gb, i) == (1 << i) - 1) {
-                    int pos = get_bits_count(&s->gb);
-                    align_get_bits(&s->gb);
-                    while (get_bits_left(&s->gb) >= 8 && show_bits(&s->gb, 8) == 0xFF)
-                        skip_bits(&s->gb, 8);
-                    if ((get_bits(&s->gb, 8) & 0xF8) == 0xD0) {
-                        for (i = 0; i < nb_components; i++) /* reset dc */
-                            s->last_dc[i] = 1024;
-                    } else
-                        skip_bits_long(&s->gb, pos - get_bits_count(&s->gb));
-                }
+        if (s->restart_interval) {
+            s->restart_count--;
+            i = 8 + ((-get_bits_count(&s->gb)) & 7);
+            /* skip RSTn */
+            if (show_bits(&s->gb, i) == (1 << i) - 1) {
+                int pos = get_bits_count(&s->gb);
+                align_get_bits(&s->gb);
+                while (get_bits_left(&s->gb) >= 8 && show_bits(&s->gb, 8) == 0xFF)
+                    skip_bits(&s->gb, 8);
+                if ((get_bits(&s->gb, 8) & 0xF8) == 0xD0) {
+                    for (i = 0; i < nb_components; i++) /* reset dc */
+                        s->last_dc[i] = 1024;
+                } else
+                    skip_bits_long(&s->gb, pos - get_bits_count(&s->gb));
             }
         }
+
+        if (++mb_x == s->mb_width) {
+            mb_x = 0;
+            mb_y++;
+        }
     }
     return 0;
 }
 
+typedef struct ScanSliceArgs {
+    int nb_components, Ah, Al;
+    int nb_intervals;       ///< number of restart intervals in the scan
+    int nb_jobs;
+    const int *starts;      ///< byte offset of each restart interval
+    GetBitContext end_gb;   ///< reader state after the last interval
+} ScanSliceArgs;
+
+static int decode_scan_slice(AVCodecContext *avctx, void *arg,
+                             int jobnr, int threadnr)
+{
+    MJpegDecodeContext *s = avctx->priv_data;
+    ScanSliceArgs *a      = arg;
+    int first     = a->nb_intervals *  jobnr      / a->nb_jobs;
+    int last      = a->nb_intervals * (jobnr + 1) / a->nb_jobs;
+    int nb_mcus   = s->mb_width * s->mb_height;
+    /* the bitstream reader, DC predictors and block are per slice */
+    MJpegDecodeContext sc = *s;
+    int i, ret;
+
+    for (i = 0; i < a->nb_components; i++)
+        sc.last_dc[i] = 1024;
+    sc.restart_count = 0;
+    skip_bits_long(&sc.gb, a->starts[first] * 8 - get_bits_count(&sc.gb));
+
+    ret = decode_scan_mcus(&sc, a->nb_components, a->Ah, a->Al, NULL, NULL,
+                           first * s->restart_interval,
+                           FFMIN(last * s->restart_interval, nb_mcus));
+
+    /* only the job with the last interval writes it, and it is not read
+     * before all jobs are done */
+    if (last == a->nb_intervals)
+        a->end_gb = sc.gb;
+    return ret;
+}
+
+/**
+ * Decode a scan with restart markers by splitting it at the markers
+ * recorded while unescaping it, with one job per group of intervals.
+ *
+ * @return AVERROR(EAGAIN) if the scan cannot be split
+ */
+static int decode_scan_threaded(MJpegDecodeContext *s, int nb_components,
+                                int Ah, int Al)
+{
+    ScanSliceArgs a = { nb_components, Ah, Al };
+    int nb_mcus = s->mb_width * s->mb_height;
+    int pos     = get_bits_count(&s->gb) >> 3;
+    int i, j, ret = 0;
+    int *rets;
+
+    a.nb_intervals = (nb_mcus + s->restart_interval - 1) / s->restart_interval;
+    if (a.nb_intervals < 2 || get_bits_count(&s->gb) & 7)
+        return AVERROR(EAGAIN);
+
+    /* the unescaped buffer starts with the SOS header, skip the header
+     * bytes that happened to look like restart markers */
+    for (i = 0; i < s->nb_restart_pos && s->restart_pos[i] <= pos; i++)
+        ;
+    if (s->nb_restart_pos - i < a.nb_intervals - 1)
+        return AVERROR(EAGAIN);
+
+    av_fast_malloc(&s->slice_starts, &s->slice_starts_size,
+                   a.nb_intervals * sizeof(*s->slice_starts));
+    if (!s->slice_starts)
+        return AVERROR(ENOMEM);
+    s->slice_starts[0] = pos;
+    for (j = 1; j < a.nb_intervals; j++)
+        s->slice_starts[j] = s->restart_pos[i + j - 1];
+    a.starts = s->slice_starts;
+
+    /* a few jobs per thread, as the intervals may differ in complexity */
+    a.nb_jobs = FFMIN(a.nb_intervals, s->avctx->thread_count * 4);
+    rets      = av_malloc_array(a.nb_jobs, sizeof(*rets));
+    if (!rets)
+        return AVERROR(ENOMEM);
+
+    a.end_gb = s->gb;
+    s->avctx->execute2(s->avctx, decode_scan_slice, &a, rets, a.nb_jobs);
+    /* continue after the last interval, as the single-threaded case does */
+    s->gb = a.end_gb;
+
+    for (i = 0; i < a.nb_jobs; i++)
+        if (rets[i] < 0)
+            ret = rets[i];
+    av_free(rets);
+
+    s->restart_count = 0;
+    return ret;
+}
+
+static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
+                             int Al, const uint8_t *mb_bitmask,
+                             const AVFrame *reference)
+{
+    int i;
+    GetBitContext mb_bitmask_gb;
+
+    for (i = 0; i < nb_components; i++)
+        s->coefs_finished[s->comp_index[i]] |= 1;
+
+    if (mb_bitmask) {
+        init_get_bits(&mb_bitmask_gb, mb_bitmask, s->mb_width * s->mb_height);
+    } else if (HAVE_THREADS &&
+               s->avctx->active_thread_type & FF_THREAD_SLICE &&
+               s->restart_interval && !s->progressive) {
+        int ret = decode_scan_threaded(s, nb_components, Ah, Al);
+        if (ret != AVERROR(EAGAIN))
+            return ret;
+    }
+
+    return decode_scan_mcus(s, nb_components, Ah, Al,
+                            mb_bitmask ? &mb_bitmask_gb : NULL, reference,
+                            0, s->mb_width * s->mb_height);
+}
+
 static int mjpeg_decode_scan_progressive_ac(MJpegDecodeContext *s, int ss,
                                             int se, int Ah, int Al,
                                             const uint8_t *mb_bitmask,
@@ -1407,6 +1528,11 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
     if (start_code == SOS && !s->ls) {
         const uint8_t *src = *buf_ptr;
         uint8_t *dst = s->buffer;
+        /* remember where the restart intervals start for slice threading */
+        int record_restarts = HAVE_THREADS &&
+                              s->avctx->active_thread_type & FF_THREAD_SLICE;
+
+        s->nb_restart_pos = 0;
 
         while (src < buf_end) {
             uint8_t x = *(src++);
@@ -1417,9 +1543,19 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                     while (src < buf_end && x == 0xff)
                         x = *(src++);
 
-                    if (x >= 0xd0 && x <= 0xd7)
+                    if (x >= 0xd0 && x <= 0xd7) {
                         *(dst++) = x;
-                    else if (x)
+                        if (record_restarts) {
+                            int *tmp = av_fast_realloc(s->restart_pos,
+                                                       &s->restart_pos_size,
+                                                       (s->nb_restart_pos + 1) *
+                                                       sizeof(*s->restart_pos));
+                            if (!tmp)
+                                return AVERROR(ENOMEM);
+                            s->restart_pos = tmp;
+                            s->restart_pos[s->nb_restart_pos++] = dst - s->buffer;
+                        }
+                    } else if (x)
                         break;
                 }
             }
@@ -1696,6 +1832,8 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
         av_frame_unref(s->picture_ptr);
 
     av_free(s->buffer);
+    av_freep(&s->restart_pos);
+    av_freep(&s->slice_starts);
     av_freep(&s->ljpeg_buffer);
     s->ljpeg_buffer_size = 0;
 
@@ -1734,7 +1872,7 @@ AVCodec ff_mjpeg_decoder = {
     .init           = ff_mjpeg_decode_init,
     .close          = ff_mjpeg_decode_end,
     .decode         = ff_mjpeg_decode_frame,
-    .capabilities   = AV_CODEC_CAP_DR1,
+    .capabilities   = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SLICE_THREADS,
     .priv_class     = &mjpegdec_class,
     .caps_internal  = FF_CODEC_CAP_INIT_THREADSAFE,
 };
@@ -102,6 +102,11 @@ typedef struct MJpegDecodeContext {
 
     int restart_interval;
     int restart_count;
+    int *restart_pos;               ///< offsets of the data following the RST markers of the current scan
+    unsigned int restart_pos_size;
+    int nb_restart_pos;
+    int *slice_starts;              ///< offsets of the restart intervals decoded by each slice
+    unsigned int slice_starts_size;
 
     int buggy_avid;
     int cs_itu601;
@@ -192,6 +192,7 @@ int avcodec_copy_context(AVCodecContext *dest, const AVCodecContext *src)
     dest->rc_override     = NULL;
     dest->subtitle_header = NULL;
     dest->hw_frames_ctx   = NULL;
+    dest->thread_pool     = NULL;
 #if FF_API_MPV_OPT
     FF_DISABLE_DEPRECATION_WARNINGS
     dest->rc_eq           = NULL;
@@ -227,6 +228,12 @@ int avcodec_copy_context(AVCodecContext *dest, const AVCodecContext *src)
             goto fail;
     }
 
+    if (src->thread_pool) {
+        dest->thread_pool = av_buffer_ref(src->thread_pool);
+        if (!dest->thread_pool)
+            goto fail;
+    }
+
     return 0;
 
 fail:
@@ -236,6 +243,7 @@ fail:
     av_freep(&dest->inter_matrix);
     av_freep(&dest->extradata);
     av_buffer_unref(&dest->hw_frames_ctx);
+    av_buffer_unref(&dest->thread_pool);
 #if FF_API_MPV_OPT
     FF_DISABLE_DEPRECATION_WARNINGS
     av_freep(&dest->rc_eq);
@@ -182,6 +182,10 @@ typedef struct OpusContext {
     AVAudioFifo **sync_buffers;
     /* number of decoded samples for each stream */
     int         *decoded_samples;
+    /* sub-packet data of each stream in the current packet */
+    const uint8_t **subpackets;
+    /* number of samples coded in the current packet */
+    int coded_samples;
 
     int             nb_streams;
     int      nb_stereo_streams;
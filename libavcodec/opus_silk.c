@@ -27,6 +27,7 @@
 #include <stdint.h>
 
 #include "opus.h"
+#include "opusdsp.h"
 
 typedef struct SilkFrame {
     int coded;
@@ -59,6 +60,8 @@ struct SilkContext {
     float stereo_weights[2];
 
     int prev_coded_channels;
+
+    OpusDSPContext dsp;
 };
 
 static const uint16_t silk_model_stereo_s1[] = {
@@ -1305,6 +1308,10 @@ static void silk_decode_frame(SilkContext *s, OpusRangeCoder *rc,
     /* obtain LPC filter coefficients */
     silk_decode_lpc(s, frame, rc, lpc_leadin, lpc_body, &order, &has_lpc_leadin, voiced);
 
+    /* the synthesis filter may run over all the taps */
+    memset(lpc_leadin + order, 0, (SILK_MAX_LPC - order) * sizeof(*lpc_leadin));
+    memset(lpc_body   + order, 0, (SILK_MAX_LPC - order) * sizeof(*lpc_body));
+
     /* obtain pitch lags, if this is a voiced frame */
     if (voiced) {
         int lag_absolute = (!frame_num || !frame->prev_voiced);
@@ -1430,14 +1437,8 @@ static void silk_decode_frame(SilkContext *s, OpusRangeCoder *rc,
         }
 
         /* LPC synthesis */
-        for (j = 0; j < s->sflength; j++) {
-            sum = resptr[j] * sf[i].gain;
-            for (k = 1; k <= order; k++)
-                sum += lpc_coeff[k - 1] * lpc[j - k];
-
-            lpc[j] = sum;
-            dst[j] = av_clipf(sum, -1.0f, 1.0f);
-        }
+        s->dsp.lpc_synthesis(dst, lpc, resptr, lpc_coeff, order, s->sflength,
+                             sf[i].gain);
     }
 
     frame->prev_voiced = voiced;
@@ -1589,6 +1590,8 @@ int ff_silk_init(AVCodecContext *avctx, SilkContext **ps, int output_channels)
     s->avctx           = avctx;
     s->output_channels = output_channels;
 
+    ff_opus_dsp_init(&s->dsp);
+
     ff_silk_flush(s);
 
     *ps = s;
@@ -447,6 +447,20 @@ finish:
     return output_samples;
 }
 
+static int opus_decode_stream(AVCodecContext *avctx, void *arg,
+                              int stream, int threadnr)
+{
+    OpusContext       *c = avctx->priv_data;
+    OpusStreamContext *s = &c->streams[stream];
+
+    c->decoded_samples[stream] =
+        opus_decode_subpacket(s, c->subpackets[stream], s->packet.data_size,
+                              c->out + 2 * stream, c->out_size[stream],
+                              c->coded_samples);
+
+    return 0;
+}
+
 static int opus_decode_packet(AVCodecContext *avctx, void *data,
                               int *got_frame_ptr, AVPacket *avpkt)
 {
@@ -531,7 +545,7 @@ static int opus_decode_packet(AVCodecContext *avctx, void *data,
         c->out_size[i] = frame->linesize[0] - ret * sizeof(float);
     }
 
-    /* decode each sub-packet */
+    /* find the sub-packet of each stream */
     for (i = 0; i < c->nb_streams; i++) {
         OpusStreamContext *s = &c->streams[i];
 
@@ -550,15 +564,21 @@ static int opus_decode_packet(AVCodecContext *avctx, void *data,
             s->silk_samplerate = get_silk_samplerate(s->packet.config);
         }
 
-        ret = opus_decode_subpacket(&c->streams[i], buf, s->packet.data_size,
-                                    c->out + 2 * i, c->out_size[i], coded_samples);
-        if (ret < 0)
-            return ret;
-        c->decoded_samples[i] = ret;
-        decoded_samples       = FFMIN(decoded_samples, ret);
+        c->subpackets[i] = buf;
+        if (buf) {
+            buf      += s->packet.packet_size;
+            buf_size -= s->packet.packet_size;
+        }
+    }
+
+    /* the streams are coded independently, so decode them in parallel */
+    c->coded_samples = coded_samples;
+    avctx->execute2(avctx, opus_decode_stream, NULL, NULL, c->nb_streams);
 
-        buf      += s->packet.packet_size;
-        buf_size -= s->packet.packet_size;
+    for (i = 0; i < c->nb_streams; i++) {
+        if (c->decoded_samples[i] < 0)
+            return c->decoded_samples[i];
+        decoded_samples = FFMIN(decoded_samples, c->decoded_samples[i]);
     }
 
     /* buffer the extra samples */
@@ -648,6 +668,7 @@ static av_cold int opus_decode_close(AVCodecContext *avctx)
     }
     av_freep(&c->sync_buffers);
     av_freep(&c->decoded_samples);
+    av_freep(&c->subpackets);
     av_freep(&c->out);
     av_freep(&c->out_size);
 
@@ -679,7 +700,9 @@ static av_cold int opus_decode_init(AVCodecContext *avctx)
     c->out_size        = av_mallocz_array(c->nb_streams, sizeof(*c->out_size));
     c->sync_buffers    = av_mallocz_array(c->nb_streams, sizeof(*c->sync_buffers));
     c->decoded_samples = av_mallocz_array(c->nb_streams, sizeof(*c->decoded_samples));
-    if (!c->streams || !c->sync_buffers || !c->decoded_samples || !c->out || !c->out_size) {
+    c->subpackets      = av_mallocz_array(c->nb_streams, sizeof(*c->subpackets));
+    if (!c->streams || !c->sync_buffers || !c->decoded_samples || !c->subpackets ||
+        !c->out || !c->out_size) {
         c->nb_streams = 0;
         ret = AVERROR(ENOMEM);
         goto fail;
@@ -751,5 +774,6 @@ AVCodec ff_opus_decoder = {
     .close           = opus_decode_close,
     .decode          = opus_decode_packet,
     .flush           = opus_decode_flush,
-    .capabilities    = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY,
+    .capabilities    = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
+                       AV_CODEC_CAP_SLICE_THREADS,
 };
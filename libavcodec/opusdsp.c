@@ -0,0 +1,79 @@
+/*
+ * Opus decoder DSP functions
+ *
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/common.h"
+#include "opusdsp.h"
+
+static void pvq_dequant_c(float *dst, const int *src, float gain, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        dst[i] = gain * src[i];
+}
+
+static void postfilter_c(float *data, int period, const float *gains, int len)
+{
+    const float g0 = gains[0];
+    const float g1 = gains[1];
+    const float g2 = gains[2];
+    float x0, x1, x2, x3, x4;
+    int i;
+
+    x4 = data[-period - 2];
+    x3 = data[-period - 1];
+    x2 = data[-period];
+    x1 = data[-period + 1];
+
+    for (i = 0; i < len; i++) {
+        x0 = data[i - period + 2];
+        data[i] += g0 * x2        +
+                   g1 * (x1 + x3) +
+                   g2 * (x0 + x4);
+        x4 = x3;
+        x3 = x2;
+        x2 = x1;
+        x1 = x0;
+    }
+}
+
+static void lpc_synthesis_c(float *dst, float *lpc, const float *res,
+                            const float *coeffs, int order, int len, float gain)
+{
+    int i, k;
+
+    for (i = 0; i < len; i++) {
+        float sum = res[i] * gain;
+
+        for (k = 1; k <= order; k++)
+            sum += coeffs[k - 1] * lpc[i - k];
+
+        lpc[i] = sum;
+        dst[i] = av_clipf(sum, -1.0f, 1.0f);
+    }
+}
+
+av_cold void ff_opus_dsp_init(OpusDSPContext *c)
+{
+    c->pvq_dequant   = pvq_dequant_c;
+    c->postfilter    = postfilter_c;
+    c->lpc_synthesis = lpc_synthesis_c;
+}
@@ -0,0 +1,54 @@
+/*
+ * Opus decoder DSP functions
+ *
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_OPUSDSP_H
+#define AVCODEC_OPUSDSP_H
+
+typedef struct OpusDSPContext {
+    /**
+     * Scale a decoded PVQ pulse vector:
+     * dst[i] = gain * src[i]
+     */
+    void (*pvq_dequant)(float *dst, const int *src, float gain, int len);
+
+    /**
+     * Apply the CELT pitch pre-filter inverse with constant parameters,
+     * in place:
+     * data[i] += gains[0] *  data[i - period] +
+     *            gains[1] * (data[i - period + 1] + data[i - period - 1]) +
+     *            gains[2] * (data[i - period + 2] + data[i - period - 2])
+     * period must be at least CELT_POSTFILTER_MINPERIOD.
+     */
+    void (*postfilter)(float *data, int period, const float *gains, int len);
+
+    /**
+     * SILK LPC synthesis filter:
+     * lpc[i] = gain * res[i] + sum(coeffs[k] * lpc[i - k - 1], k < order)
+     * dst[i] = av_clipf(lpc[i], -1.0, 1.0)
+     * coeffs must be zero-padded up to 16 entries and lpc[-16..-1] must hold
+     * the filter history.
+     */
+    void (*lpc_synthesis)(float *dst, float *lpc, const float *res,
+                          const float *coeffs, int order, int len, float gain);
+} OpusDSPContext;
+
+void ff_opus_dsp_init(OpusDSPContext *c);
+
+#endif /* AVCODEC_OPUSDSP_H */
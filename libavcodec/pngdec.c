@@ -28,6 +28,7 @@
 #include "internal.h"
 #include "png.h"
 #include "pngdsp.h"
+#include "thread.h"
 
 /* TODO:
  * - add 2, 4 and 16 bit depth support
@@ -39,7 +40,8 @@ typedef struct PNGDecContext {
     PNGDSPContext dsp;
 
     GetByteContext gb;
-    AVFrame *prev;
+    ThreadFrame picture;
+    ThreadFrame last_picture;
 
     int state;
     int width, height;
@@ -412,11 +414,15 @@ static int decode_frame(AVCodecContext *avctx,
     PNGDecContext *const s = avctx->priv_data;
     const uint8_t *buf     = avpkt->data;
     int buf_size           = avpkt->size;
-    AVFrame *p             = data;
+    AVFrame *p;
     uint8_t *crow_buf_base = NULL;
     uint32_t tag, length;
     int ret;
 
+    ff_thread_release_buffer(avctx, &s->last_picture);
+    FFSWAP(ThreadFrame, s->picture, s->last_picture);
+    p = s->picture.f;
+
     /* check signature */
     if (buf_size < 8) {
         av_log(avctx, AV_LOG_ERROR, "Not enough data %d\n",
@@ -524,7 +530,7 @@ static int decode_frame(AVCodecContext *avctx,
                     goto fail;
                 }
 
-                if (ff_get_buffer(avctx, p, AV_GET_BUFFER_FLAG_REF) < 0) {
+                if (ff_thread_get_buffer(avctx, &s->picture, AV_GET_BUFFER_FLAG_REF) < 0) {
                     av_log(avctx, AV_LOG_ERROR, "get_buffer() failed\n");
                     goto fail;
                 }
@@ -568,6 +574,8 @@ static int decode_frame(AVCodecContext *avctx,
                 s->crow_buf          = crow_buf_base + 15;
                 s->zstream.avail_out = s->crow_size;
                 s->zstream.next_out  = s->crow_buf;
+
+                ff_thread_finish_setup(avctx);
             }
             s->state |= PNG_IDAT;
             if (png_decode_idat(s, length) < 0)
@@ -611,8 +619,16 @@ static int decode_frame(AVCodecContext *avctx,
         }
         break;
         case MKTAG('s', 'T', 'E', 'R'): {
-            int mode = bytestream2_get_byte(&s->gb);
-            AVStereo3D *stereo3d = av_stereo3d_create_side_data(p);
+            int mode;
+            AVStereo3D *stereo3d;
+
+            /* sTER must come before IDAT, the frame may be shared with the
+             * next frame thread afterwards */
+            if (s->state & PNG_IDAT)
+                goto skip_tag;
+
+            mode     = bytestream2_get_byte(&s->gb);
+            stereo3d = av_stereo3d_create_side_data(p);
             if (!stereo3d)
                 goto the_end;
 
@@ -640,11 +656,13 @@ skip_tag:
     }
 exit_loop:
     /* handle P-frames only if a predecessor frame is available */
-    if (s->prev->data[0]) {
+    if (s->last_picture.f->data[0]) {
         if (!(avpkt->flags & AV_PKT_FLAG_KEY)) {
             int i, j;
             uint8_t *pd      = p->data[0];
-            uint8_t *pd_last = s->prev->data[0];
+            uint8_t *pd_last = s->last_picture.f->data[0];
+
+            ff_thread_await_progress(&s->last_picture, INT_MAX, 0);
 
             for (j = 0; j < s->height; j++) {
                 for (i = 0; i < s->width * s->bpp; i++)
@@ -655,14 +673,14 @@ exit_loop:
         }
     }
 
-    av_frame_unref(s->prev);
-    if ((ret = av_frame_ref(s->prev, p)) < 0)
+    if ((ret = av_frame_ref(data, p)) < 0)
         goto fail;
 
     *got_frame = 1;
 
     ret = bytestream2_tell(&s->gb);
 the_end:
+    ff_thread_report_progress(&s->picture, INT_MAX, 0);
     inflateEnd(&s->zstream);
     av_free(crow_buf_base);
     s->crow_buf = NULL;
@@ -674,26 +692,62 @@ fail:
     goto the_end;
 }
 
-static av_cold int png_dec_init(AVCodecContext *avctx)
+static int update_thread_context(AVCodecContext *dst, const AVCodecContext *src)
+{
+    PNGDecContext *psrc = src->priv_data;
+    PNGDecContext *pdst = dst->priv_data;
+
+    if (dst == src)
+        return 0;
+
+    /* the picture of the previous thread becomes our last picture */
+    ff_thread_release_buffer(dst, &pdst->picture);
+    if (psrc->picture.f->data[0])
+        return ff_thread_ref_frame(&pdst->picture, &psrc->picture);
+
+    return 0;
+}
+
+static av_cold int png_dec_end(AVCodecContext *avctx)
 {
     PNGDecContext *s = avctx->priv_data;
 
-    avctx->color_range = AVCOL_RANGE_JPEG;
+    if (s->picture.f)
+        ff_thread_release_buffer(avctx, &s->picture);
+    av_frame_free(&s->picture.f);
+    if (s->last_picture.f)
+        ff_thread_release_buffer(avctx, &s->last_picture);
+    av_frame_free(&s->last_picture.f);
 
-    s->prev = av_frame_alloc();
-    if (!s->prev)
-        return AVERROR(ENOMEM);
+    return 0;
+}
 
-    ff_pngdsp_init(&s->dsp);
+static av_cold int png_dec_init_thread_copy(AVCodecContext *avctx)
+{
+    PNGDecContext *s = avctx->priv_data;
+
+    s->picture.f      = av_frame_alloc();
+    s->last_picture.f = av_frame_alloc();
+    if (!s->picture.f || !s->last_picture.f) {
+        png_dec_end(avctx);
+        return AVERROR(ENOMEM);
+    }
 
     return 0;
 }
 
-static av_cold int png_dec_end(AVCodecContext *avctx)
+static av_cold int png_dec_init(AVCodecContext *avctx)
 {
     PNGDecContext *s = avctx->priv_data;
+    int ret;
 
-    av_frame_free(&s->prev);
+    avctx->color_range = AVCOL_RANGE_JPEG;
+    avctx->internal->allocate_progress = 1;
+
+    if ((ret = png_dec_init_thread_copy(avctx)) < 0)
+        return ret;
+
+    ff_pngdsp_init(&s->dsp);
 
     return 0;
 }
@@ -707,6 +761,8 @@ AVCodec ff_png_decoder = {
     .init           = png_dec_init,
     .close          = png_dec_end,
     .decode         = decode_frame,
-    .capabilities   = AV_CODEC_CAP_DR1 /*| AV_CODEC_CAP_DRAW_HORIZ_BAND*/,
+    .init_thread_copy      = ONLY_IF_THREADS_ENABLED(png_dec_init_thread_copy),
+    .update_thread_context = ONLY_IF_THREADS_ENABLED(update_thread_context),
+    .capabilities   = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS /*| AV_CODEC_CAP_DRAW_HORIZ_BAND*/,
     .caps_internal  = FF_CODEC_CAP_INIT_THREADSAFE,
 };
@@ -111,6 +111,21 @@ typedef struct FFPsyModel {
      */
     FFPsyWindowInfo (*window)(FFPsyContext *ctx, const float *audio, const float *la, int channel, int prev_type);
 
+    /**
+     * Perform the part of the psychoacoustic analysis of a group of channels
+     * that does not depend on the other groups. Optional.
+     *
+     * If set, it must be called for a group before analyze() is called for
+     * it. It may run concurrently for different groups, while analyze() must
+     * be called for the groups in order.
+     *
+     * @param ctx      model context
+     * @param channel  channel number of the first channel in the group to perform analysis on
+     * @param coeffs   array of pointers to the transformed coefficients
+     * @param wi       window information for the channels in the group
+     */
+    void (*prepare_analysis)(FFPsyContext *ctx, int channel, const float **coeffs, const FFPsyWindowInfo *wi);
+
     /**
      * Perform psychoacoustic analysis and set band info (threshold, energy) for a group of channels.
      *
@@ -34,6 +34,9 @@
 #include "pthread_internal.h"
 #include "thread.h"
 
+#include "libavutil/internal.h"
+#include "libavutil/opt.h"
+
 /**
  * Set the threading algorithms used.
  *
@@ -43,12 +46,44 @@
  *
  * @param avctx The context.
  */
+/**
+ * Check whether the encoder is configured to code every frame independently
+ * of the others, which frame threading relies on.
+ */
+static int encoder_frames_independent(AVCodecContext *avctx)
+{
+    int64_t context = 0;
+
+    if (avctx->flags & (AV_CODEC_FLAG_PASS1 | AV_CODEC_FLAG_PASS2))
+        return 0;
+
+    switch (avctx->codec_id) {
+    case AV_CODEC_ID_MJPEG:
+        /* rate control carries state from frame to frame */
+        return !!(avctx->flags & AV_CODEC_FLAG_QSCALE);
+    case AV_CODEC_ID_HUFFYUV:
+    case AV_CODEC_ID_FFVHUFF:
+        /* the adaptive tables are updated after each frame */
+#if FF_API_PRIVATE_OPT
+FF_DISABLE_DEPRECATION_WARNINGS
+        if (avctx->context_model)
+            return 0;
+FF_ENABLE_DEPRECATION_WARNINGS
+#endif
+        av_opt_get_int(avctx->priv_data, "context", 0, &context);
+        return !context;
+    }
+    return 1;
+}
+
 static void validate_thread_parameters(AVCodecContext *avctx)
 {
     int frame_threading_supported = (avctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS)
                                 && !(avctx->flags  & AV_CODEC_FLAG_TRUNCATED)
                                 && !(avctx->flags  & AV_CODEC_FLAG_LOW_DELAY)
-                                && !(avctx->flags2 & AV_CODEC_FLAG2_CHUNKS);
+                                && !(avctx->flags2 & AV_CODEC_FLAG2_CHUNKS)
+                                && (!av_codec_is_encoder(avctx->codec) ||
+                                    encoder_frames_independent(avctx));
     if (avctx->thread_count == 1) {
         avctx->active_thread_type = 0;
     } else if (frame_threading_supported && (avctx->thread_type & FF_THREAD_FRAME)) {
@@ -73,7 +108,10 @@ int ff_thread_init(AVCodecContext *avctx)
 
     if (avctx->active_thread_type&FF_THREAD_SLICE)
         return ff_slice_thread_init(avctx);
-    else if (avctx->active_thread_type&FF_THREAD_FRAME)
+    /* encoder threads are started by avcodec_open2() through
+     * ff_frame_thread_encoder_init() */
+    else if (avctx->active_thread_type&FF_THREAD_FRAME &&
+             !av_codec_is_encoder(avctx->codec))
         return ff_frame_thread_init(avctx);
 
     return 0;
@@ -81,7 +119,10 @@ int ff_thread_init(AVCodecContext *avctx)
 
 void ff_thread_free(AVCodecContext *avctx)
 {
-    if (avctx->active_thread_type&FF_THREAD_FRAME)
+    if (avctx->active_thread_type&FF_THREAD_FRAME &&
+        av_codec_is_encoder(avctx->codec))
+        ff_frame_thread_encoder_free(avctx);
+    else if (avctx->active_thread_type&FF_THREAD_FRAME)
         ff_frame_thread_free(avctx, avctx->thread_count);
     else
         ff_slice_thread_free(avctx);
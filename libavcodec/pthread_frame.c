@@ -723,6 +723,7 @@ int ff_frame_thread_init(AVCodecContext *avctx)
         }
 
         *copy = *src;
+        copy->thread_pool = NULL;
 
         copy->internal = av_malloc(sizeof(AVCodecInternal));
         if (!copy->internal) {
@@ -0,0 +1,376 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Frame multithreading support functions for encoders
+ * @see doc/multithreading.txt
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
+
+#include "avcodec.h"
+#include "internal.h"
+#include "pthread_internal.h"
+#include "thread.h"
+
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/frame.h"
+#include "libavutil/internal.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+
+/**
+ * A frame submitted for encoding, and the packet it is coded into.
+ */
+typedef struct EncodeTask {
+    AVFrame  *frame;
+    AVPacket *pkt;
+    int ret;
+    int got_packet;
+    int done;               ///< set by the worker once pkt and ret are valid
+} EncodeTask;
+
+typedef struct EncodeThread {
+    struct FrameThreadEncoder *parent;
+    AVCodecContext *avctx;  ///< private encoder context of this thread
+    pthread_t thread;
+    int thread_init;
+} EncodeThread;
+
+/**
+ * Context used by frame-threaded encoders.
+ *
+ * Frames are queued into a ring of tasks, picked up by whichever thread is
+ * idle, and the packets are returned in submission order.
+ */
+typedef struct FrameThreadEncoder {
+    EncodeThread *threads;
+    int nb_threads;
+
+    EncodeTask *tasks;
+    int nb_tasks;
+    unsigned submitted;     ///< number of tasks queued by the user thread
+    unsigned started;       ///< number of tasks picked up by a worker
+    unsigned returned;      ///< number of tasks returned to the user
+
+    pthread_mutex_t lock;
+    pthread_cond_t task_cond;   ///< signalled when a task is queued
+    pthread_cond_t done_cond;   ///< signalled when a task is finished
+    int exit;
+} FrameThreadEncoder;
+
+static void * attribute_align_arg worker(void *arg)
+{
+    EncodeThread       *t = arg;
+    FrameThreadEncoder *c = t->parent;
+    AVCodecContext *avctx = t->avctx;
+
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        EncodeTask *task;
+
+        while (!c->exit && c->started == c->submitted)
+            pthread_cond_wait(&c->task_cond, &c->lock);
+        if (c->exit)
+            break;
+
+        task = &c->tasks[c->started++ % c->nb_tasks];
+        pthread_mutex_unlock(&c->lock);
+
+        task->ret = avctx->codec->encode2(avctx, task->pkt, task->frame,
+                                          &task->got_packet);
+        if (!task->ret && task->got_packet &&
+            !(avctx->codec->capabilities & AV_CODEC_CAP_DELAY))
+            task->pkt->pts = task->pkt->dts = task->frame->pts;
+        emms_c();
+        av_frame_unref(task->frame);
+
+        pthread_mutex_lock(&c->lock);
+        task->done = 1;
+        pthread_cond_broadcast(&c->done_cond);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    return NULL;
+}
+
+/**
+ * Copy the options of src into the shallow copy dst, without freeing
+ * the strings dst still shares with src.
+ */
+static int copy_options(void *dst, const void *src)
+{
+    const AVOption *o = NULL;
+
+    while ((o = av_opt_next(dst, o)))
+        if (o->type == AV_OPT_TYPE_STRING || o->type == AV_OPT_TYPE_BINARY)
+            *(uint8_t **)((uint8_t *)dst + o->offset) = NULL;
+
+    return av_opt_copy(dst, src);
+}
+
+static int open_thread_context(AVCodecContext *avctx, AVCodecContext **pctx)
+{
+    const AVCodec *codec = avctx->codec;
+    AVCodecContext *copy;
+    int ret;
+
+    copy = av_malloc(sizeof(*copy));
+    if (!copy)
+        return AVERROR(ENOMEM);
+    *pctx = copy;
+
+    memcpy(copy, avctx, sizeof(*copy));
+    copy->internal             = NULL;
+    copy->priv_data            = NULL;
+    copy->extradata            = NULL;
+    copy->extradata_size       = 0;
+    copy->coded_side_data      = NULL;
+    copy->nb_coded_side_data   = 0;
+    copy->stats_out            = NULL;
+    copy->hw_frames_ctx        = NULL;
+    copy->thread_pool          = NULL;
+#if FF_API_CODED_FRAME
+FF_DISABLE_DEPRECATION_WARNINGS
+    copy->coded_frame          = NULL;
+FF_ENABLE_DEPRECATION_WARNINGS
+#endif
+
+    ret = copy_options(copy, avctx);
+    if (ret < 0)
+        return ret;
+    copy->thread_count         = 1;
+    copy->active_thread_type   = 0;
+
+    if (avctx->hw_frames_ctx) {
+        copy->hw_frames_ctx = av_buffer_ref(avctx->hw_frames_ctx);
+        if (!copy->hw_frames_ctx)
+            return AVERROR(ENOMEM);
+    }
+
+    if (codec->priv_data_size > 0) {
+        copy->priv_data = av_malloc(codec->priv_data_size);
+        if (!copy->priv_data)
+            return AVERROR(ENOMEM);
+        memcpy(copy->priv_data, avctx->priv_data, codec->priv_data_size);
+        if (codec->priv_class) {
+            ret = copy_options(copy->priv_data, avctx->priv_data);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    return avcodec_open2(copy, codec, NULL);
+}
+
+static void close_thread_context(AVCodecContext **pctx)
+{
+    AVCodecContext *ctx = *pctx;
+
+    if (!ctx)
+        return;
+
+    /* only frees what open_thread_context() did not share with the parent */
+    avcodec_close(ctx);
+    av_freep(pctx);
+}
+
+int ff_frame_thread_encoder_init(AVCodecContext *avctx)
+{
+    int thread_count = avctx->thread_count;
+    FrameThreadEncoder *c;
+    int i, ret;
+
+#if HAVE_W32THREADS
+    w32thread_init();
+#endif
+
+    if (!thread_count) {
+        int nb_cpus = av_cpu_count();
+        av_log(avctx, AV_LOG_DEBUG, "detected %d logical cores\n", nb_cpus);
+        // use number of cores + 1 as thread count if there is more than one
+        if (nb_cpus > 1)
+            thread_count = avctx->thread_count = FFMIN(nb_cpus + 1, MAX_AUTO_THREADS);
+        else
+            thread_count = avctx->thread_count = 1;
+    }
+
+    if (thread_count <= 1) {
+        avctx->active_thread_type = 0;
+        return 0;
+    }
+
+    c = av_mallocz(sizeof(*c));
+    if (!c)
+        return AVERROR(ENOMEM);
+    avctx->internal->thread_ctx = c;
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->task_cond, NULL);
+    pthread_cond_init(&c->done_cond, NULL);
+
+    /* one spare task, so that a frame can be queued while all the threads
+     * are busy and the oldest packet is being waited for */
+    c->nb_tasks = thread_count + 1;
+    c->tasks    = av_mallocz_array(c->nb_tasks, sizeof(*c->tasks));
+    c->threads  = av_mallocz_array(thread_count, sizeof(*c->threads));
+    if (!c->tasks || !c->threads) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    for (i = 0; i < c->nb_tasks; i++) {
+        c->tasks[i].frame = av_frame_alloc();
+        c->tasks[i].pkt   = av_packet_alloc();
+        if (!c->tasks[i].frame || !c->tasks[i].pkt) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
+
+    for (; c->nb_threads < thread_count; c->nb_threads++) {
+        EncodeThread *t = &c->threads[c->nb_threads];
+
+        t->parent = c;
+        ret = open_thread_context(avctx, &t->avctx);
+        if (ret < 0)
+            goto fail;
+
+        ret = pthread_create(&t->thread, NULL, worker, t);
+        if (ret) {
+            ret = AVERROR(ret);
+            c->nb_threads++;
+            goto fail;
+        }
+        t->thread_init = 1;
+    }
+
+    return 0;
+
+fail:
+    ff_frame_thread_encoder_free(avctx);
+    avctx->active_thread_type = 0;
+    return ret;
+}
+
+void ff_frame_thread_encoder_free(AVCodecContext *avctx)
+{
+    FrameThreadEncoder *c = avctx->internal->thread_ctx;
+    int i;
+
+    if (!c)
+        return;
+
+    pthread_mutex_lock(&c->lock);
+    c->exit = 1;
+    pthread_cond_broadcast(&c->task_cond);
+    pthread_mutex_unlock(&c->lock);
+
+    for (i = 0; i < c->nb_threads; i++) {
+        EncodeThread *t = &c->threads[i];
+
+        if (t->thread_init)
+            pthread_join(t->thread, NULL);
+        close_thread_context(&t->avctx);
+    }
+    av_freep(&c->threads);
+
+    if (c->tasks) {
+        for (i = 0; i < c->nb_tasks; i++) {
+            av_frame_free(&c->tasks[i].frame);
+            av_packet_free(&c->tasks[i].pkt);
+        }
+    }
+    av_freep(&c->tasks);
+
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->task_cond);
+    pthread_cond_destroy(&c->done_cond);
+
+    av_freep(&avctx->internal->thread_ctx);
+}
+
+int ff_thread_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
+                           const AVFrame *frame, int *got_packet_ptr)
+{
+    FrameThreadEncoder *c = avctx->internal->thread_ctx;
+    EncodeTask *task;
+    int ret;
+
+    *got_packet_ptr = 0;
+
+    if (frame) {
+        task = &c->tasks[c->submitted % c->nb_tasks];
+
+        ret = av_frame_ref(task->frame, frame);
+        if (ret < 0)
+            return ret;
+        task->done = 0;
+
+        pthread_mutex_lock(&c->lock);
+        c->submitted++;
+        pthread_cond_signal(&c->task_cond);
+        pthread_mutex_unlock(&c->lock);
+
+        /* keep every thread busy before waiting on anything */
+        if (c->submitted - c->returned <= c->nb_threads)
+            return 0;
+    } else if (c->submitted == c->returned) {
+        return 0;
+    }
+
+    task = &c->tasks[c->returned++ % c->nb_tasks];
+
+    pthread_mutex_lock(&c->lock);
+    while (!task->done)
+        pthread_cond_wait(&c->done_cond, &c->lock);
+    pthread_mutex_unlock(&c->lock);
+
+    ret = task->ret;
+    if (!ret && task->got_packet) {
+        if (avpkt->data) {
+            /* the user supplied the packet buffer */
+            if (avpkt->size < task->pkt->size) {
+                av_log(avctx, AV_LOG_ERROR,
+                       "User packet is too small (%d < %d)\n",
+                       avpkt->size, task->pkt->size);
+                ret = AVERROR(EINVAL);
+            } else {
+                memcpy(avpkt->data, task->pkt->data, task->pkt->size);
+                avpkt->size = task->pkt->size;
+                ret = av_packet_copy_props(avpkt, task->pkt);
+            }
+        } else {
+            av_packet_move_ref(avpkt, task->pkt);
+        }
+        *got_packet_ptr = !ret;
+    }
+    av_packet_unref(task->pkt);
+
+    return ret;
+}
@@ -35,14 +35,17 @@
 #include "pthread_internal.h"
 #include "thread.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/common.h"
 #include "libavutil/cpu.h"
 #include "libavutil/mem.h"
+#include "libavutil/threadpool.h"
 
 typedef int (action_func)(AVCodecContext *c, void *arg);
 typedef int (action_func2)(AVCodecContext *c, void *arg, int jobnr, int threadnr);
 
 typedef struct SliceThreadContext {
+    AVBufferRef *pool;      ///< shared thread pool used instead of the own workers
     pthread_t *workers;
     action_func *func;
     action_func2 *func2;
@@ -58,6 +61,11 @@ typedef struct SliceThreadContext {
     unsigned current_execute;
     int current_job;
     int done;
+
+    int *progress;
+    int progress_count;
+    pthread_cond_t progress_cond;
+    pthread_mutex_t progress_lock;
 } SliceThreadContext;
 
 static void* attribute_align_arg worker(void *v)
@@ -101,18 +109,26 @@ void ff_slice_thread_free(AVCodecContext *avctx)
     SliceThreadContext *c = avctx->internal->thread_ctx;
     int i;
 
-    pthread_mutex_lock(&c->current_job_lock);
-    c->done = 1;
-    pthread_cond_broadcast(&c->current_job_cond);
-    pthread_mutex_unlock(&c->current_job_lock);
+    if (c->pool) {
+        av_buffer_unref(&c->pool);
+    } else {
+        pthread_mutex_lock(&c->current_job_lock);
+        c->done = 1;
+        pthread_cond_broadcast(&c->current_job_cond);
+        pthread_mutex_unlock(&c->current_job_lock);
 
-    for (i=0; i<avctx->thread_count; i++)
-         pthread_join(c->workers[i], NULL);
+        for (i=0; i<avctx->thread_count; i++)
+             pthread_join(c->workers[i], NULL);
+
+        pthread_mutex_destroy(&c->current_job_lock);
+        pthread_cond_destroy(&c->current_job_cond);
+        pthread_cond_destroy(&c->last_job_cond);
+        av_free(c->workers);
+    }
 
-    pthread_mutex_destroy(&c->current_job_lock);
-    pthread_cond_destroy(&c->current_job_cond);
-    pthread_cond_destroy(&c->last_job_cond);
-    av_free(c->workers);
+    pthread_mutex_destroy(&c->progress_lock);
+    pthread_cond_destroy(&c->progress_cond);
+    av_free(c->progress);
     av_freep(&avctx->internal->thread_ctx);
 }
 
@@ -163,6 +179,84 @@ static int thread_execute2(AVCodecContext *avctx, action_func2* func2, void *arg
     return thread_execute(avctx, NULL, arg, ret, job_count, 0);
 }
 
+typedef struct PoolExecuteContext {
+    AVCodecContext *avctx;
+    action_func    *func;
+    action_func2   *func2;
+    void           *args;
+    int             job_size;
+} PoolExecuteContext;
+
+static int pool_job(void *arg, int jobnr, int threadnr)
+{
+    PoolExecuteContext *e = arg;
+
+    return e->func ? e->func(e->avctx, (char*)e->args + jobnr * e->job_size) :
+                     e->func2(e->avctx, e->args, jobnr, threadnr);
+}
+
+static int pool_execute(AVCodecContext *avctx, action_func *func, void *arg,
+                        int *ret, int job_count, int job_size)
+{
+    SliceThreadContext *c = avctx->internal->thread_ctx;
+    PoolExecuteContext e  = { avctx, func, NULL, arg, job_size };
+
+    if (!(avctx->active_thread_type & FF_THREAD_SLICE))
+        return avcodec_default_execute(avctx, func, arg, ret, job_count, job_size);
+
+    return av_thread_pool_execute(c->pool, pool_job, &e, ret, job_count,
+                                  avctx->thread_count);
+}
+
+static int pool_execute2(AVCodecContext *avctx, action_func2 *func2, void *arg,
+                         int *ret, int job_count)
+{
+    SliceThreadContext *c = avctx->internal->thread_ctx;
+    PoolExecuteContext e  = { avctx, NULL, func2, arg, 0 };
+
+    if (!(avctx->active_thread_type & FF_THREAD_SLICE))
+        return avcodec_default_execute2(avctx, func2, arg, ret, job_count);
+
+    return av_thread_pool_execute(c->pool, pool_job, &e, ret, job_count,
+                                  avctx->thread_count);
+}
+
+/**
+ * Run the slice jobs on the thread pool set by the caller instead of
+ * starting threads for this context. The thread count is only used to bound
+ * the number of jobs running at the same time.
+ */
+static int pool_thread_init(AVCodecContext *avctx)
+{
+    SliceThreadContext *c;
+
+    if (!avctx->thread_count)
+        avctx->thread_count = FFMIN(av_thread_pool_nb_threads(avctx->thread_pool) + 1,
+                                    MAX_AUTO_THREADS);
+
+    if (avctx->thread_count <= 1) {
+        avctx->active_thread_type = 0;
+        return 0;
+    }
+
+    c = av_mallocz(sizeof(SliceThreadContext));
+    if (!c)
+        return AVERROR(ENOMEM);
+
+    c->pool = av_buffer_ref(avctx->thread_pool);
+    if (!c->pool) {
+        av_free(c);
+        return AVERROR(ENOMEM);
+    }
+    pthread_cond_init(&c->progress_cond, NULL);
+    pthread_mutex_init(&c->progress_lock, NULL);
+
+    avctx->internal->thread_ctx = c;
+    avctx->execute  = pool_execute;
+    avctx->execute2 = pool_execute2;
+    return 0;
+}
+
 int ff_slice_thread_init(AVCodecContext *avctx)
 {
     int i;
@@ -173,6 +267,9 @@ int ff_slice_thread_init(AVCodecContext *avctx)
     w32thread_init();
 #endif
 
+    if (avctx->thread_pool)
+        return pool_thread_init(avctx);
+
     if (!thread_count) {
         int nb_cpus = av_cpu_count();
         av_log(avctx, AV_LOG_DEBUG, "detected %d logical cores\n", nb_cpus);
@@ -206,6 +303,8 @@ int ff_slice_thread_init(AVCodecContext *avctx)
     pthread_cond_init(&c->current_job_cond, NULL);
     pthread_cond_init(&c->last_job_cond, NULL);
     pthread_mutex_init(&c->current_job_lock, NULL);
+    pthread_cond_init(&c->progress_cond, NULL);
+    pthread_mutex_init(&c->progress_lock, NULL);
     pthread_mutex_lock(&c->current_job_lock);
     for (i=0; i<thread_count; i++) {
         if(pthread_create(&c->workers[i], NULL, worker, avctx)) {
@@ -222,3 +321,48 @@ int ff_slice_thread_init(AVCodecContext *avctx)
     avctx->execute2 = thread_execute2;
     return 0;
 }
+
+int ff_slice_thread_init_progress(AVCodecContext *avctx, int count)
+{
+    SliceThreadContext *c = avctx->internal->thread_ctx;
+
+    if (!(avctx->active_thread_type & FF_THREAD_SLICE))
+        return 0;
+
+    if (count > c->progress_count) {
+        int *progress = av_realloc_array(c->progress, count, sizeof(*progress));
+        if (!progress)
+            return AVERROR(ENOMEM);
+        c->progress       = progress;
+        c->progress_count = count;
+    }
+    memset(c->progress, 0, count * sizeof(*c->progress));
+
+    return 0;
+}
+
+void ff_thread_report_progress2(AVCodecContext *avctx, int job, int progress)
+{
+    SliceThreadContext *c = avctx->internal->thread_ctx;
+
+    if (!(avctx->active_thread_type & FF_THREAD_SLICE))
+        return;
+
+    pthread_mutex_lock(&c->progress_lock);
+    c->progress[job] = progress;
+    pthread_cond_broadcast(&c->progress_cond);
+    pthread_mutex_unlock(&c->progress_lock);
+}
+
+void ff_thread_await_progress2(AVCodecContext *avctx, int job, int progress)
+{
+    SliceThreadContext *c = avctx->internal->thread_ctx;
+
+    if (!(avctx->active_thread_type & FF_THREAD_SLICE))
+        return;
+
+    pthread_mutex_lock(&c->progress_lock);
+    while (c->progress[job] < progress)
+        pthread_cond_wait(&c->progress_cond, &c->progress_lock);
+    pthread_mutex_unlock(&c->progress_lock);
+}
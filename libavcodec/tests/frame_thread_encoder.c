@@ -0,0 +1,122 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This test program encodes a few frames with a frame-threaded encoder
+ * whose context was given a thread pool, so that the per-thread contexts
+ * are set up and freed along with the pool reference.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "libavutil/frame.h"
+#include "libavutil/threadpool.h"
+
+#include "libavcodec/avcodec.h"
+
+#define WIDTH     64
+#define HEIGHT    48
+#define NB_FRAMES 8
+
+static int receive_packets(AVCodecContext *avctx, AVPacket *pkt)
+{
+    int ret;
+
+    while ((ret = avcodec_receive_packet(avctx, pkt)) >= 0) {
+        printf("%"PRId64" %d\n", pkt->pts, pkt->size);
+        av_packet_unref(pkt);
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+int main(void)
+{
+    AVCodecContext *avctx = NULL;
+    AVFrame *frame        = NULL;
+    AVPacket *pkt         = NULL;
+    const AVCodec *codec;
+    int i, x, y, ret;
+
+    avcodec_register_all();
+
+    codec = avcodec_find_encoder(AV_CODEC_ID_HUFFYUV);
+    if (!codec)
+        return 1;
+
+    avctx = avcodec_alloc_context3(codec);
+    frame = av_frame_alloc();
+    pkt   = av_packet_alloc();
+    if (!avctx || !frame || !pkt) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    avctx->width        = WIDTH;
+    avctx->height       = HEIGHT;
+    avctx->pix_fmt      = AV_PIX_FMT_YUV422P;
+    avctx->time_base    = (AVRational){ 1, 25 };
+    avctx->thread_count = 3;
+    avctx->thread_type  = FF_THREAD_FRAME;
+
+    ret = av_thread_pool_create(&avctx->thread_pool, 2, 0);
+    if (ret < 0)
+        goto end;
+
+    ret = avcodec_open2(avctx, codec, NULL);
+    if (ret < 0)
+        goto end;
+
+    for (i = 0; i < NB_FRAMES; i++) {
+        frame->width  = WIDTH;
+        frame->height = HEIGHT;
+        frame->format = AV_PIX_FMT_YUV422P;
+        ret = av_frame_get_buffer(frame, 32);
+        if (ret < 0)
+            goto end;
+        for (y = 0; y < HEIGHT; y++) {
+            for (x = 0; x < WIDTH; x++)
+                frame->data[0][y * frame->linesize[0] + x] = x * y + i * 3;
+            for (x = 0; x < WIDTH / 2; x++) {
+                frame->data[1][y * frame->linesize[1] + x] = 128 + x - y + i;
+                frame->data[2][y * frame->linesize[2] + x] = 64 + x + y - i;
+            }
+        }
+        frame->pts = i;
+
+        ret = avcodec_send_frame(avctx, frame);
+        av_frame_unref(frame);
+        if (ret < 0)
+            goto end;
+        if ((ret = receive_packets(avctx, pkt)) < 0)
+            goto end;
+    }
+
+    ret = avcodec_send_frame(avctx, NULL);
+    if (ret < 0)
+        goto end;
+    ret = receive_packets(avctx, pkt);
+
+end:
+    if (ret < 0)
+        printf("error %d\n", ret);
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&avctx);
+    return ret < 0;
+}
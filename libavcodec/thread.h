@@ -122,6 +122,48 @@ void ff_thread_release_buffer(AVCodecContext *avctx, ThreadFrame *f);
 
 int ff_thread_ref_frame(ThreadFrame *dst, ThreadFrame *src);
 
+/**
+ * Allocate and reset the progress counters of the jobs of the next
+ * execute2() call, for codecs whose slice-threaded jobs depend on each other
+ * (e.g. the rows of a wavefront). Does nothing without slice threading.
+ *
+ * @param count The number of jobs.
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_slice_thread_init_progress(AVCodecContext *avctx, int count);
+
+/**
+ * Notify the other slice-threaded jobs that a job reached a given
+ * progress, in arbitrary units. The value must not decrease.
+ */
+void ff_thread_report_progress2(AVCodecContext *avctx, int job, int progress);
+
+/**
+ * Wait until a slice-threaded job reported at least the given progress.
+ * The awaited job must have been started before the calling one, which is
+ * always the case for a job with a lower index.
+ */
+void ff_thread_await_progress2(AVCodecContext *avctx, int job, int progress);
+
+/**
+ * Open one encoder context per thread for frame-threaded encoding.
+ * Called by avcodec_open2() before the codec is initialized.
+ *
+ * @param avctx The context, with the codec options already set.
+ */
+int ff_frame_thread_encoder_init(AVCodecContext *avctx);
+
+/**
+ * Submit a new frame to an encoding thread.
+ * Returns the next finished packet in avpkt, in submission order.
+ * *got_packet_ptr will be 0 if none is available yet.
+ * Passing a NULL frame returns the oldest packet still pending.
+ *
+ * Parameters are the same as avcodec_encode_video2().
+ */
+int ff_thread_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
+                           const AVFrame *frame, int *got_packet_ptr);
+
 int ff_thread_init(AVCodecContext *s);
 void ff_thread_free(AVCodecContext *s);
 
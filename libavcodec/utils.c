@@ -360,9 +360,45 @@ int avcodec_default_execute2(AVCodecContext *c, int (*func)(AVCodecContext *c2,
     return 0;
 }
 
+static int lock_avcodec(AVCodecContext *avctx, const AVCodec *codec)
+{
+    if (!(codec->caps_internal & FF_CODEC_CAP_INIT_THREADSAFE) && codec->init) {
+        /* If there is a user-supplied mutex locking routine, call it. */
+        if (lockmgr_cb) {
+            if ((*lockmgr_cb)(&codec_mutex, AV_LOCK_OBTAIN))
+                return -1;
+        }
+
+        entangled_thread_counter++;
+        if (entangled_thread_counter != 1) {
+            av_log(avctx, AV_LOG_ERROR,
+                   "Insufficient thread locking. At least %d threads are "
+                   "calling avcodec_open2() at the same time right now.\n",
+                   entangled_thread_counter);
+            entangled_thread_counter--;
+            if (lockmgr_cb)
+                (*lockmgr_cb)(&codec_mutex, AV_LOCK_RELEASE);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void unlock_avcodec(const AVCodec *codec)
+{
+    if (!(codec->caps_internal & FF_CODEC_CAP_INIT_THREADSAFE) && codec->init) {
+        entangled_thread_counter--;
+
+        /* Release any user-supplied mutex. */
+        if (lockmgr_cb) {
+            (*lockmgr_cb)(&codec_mutex, AV_LOCK_RELEASE);
+        }
+    }
+}
+
 int attribute_align_arg avcodec_open2(AVCodecContext *avctx, const AVCodec *codec, AVDictionary **options)
 {
-    int ret = 0;
+    int ret = 0, locked = 1;
     AVDictionary *tmp = NULL;
 
     if (avcodec_is_open(avctx))
@@ -383,27 +419,12 @@ int attribute_align_arg avcodec_open2(AVCodecContext *avctx, const AVCodec *code
     if (avctx->extradata_size < 0 || avctx->extradata_size >= FF_MAX_EXTRADATA_SIZE)
         return AVERROR(EINVAL);
 
+    if (lock_avcodec(avctx, codec) < 0)
+        return -1;
+
     if (options)
         av_dict_copy(&tmp, *options, 0);
 
-    /* If there is a user-supplied mutex locking routine, call it. */
-    if (!(codec->caps_internal & FF_CODEC_CAP_INIT_THREADSAFE) && codec->init) {
-        if (lockmgr_cb) {
-            if ((*lockmgr_cb)(&codec_mutex, AV_LOCK_OBTAIN))
-                return -1;
-        }
-
-        entangled_thread_counter++;
-        if (entangled_thread_counter != 1) {
-            av_log(avctx, AV_LOG_ERROR,
-                   "Insufficient thread locking. At least %d threads are "
-                   "calling avcodec_open2() at the same time right now.\n",
-                   entangled_thread_counter);
-            ret = -1;
-            goto end;
-        }
-    }
-
     avctx->internal = av_mallocz(sizeof(AVCodecInternal));
     if (!avctx->internal) {
         ret = AVERROR(ENOMEM);
@@ -660,7 +681,23 @@ FF_ENABLE_DEPRECATION_WARNINGS
         }
     }
 
-    if (avctx->codec->init && !(avctx->active_thread_type & FF_THREAD_FRAME)) {
+    if (HAVE_THREADS && av_codec_is_encoder(avctx->codec) &&
+        avctx->active_thread_type & FF_THREAD_FRAME) {
+        /* The per-thread encoder contexts are opened with avcodec_open2()
+         * as well, so the global lock must not be held meanwhile. */
+        unlock_avcodec(codec);
+        ret = ff_frame_thread_encoder_init(avctx);
+        if (lock_avcodec(avctx, codec) < 0) {
+            locked = 0;
+            ret    = -1;
+            goto free_and_end;
+        }
+        if (ret < 0)
+            goto free_and_end;
+    }
+
+    if (avctx->codec->init && (!(avctx->active_thread_type & FF_THREAD_FRAME) ||
+                               av_codec_is_encoder(avctx->codec))) {
         ret = avctx->codec->init(avctx);
         if (ret < 0) {
             goto free_and_end;
@@ -696,14 +733,8 @@ FF_ENABLE_DEPRECATION_WARNINGS
 #endif
     }
 end:
-    if (!(codec->caps_internal & FF_CODEC_CAP_INIT_THREADSAFE) && codec->init) {
-        entangled_thread_counter--;
-
-        /* Release any user-supplied mutex. */
-        if (lockmgr_cb) {
-            (*lockmgr_cb)(&codec_mutex, AV_LOCK_RELEASE);
-        }
-    }
+    if (locked)
+        unlock_avcodec(codec);
 
     if (options) {
         av_dict_free(options);
@@ -712,6 +743,8 @@ end:
 
     return ret;
 free_and_end:
+    if (HAVE_THREADS && avctx->internal && avctx->internal->thread_ctx)
+        ff_thread_free(avctx);
     if (avctx->codec &&
         (avctx->codec->caps_internal & FF_CODEC_CAP_INIT_CLEANUP))
         avctx->codec->close(avctx);
@@ -801,6 +834,7 @@ av_cold int avcodec_close(AVCodecContext *avctx)
     avctx->nb_coded_side_data = 0;
 
     av_buffer_unref(&avctx->hw_frames_ctx);
+    av_buffer_unref(&avctx->thread_pool);
 
     if (avctx->priv_data && avctx->codec && avctx->codec->priv_class)
         av_opt_free(avctx->priv_data);
@@ -1513,6 +1547,19 @@ void ff_thread_await_progress(ThreadFrame *f, int progress, int field)
 {
 }
 
+int ff_slice_thread_init_progress(AVCodecContext *avctx, int count)
+{
+    return 0;
+}
+
+void ff_thread_report_progress2(AVCodecContext *avctx, int job, int progress)
+{
+}
+
+void ff_thread_await_progress2(AVCodecContext *avctx, int job, int progress)
+{
+}
+
 #endif
 
 int avcodec_is_open(AVCodecContext *s)
@@ -116,7 +116,7 @@ static int update_size(AVCodecContext *avctx, int w, int h)
 {
     VP9Context *s = avctx->priv_data;
     uint8_t *p;
-    int nb_blocks, nb_superblocks;
+    int nb_blocks, nb_superblocks, lflvl_rows;
 
     if (s->above_partition_ctx && w == s->alloc_width && h == s->alloc_height)
         return 0;
@@ -133,10 +133,14 @@ static int update_size(AVCodecContext *avctx, int w, int h)
     s->cols       = (w +  7) >> 3;
     s->rows       = (h +  7) >> 3;
 
+    // with slice threads, the loopfilter lags behind the tile columns by
+    // an arbitrary number of sb64 rows
+    lflvl_rows = avctx->active_thread_type & FF_THREAD_SLICE ? s->sb_rows : 1;
+
 #define assign(var, type, n) var = (type)p; p += s->sb_cols * n * sizeof(*var)
     av_free(s->above_partition_ctx);
-    p = av_malloc(s->sb_cols *
-                  (240 + sizeof(*s->lflvl) + 16 * sizeof(*s->above_mv_ctx)));
+    p = av_malloc(s->sb_cols * (240 + lflvl_rows * sizeof(*s->lflvl) +
+                                16 * sizeof(*s->above_mv_ctx)));
     if (!p)
         return AVERROR(ENOMEM);
     assign(s->above_partition_ctx, uint8_t *,     8);
@@ -154,7 +158,7 @@ static int update_size(AVCodecContext *avctx, int w, int h)
     assign(s->above_comp_ctx,      uint8_t *,     8);
     assign(s->above_ref_ctx,       uint8_t *,     8);
     assign(s->above_filter_ctx,    uint8_t *,     8);
-    assign(s->lflvl,               VP9Filter *,   1);
+    assign(s->lflvl,               VP9Filter *,   lflvl_rows);
     assign(s->above_mv_ctx,        VP56mv(*)[2], 16);
 #undef assign
 
@@ -164,6 +168,9 @@ static int update_size(AVCodecContext *avctx, int w, int h)
     if (avctx->active_thread_type & FF_THREAD_FRAME) {
         nb_blocks      = s->cols * s->rows;
         nb_superblocks = s->sb_cols * s->sb_rows;
+    } else if (avctx->active_thread_type & FF_THREAD_SLICE) {
+        // one set of block scratch buffers per thread
+        nb_blocks = nb_superblocks = avctx->thread_count;
     } else {
         nb_blocks = nb_superblocks = 1;
     }
@@ -409,9 +416,22 @@ static int decode_frame_header(AVCodecContext *avctx,
     s->filter.level = get_bits(&s->gb, 6);
     sharp           = get_bits(&s->gb, 3);
     /* If sharpness changed, reinit lim/mblim LUTs. if it didn't change,
-     * keep the old cache values since they are still valid. */
-    if (s->filter.sharpness != sharp)
-        memset(s->filter.lim_lut, 0, sizeof(s->filter.lim_lut));
+     * keep the old cache values since they are still valid. The tables are
+     * filled up front since tile columns may be decoded concurrently. */
+    if (s->filter.sharpness != sharp) {
+        for (i = 0; i < 64; i++) {
+            int limit = i;
+
+            if (sharp > 0) {
+                limit >>= (sharp + 3) >> 2;
+                limit   = FFMIN(limit, 9 - sharp);
+            }
+            limit = FFMAX(limit, 1);
+
+            s->filter.lim_lut[i]   = limit;
+            s->filter.mblim_lut[i] = 2 * (i + 2) + limit;
+        }
+    }
     s->filter.sharpness = sharp;
     if ((s->lf_delta.enabled = get_bits1(&s->gb))) {
         if (get_bits1(&s->gb)) {
@@ -762,11 +782,10 @@ static int decode_frame_header(AVCodecContext *avctx,
     return (data2 - data) + size2;
 }
 
-static int decode_subblock(AVCodecContext *avctx, int row, int col,
+static int decode_subblock(VP9Context *s, int row, int col,
                            VP9Filter *lflvl,
                            ptrdiff_t yoff, ptrdiff_t uvoff, enum BlockLevel bl)
 {
-    VP9Context *s = avctx->priv_data;
     AVFrame    *f = s->frames[CUR_FRAME].tf.f;
     int c = ((s->above_partition_ctx[col]       >> (3 - bl)) & 1) |
             (((s->left_partition_ctx[row & 0x7] >> (3 - bl)) & 1) << 1);
@@ -778,49 +797,49 @@ static int decode_subblock(AVCodecContext *avctx, int row, int col,
 
     if (bl == BL_8X8) {
         bp  = vp8_rac_get_tree(&s->c, ff_vp9_partition_tree, p);
-        ret = ff_vp9_decode_block(avctx, row, col, lflvl, yoff, uvoff, bl, bp);
+        ret = ff_vp9_decode_block(s, row, col, lflvl, yoff, uvoff, bl, bp);
     } else if (col + hbs < s->cols) {
         if (row + hbs < s->rows) {
             bp = vp8_rac_get_tree(&s->c, ff_vp9_partition_tree, p);
             switch (bp) {
             case PARTITION_NONE:
-                ret = ff_vp9_decode_block(avctx, row, col, lflvl, yoff, uvoff,
+                ret = ff_vp9_decode_block(s, row, col, lflvl, yoff, uvoff,
                                           bl, bp);
                 break;
             case PARTITION_H:
-                ret = ff_vp9_decode_block(avctx, row, col, lflvl, yoff, uvoff,
+                ret = ff_vp9_decode_block(s, row, col, lflvl, yoff, uvoff,
                                           bl, bp);
                 if (!ret) {
                     yoff  += hbs * 8 * f->linesize[0];
                     uvoff += hbs * 4 * f->linesize[1];
-                    ret    = ff_vp9_decode_block(avctx, row + hbs, col, lflvl,
+                    ret    = ff_vp9_decode_block(s, row + hbs, col, lflvl,
                                                  yoff, uvoff, bl, bp);
                 }
                 break;
             case PARTITION_V:
-                ret = ff_vp9_decode_block(avctx, row, col, lflvl, yoff, uvoff,
+                ret = ff_vp9_decode_block(s, row, col, lflvl, yoff, uvoff,
                                           bl, bp);
                 if (!ret) {
                     yoff  += hbs * 8;
                     uvoff += hbs * 4;
-                    ret    = ff_vp9_decode_block(avctx, row, col + hbs, lflvl,
+                    ret    = ff_vp9_decode_block(s, row, col + hbs, lflvl,
                                                  yoff, uvoff, bl, bp);
                 }
                 break;
             case PARTITION_SPLIT:
-                ret = decode_subblock(avctx, row, col, lflvl,
+                ret = decode_subblock(s, row, col, lflvl,
                                       yoff, uvoff, bl + 1);
                 if (!ret) {
-                    ret = decode_subblock(avctx, row, col + hbs, lflvl,
+                    ret = decode_subblock(s, row, col + hbs, lflvl,
                                           yoff + 8 * hbs, uvoff + 4 * hbs,
                                           bl + 1);
                     if (!ret) {
                         yoff  += hbs * 8 * f->linesize[0];
                         uvoff += hbs * 4 * f->linesize[1];
-                        ret    = decode_subblock(avctx, row + hbs, col, lflvl,
+                        ret    = decode_subblock(s, row + hbs, col, lflvl,
                                                  yoff, uvoff, bl + 1);
                         if (!ret) {
-                            ret = decode_subblock(avctx, row + hbs, col + hbs,
+                            ret = decode_subblock(s, row + hbs, col + hbs,
                                                   lflvl, yoff + 8 * hbs,
                                                   uvoff + 4 * hbs, bl + 1);
                         }
@@ -828,48 +847,47 @@ static int decode_subblock(AVCodecContext *avctx, int row, int col,
                 }
                 break;
             default:
-                av_log(avctx, AV_LOG_ERROR, "Unexpected partition %d.", bp);
+                av_log(s->avctx, AV_LOG_ERROR, "Unexpected partition %d.", bp);
                 return AVERROR_INVALIDDATA;
             }
         } else if (vp56_rac_get_prob_branchy(&s->c, p[1])) {
             bp  = PARTITION_SPLIT;
-            ret = decode_subblock(avctx, row, col, lflvl, yoff, uvoff, bl + 1);
+            ret = decode_subblock(s, row, col, lflvl, yoff, uvoff, bl + 1);
             if (!ret)
-                ret = decode_subblock(avctx, row, col + hbs, lflvl,
+                ret = decode_subblock(s, row, col + hbs, lflvl,
                                       yoff + 8 * hbs, uvoff + 4 * hbs, bl + 1);
         } else {
             bp  = PARTITION_H;
-            ret = ff_vp9_decode_block(avctx, row, col, lflvl, yoff, uvoff,
+            ret = ff_vp9_decode_block(s, row, col, lflvl, yoff, uvoff,
                                       bl, bp);
         }
     } else if (row + hbs < s->rows) {
         if (vp56_rac_get_prob_branchy(&s->c, p[2])) {
             bp  = PARTITION_SPLIT;
-            ret = decode_subblock(avctx, row, col, lflvl, yoff, uvoff, bl + 1);
+            ret = decode_subblock(s, row, col, lflvl, yoff, uvoff, bl + 1);
             if (!ret) {
                 yoff  += hbs * 8 * f->linesize[0];
                 uvoff += hbs * 4 * f->linesize[1];
-                ret    = decode_subblock(avctx, row + hbs, col, lflvl,
+                ret    = decode_subblock(s, row + hbs, col, lflvl,
                                          yoff, uvoff, bl + 1);
             }
         } else {
             bp  = PARTITION_V;
-            ret = ff_vp9_decode_block(avctx, row, col, lflvl, yoff, uvoff,
+            ret = ff_vp9_decode_block(s, row, col, lflvl, yoff, uvoff,
                                       bl, bp);
         }
     } else {
         bp  = PARTITION_SPLIT;
-        ret = decode_subblock(avctx, row, col, lflvl, yoff, uvoff, bl + 1);
+        ret = decode_subblock(s, row, col, lflvl, yoff, uvoff, bl + 1);
     }
     s->counts.partition[bl][c][bp]++;
 
     return ret;
 }
 
-static int decode_superblock_mem(AVCodecContext *avctx, int row, int col, struct VP9Filter *lflvl,
+static int decode_superblock_mem(VP9Context *s, int row, int col, struct VP9Filter *lflvl,
                                  ptrdiff_t yoff, ptrdiff_t uvoff, enum BlockLevel bl)
 {
-    VP9Context *s = avctx->priv_data;
     VP9Block *b = s->b;
     ptrdiff_t hbs = 4 >> bl;
     AVFrame *f = s->frames[CUR_FRAME].tf.f;
@@ -878,43 +896,43 @@ static int decode_superblock_mem(AVCodecContext *avctx, int row, int col, struct
 
     if (bl == BL_8X8) {
         av_assert2(b->bl == BL_8X8);
-        res = ff_vp9_decode_block(avctx, row, col, lflvl, yoff, uvoff, b->bl, b->bp);
+        res = ff_vp9_decode_block(s, row, col, lflvl, yoff, uvoff, b->bl, b->bp);
     } else if (s->b->bl == bl) {
-        if ((res = ff_vp9_decode_block(avctx, row, col, lflvl, yoff, uvoff, b->bl, b->bp)) < 0)
+        if ((res = ff_vp9_decode_block(s, row, col, lflvl, yoff, uvoff, b->bl, b->bp)) < 0)
             return res;
         if (b->bp == PARTITION_H && row + hbs < s->rows) {
             yoff  += hbs * 8 * y_stride;
             uvoff += hbs * 4 * uv_stride;
-            res = ff_vp9_decode_block(avctx, row + hbs, col, lflvl, yoff, uvoff, b->bl, b->bp);
+            res = ff_vp9_decode_block(s, row + hbs, col, lflvl, yoff, uvoff, b->bl, b->bp);
         } else if (b->bp == PARTITION_V && col + hbs < s->cols) {
             yoff  += hbs * 8;
             uvoff += hbs * 4;
-            res = ff_vp9_decode_block(avctx, row, col + hbs, lflvl, yoff, uvoff, b->bl, b->bp);
+            res = ff_vp9_decode_block(s, row, col + hbs, lflvl, yoff, uvoff, b->bl, b->bp);
         }
     } else {
-        if ((res = decode_superblock_mem(avctx, row, col, lflvl, yoff, uvoff, bl + 1)) < 0)
+        if ((res = decode_superblock_mem(s, row, col, lflvl, yoff, uvoff, bl + 1)) < 0)
             return res;
         if (col + hbs < s->cols) { // FIXME why not <=?
             if (row + hbs < s->rows) {
-                if ((res = decode_superblock_mem(avctx, row, col + hbs, lflvl, yoff + 8 * hbs,
+                if ((res = decode_superblock_mem(s, row, col + hbs, lflvl, yoff + 8 * hbs,
                                                  uvoff + 4 * hbs, bl + 1)) < 0)
                     return res;
                 yoff  += hbs * 8 * y_stride;
                 uvoff += hbs * 4 * uv_stride;
-                if ((res = decode_superblock_mem(avctx, row + hbs, col, lflvl, yoff,
+                if ((res = decode_superblock_mem(s, row + hbs, col, lflvl, yoff,
                                                  uvoff, bl + 1)) < 0)
                     return res;
-                res = decode_superblock_mem(avctx, row + hbs, col + hbs, lflvl,
+                res = decode_superblock_mem(s, row + hbs, col + hbs, lflvl,
                                             yoff + 8 * hbs, uvoff + 4 * hbs, bl + 1);
             } else {
                 yoff  += hbs * 8;
                 uvoff += hbs * 4;
-                res = decode_superblock_mem(avctx, row, col + hbs, lflvl, yoff, uvoff, bl + 1);
+                res = decode_superblock_mem(s, row, col + hbs, lflvl, yoff, uvoff, bl + 1);
             }
         } else if (row + hbs < s->rows) {
             yoff  += hbs * 8 * y_stride;
             uvoff += hbs * 4 * uv_stride;
-            res = decode_superblock_mem(avctx, row + hbs, col, lflvl, yoff, uvoff, bl + 1);
+            res = decode_superblock_mem(s, row + hbs, col, lflvl, yoff, uvoff, bl + 1);
         }
     }
 
@@ -1172,6 +1190,165 @@ static void set_tile_offset(int *start, int *end, int idx, int log2_n, int n)
     *end   = FFMIN(sb_end,   n) << 3;
 }
 
+static void reset_left_ctx(VP9Context *s)
+{
+    memset(s->left_partition_ctx, 0, 8);
+    memset(s->left_skip_ctx, 0, 8);
+    if (s->keyframe || s->intraonly)
+        memset(s->left_mode_ctx, DC_PRED, 16);
+    else
+        memset(s->left_mode_ctx, NEARESTMV, 8);
+    memset(s->left_y_nnz_ctx, 0, 16);
+    memset(s->left_uv_nnz_ctx, 0, 16);
+    memset(s->left_segpred_ctx, 0, 8);
+}
+
+/**
+ * Decode one tile column of the current tile row with its own copy of the
+ * context, reporting the number of finished sb64 rows as progress.
+ */
+static int decode_tile_col(AVCodecContext *avctx, int tile_col, int thread)
+{
+    VP9Context *s  = avctx->priv_data;
+    VP9Context *td = &s->tile_ctx[tile_col];
+    AVFrame *f = s->frames[CUR_FRAME].tf.f;
+    int row, col, start, end, ret;
+
+    memcpy(td, s, sizeof(*td));
+    memset(&td->counts, 0, sizeof(td->counts));
+    td->b          = s->b_base          + thread;
+    td->block      = s->block_base      + thread * 64 * 64;
+    td->uvblock[0] = s->uvblock_base[0] + thread * 32 * 32;
+    td->uvblock[1] = s->uvblock_base[1] + thread * 32 * 32;
+    td->eob        = s->eob_base        + thread * 256;
+    td->uveob[0]   = s->uveob_base[0]   + thread * 64;
+    td->uveob[1]   = s->uveob_base[1]   + thread * 64;
+    td->c          = s->c_b[tile_col];
+
+    set_tile_offset(&td->tiling.tile_col_start, &td->tiling.tile_col_end,
+                    tile_col, s->tiling.log2_tile_cols, s->sb_cols);
+    start = td->tiling.tile_col_start;
+    end   = FFMIN(td->tiling.tile_col_end, s->cols);
+
+    for (row = s->tiling.tile_row_start;
+         row < s->tiling.tile_row_end; row += 8) {
+        VP9Filter *lflvl = s->lflvl + (row >> 3) * s->sb_cols + (start >> 3);
+        ptrdiff_t yoff   = (row >> 3) * f->linesize[0] * 64 + start * 8;
+        ptrdiff_t uvoff  = (row >> 3) * f->linesize[1] * 32 + start * 4;
+
+        reset_left_ctx(td);
+
+        for (col = start; col < td->tiling.tile_col_end;
+             col += 8, yoff += 64, uvoff += 32, lflvl++) {
+            memset(lflvl->mask, 0, sizeof(lflvl->mask));
+
+            ret = decode_subblock(td, row, col, lflvl, yoff, uvoff, BL_64X64);
+            if (ret < 0) {
+                atomic_store(&s->tile_error, ret);
+                ff_thread_report_progress2(avctx, tile_col, INT_MAX);
+                return ret;
+            }
+        }
+
+        // backup pre-loopfilter reconstruction data of this tile column
+        // for intra prediction of the next row of sb64s
+        if (row + 8 < s->rows) {
+            yoff  = (row >> 3) * f->linesize[0] * 64 + 63 * f->linesize[0];
+            uvoff = (row >> 3) * f->linesize[1] * 32 + 31 * f->linesize[1];
+            memcpy(s->intra_pred_data[0] + start * 8,
+                   f->data[0] + yoff + start * 8, (end - start) * 8);
+            memcpy(s->intra_pred_data[1] + start * 4,
+                   f->data[1] + uvoff + start * 4, (end - start) * 4);
+            memcpy(s->intra_pred_data[2] + start * 4,
+                   f->data[2] + uvoff + start * 4, (end - start) * 4);
+        }
+
+        ff_thread_report_progress2(avctx, tile_col, (row >> 3) + 1);
+    }
+
+    return 0;
+}
+
+/**
+ * Loopfilter the sb64 rows of the current tile row as soon as all the tile
+ * columns decoded them.
+ */
+static int loopfilter_tile_row(AVCodecContext *avctx)
+{
+    VP9Context *s = avctx->priv_data;
+    AVFrame *f = s->frames[CUR_FRAME].tf.f;
+    int row, col, tile_col;
+
+    for (row = s->tiling.tile_row_start;
+         row < s->tiling.tile_row_end; row += 8) {
+        VP9Filter *lflvl = s->lflvl + (row >> 3) * s->sb_cols;
+        ptrdiff_t yoff   = (row >> 3) * f->linesize[0] * 64;
+        ptrdiff_t uvoff  = (row >> 3) * f->linesize[1] * 32;
+
+        for (tile_col = 0; tile_col < s->tiling.tile_cols; tile_col++)
+            ff_thread_await_progress2(avctx, tile_col, (row >> 3) + 1);
+        if (atomic_load(&s->tile_error) < 0)
+            break;
+
+        if (s->filter.level) {
+            for (col = 0; col < s->cols;
+                 col += 8, yoff += 64, uvoff += 32, lflvl++)
+                loopfilter_subblock(avctx, lflvl, row, col, yoff, uvoff);
+        }
+    }
+
+    return 0;
+}
+
+static int decode_tiles_job(AVCodecContext *avctx, void *arg,
+                            int job, int thread)
+{
+    VP9Context *s = avctx->priv_data;
+
+    if (job == s->tiling.tile_cols)
+        return loopfilter_tile_row(avctx);
+    return decode_tile_col(avctx, job, thread);
+}
+
+/**
+ * Decode the tile columns of the current tile row in parallel, with one more
+ * job running the loopfilter row by row behind them.
+ */
+static int decode_tiles_slice_threaded(AVCodecContext *avctx)
+{
+    VP9Context *s = avctx->priv_data;
+    int nb_jobs = s->tiling.tile_cols + 1;
+    int i, j, ret;
+
+    av_fast_malloc(&s->tile_ctx, &s->tile_ctx_size,
+                   s->tiling.tile_cols * sizeof(*s->tile_ctx));
+    if (!s->tile_ctx)
+        return AVERROR(ENOMEM);
+
+    ret = ff_slice_thread_init_progress(avctx, nb_jobs);
+    if (ret < 0)
+        return ret;
+    atomic_store(&s->tile_error, 0);
+
+    avctx->execute2(avctx, decode_tiles_job, NULL, NULL, nb_jobs);
+
+    ret = atomic_load(&s->tile_error);
+    if (ret < 0)
+        return ret;
+
+    if (s->refreshctx && !s->parallelmode) {
+        for (i = 0; i < s->tiling.tile_cols; i++) {
+            unsigned *dst       = (unsigned *)&s->counts;
+            const unsigned *src = (const unsigned *)&s->tile_ctx[i].counts;
+
+            for (j = 0; j < sizeof(s->counts) / sizeof(*dst); j++)
+                dst[j] += src[j];
+        }
+    }
+
+    return 0;
+}
+
 static int update_refs(AVCodecContext *avctx)
 {
     VP9Context *s = avctx->priv_data;
@@ -1322,6 +1499,13 @@ static int vp9_decode_frame(AVCodecContext *avctx, void *output,
                 }
             }
 
+            if (avctx->active_thread_type & FF_THREAD_SLICE) {
+                ret = decode_tiles_slice_threaded(avctx);
+                if (ret < 0)
+                    goto fail;
+                continue;
+            }
+
             for (row = s->tiling.tile_row_start;
                  row < s->tiling.tile_row_end;
                  row += 8, yoff += f->linesize[0] * 64,
@@ -1334,15 +1518,7 @@ static int vp9_decode_frame(AVCodecContext *avctx, void *output,
                                     &s->tiling.tile_col_end,
                                     tile_col, s->tiling.log2_tile_cols, s->sb_cols);
 
-                    memset(s->left_partition_ctx, 0, 8);
-                    memset(s->left_skip_ctx, 0, 8);
-                    if (s->keyframe || s->intraonly)
-                        memset(s->left_mode_ctx, DC_PRED, 16);
-                    else
-                        memset(s->left_mode_ctx, NEARESTMV, 8);
-                    memset(s->left_y_nnz_ctx, 0, 16);
-                    memset(s->left_uv_nnz_ctx, 0, 16);
-                    memset(s->left_segpred_ctx, 0, 8);
+                    reset_left_ctx(s);
 
                     memcpy(&s->c, &s->c_b[tile_col], sizeof(s->c));
                     for (col = s->tiling.tile_col_start;
@@ -1354,10 +1530,10 @@ static int vp9_decode_frame(AVCodecContext *avctx, void *output,
                             memset(lflvl->mask, 0, sizeof(lflvl->mask));
 
                         if (s->pass == 2) {
-                            ret = decode_superblock_mem(avctx, row, col, lflvl,
+                            ret = decode_superblock_mem(s, row, col, lflvl,
                                                         yoff2, uvoff2, BL_64X64);
                         } else {
-                            ret = decode_subblock(avctx, row, col, lflvl,
+                            ret = decode_subblock(s, row, col, lflvl,
                                                   yoff2, uvoff2, BL_64X64);
                         }
                         if (ret < 0)
@@ -1451,6 +1627,7 @@ static av_cold int vp9_decode_free(AVCodecContext *avctx)
     }
 
     av_freep(&s->c_b);
+    av_freep(&s->tile_ctx);
     av_freep(&s->above_partition_ctx);
     av_freep(&s->b_base);
     av_freep(&s->block_base);
@@ -1465,6 +1642,8 @@ static av_cold int vp9_decode_init(AVCodecContext *avctx)
 
     memset(s, 0, sizeof(*s));
 
+    s->avctx = avctx;
+
     avctx->internal->allocate_progress = 1;
 
     avctx->pix_fmt = AV_PIX_FMT_YUV420P;
@@ -1544,7 +1723,8 @@ AVCodec ff_vp9_decoder = {
     .decode                = vp9_decode_frame,
     .flush                 = vp9_decode_flush,
     .close                 = vp9_decode_free,
-    .capabilities          = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS,
+    .capabilities          = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS |
+                             AV_CODEC_CAP_SLICE_THREADS,
     .init_thread_copy      = vp9_decode_init,
     .update_thread_context = vp9_decode_update_thread_context,
     .bsfs                  = "vp9_superframe_split",
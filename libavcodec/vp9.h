@@ -24,6 +24,7 @@
 #ifndef AVCODEC_VP9_H
 #define AVCODEC_VP9_H
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -276,6 +277,7 @@ typedef struct VP9Block {
 } VP9Block;
 
 typedef struct VP9Context {
+    AVCodecContext *avctx;
     VP9DSPContext dsp;
     VideoDSPContext vdsp;
     GetBitContext gb;
@@ -285,6 +287,11 @@ typedef struct VP9Context {
     VP9Block *b;
     VP9Block *b_base;
 
+    // slice threading: a copy of the context for each tile column
+    struct VP9Context *tile_ctx;
+    unsigned tile_ctx_size;
+    atomic_int tile_error;
+
     int alloc_width;
     int alloc_height;
 
@@ -443,7 +450,7 @@ void ff_vp9_fill_mv(VP9Context *s, VP56mv *mv, int mode, int sb);
 
 void ff_vp9_adapt_probs(VP9Context *s);
 
-int ff_vp9_decode_block(AVCodecContext *avctx, int row, int col,
+int ff_vp9_decode_block(VP9Context *s, int row, int col,
                         VP9Filter *lflvl, ptrdiff_t yoff, ptrdiff_t uvoff,
                         enum BlockLevel bl, enum BlockPartition bp);
 
@@ -827,9 +827,8 @@ skip_eob:
     return i;
 }
 
-static int decode_coeffs(AVCodecContext *avctx)
+static int decode_coeffs(VP9Context *s)
 {
-    VP9Context *s = avctx->priv_data;
     VP9Block *b = s->b;
     int row = b->row, col = b->col;
     uint8_t (*p)[6][11] = s->prob.coef[b->tx][0 /* y */][!b->intra];
@@ -1078,9 +1077,8 @@ static av_always_inline int check_intra_mode(VP9Context *s, int mode,
     return mode;
 }
 
-static void intra_recon(AVCodecContext *avctx, ptrdiff_t y_off, ptrdiff_t uv_off)
+static void intra_recon(VP9Context *s, ptrdiff_t y_off, ptrdiff_t uv_off)
 {
-    VP9Context *s = avctx->priv_data;
     VP9Block *b = s->b;
     AVFrame *f = s->frames[CUR_FRAME].tf.f;
     int row = b->row, col = b->col;
@@ -1249,13 +1247,12 @@ static av_always_inline void mc_chroma_dir(VP9Context *s, vp9_mc_func(*mc)[2],
     }
 }
 
-static int inter_recon(AVCodecContext *avctx)
+static int inter_recon(VP9Context *s)
 {
     static const uint8_t bwlog_tab[2][N_BS_SIZES] = {
         { 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4 },
         { 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 4, 4 },
     };
-    VP9Context *s = avctx->priv_data;
     VP9Block *b = s->b;
     int row = b->row, col = b->col;
 
@@ -1264,7 +1261,7 @@ static int inter_recon(AVCodecContext *avctx)
     AVFrame      *ref1 = tref1->f;
     AVFrame      *ref2 = tref2 ? tref2->f : NULL;
 
-    int w = avctx->width, h = avctx->height;
+    int w = s->avctx->width, h = s->avctx->height;
     ptrdiff_t ls_y = b->y_stride, ls_uv = b->uv_stride;
 
     if (!ref1->data[0] || (b->comp && !ref2->data[0]))
@@ -1579,11 +1576,10 @@ static av_always_inline void mask_edges(VP9Filter *lflvl, int is_uv,
     }
 }
 
-int ff_vp9_decode_block(AVCodecContext *avctx, int row, int col,
+int ff_vp9_decode_block(VP9Context *s, int row, int col,
                         VP9Filter *lflvl, ptrdiff_t yoff, ptrdiff_t uvoff,
                         enum BlockLevel bl, enum BlockPartition bp)
 {
-    VP9Context *s = avctx->priv_data;
     VP9Block *b = s->b;
     AVFrame *f = s->frames[CUR_FRAME].tf.f;
     enum BlockSize bs = bl * 3 + bp;
@@ -1608,7 +1604,7 @@ int ff_vp9_decode_block(AVCodecContext *avctx, int row, int col,
         b->uvtx = b->tx - (w4 * 2 == (1 << b->tx) || h4 * 2 == (1 << b->tx));
 
         if (!b->skip) {
-            if ((ret = decode_coeffs(avctx)) < 0)
+            if ((ret = decode_coeffs(s)) < 0)
                 return ret;
         } else {
             int pl;
@@ -1658,9 +1654,9 @@ int ff_vp9_decode_block(AVCodecContext *avctx, int row, int col,
         b->uv_stride = f->linesize[1];
     }
     if (b->intra) {
-        intra_recon(avctx, yoff, uvoff);
+        intra_recon(s, yoff, uvoff);
     } else {
-        if ((ret = inter_recon(avctx)) < 0)
+        if ((ret = inter_recon(s)) < 0)
             return ret;
     }
     if (emu[0]) {
@@ -1719,20 +1715,6 @@ int ff_vp9_decode_block(AVCodecContext *avctx, int row, int col,
                    s->cols & 1 && col + w4 >= s->cols ? s->cols & 7 : 0,
                    s->rows & 1 && row + h4 >= s->rows ? s->rows & 7 : 0,
                    b->uvtx, skip_inter);
-
-        if (!s->filter.lim_lut[lvl]) {
-            int sharp = s->filter.sharpness;
-            int limit = lvl;
-
-            if (sharp > 0) {
-                limit >>= (sharp + 3) >> 2;
-                limit   = FFMIN(limit, 9 - sharp);
-            }
-            limit = FFMAX(limit, 1);
-
-            s->filter.lim_lut[lvl]   = limit;
-            s->filter.mblim_lut[lvl] = 2 * (lvl + 2) + limit;
-        }
     }
 
     if (s->pass == 2) {
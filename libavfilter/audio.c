@@ -21,6 +21,7 @@
 
 #include "audio.h"
 #include "avfilter.h"
+#include "framepool.h"
 #include "internal.h"
 
 AVFrame *ff_null_get_audio_buffer(AVFilterLink *link, int nb_samples)
@@ -30,22 +31,15 @@ AVFrame *ff_null_get_audio_buffer(AVFilterLink *link, int nb_samples)
 
 AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
 {
-    AVFrame *frame = av_frame_alloc();
+    AVFrame *frame;
     int channels = av_get_channel_layout_nb_channels(link->channel_layout);
-    int ret;
 
+    frame = ff_frame_pool_get_audio(&link->frame_pool, link->format,
+                                    link->channel_layout, nb_samples);
     if (!frame)
         return NULL;
 
-    frame->nb_samples     = nb_samples;
-    frame->format         = link->format;
-    frame->channel_layout = link->channel_layout;
-    frame->sample_rate    = link->sample_rate;
-    ret = av_frame_get_buffer(frame, 0);
-    if (ret < 0) {
-        av_frame_free(&frame);
-        return NULL;
-    }
+    frame->sample_rate = link->sample_rate;
 
     av_samples_set_silence(frame->extended_data, 0, nb_samples, channels,
                            link->format);
@@ -35,6 +35,7 @@
 #include "audio.h"
 #include "avfilter.h"
 #include "formats.h"
+#include "framepool.h"
 #include "internal.h"
 #include "video.h"
 
@@ -169,6 +170,8 @@ int avfilter_config_links(AVFilterContext *filter)
             return 0;
         case AVLINK_UNINIT:
             link->init_state = AVLINK_STARTINIT;
+            /* the frame parameters may change */
+            ff_frame_pool_uninit(&link->frame_pool);
 
             if ((ret = avfilter_config_links(link->src)) < 0)
                 return ret;
@@ -494,6 +497,7 @@ static void free_link(AVFilterLink *link)
         link->dst->inputs[link->dstpad - link->dst->input_pads] = NULL;
 
     av_buffer_unref(&link->hw_frames_ctx);
+    ff_frame_pool_uninit(&link->frame_pool);
 
     ff_formats_unref(&link->in_formats);
     ff_formats_unref(&link->out_formats);
@@ -586,7 +590,7 @@ int avfilter_init_dict(AVFilterContext *ctx, AVDictionary **options)
         return ret;
     }
 
-    if (0 && ctx->filter->flags & AVFILTER_FLAG_SLICE_THREADS &&
+    if (ctx->graph && ctx->filter->flags & AVFILTER_FLAG_SLICE_THREADS &&
         ctx->thread_type & ctx->graph->thread_type & AVFILTER_THREAD_SLICE &&
         ctx->graph->internal->thread_execute) {
         ctx->thread_type       = AVFILTER_THREAD_SLICE;
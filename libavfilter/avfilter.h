@@ -405,6 +405,12 @@ struct AVFilterLink {
      * AVHWFramesContext describing the frames.
      */
     AVBufferRef *hw_frames_ctx;
+
+    /**
+     * Pool of the buffers of the frames allocated by the default
+     * get_video_buffer() / get_audio_buffer() on this link.
+     */
+    struct FFFramePool *frame_pool;
 };
 
 /**
@@ -656,6 +662,19 @@ typedef struct AVFilterGraph {
      * platform and build options.
      */
     avfilter_execute_func *execute;
+
+    /**
+     * A reference to an AVThreadPool (see libavutil/threadpool.h) to run the
+     * slice threading jobs of the filters in this graph on, instead of
+     * starting threads for the graph. The pool may be shared with other
+     * filter graphs, codec contexts and scalers.
+     *
+     * May be set by the caller before adding any filters to the graph. The
+     * reference is then owned (and freed) by libavfilter. nb_threads limits
+     * the number of jobs of one filter running at the same time; zero means
+     * as many as the pool has threads, plus the calling thread.
+     */
+    AVBufferRef *thread_pool;
 } AVFilterGraph;
 
 /**
@@ -0,0 +1,242 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "libavutil/avutil.h"
+#include "libavutil/buffer.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/common.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/samplefmt.h"
+
+#include "framepool.h"
+
+struct FFFramePool {
+    enum AVMediaType type;
+
+    /**
+     * Pools for each data plane. For audio all the planes have the same
+     * size, so only pools[0] is used.
+     */
+    AVBufferPool *pools[4];
+
+    /* pool parameters */
+    int format;
+    int width, height;
+    int align;
+    int linesize[4];
+    int channels;
+    int buf_size;           ///< size of the audio buffers
+};
+
+static void pool_reset(FFFramePool *pool)
+{
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(pool->pools); i++)
+        av_buffer_pool_uninit(&pool->pools[i]);
+    pool->type = AVMEDIA_TYPE_UNKNOWN;
+}
+
+static FFFramePool *pool_get(FFFramePool **ppool)
+{
+    if (!*ppool) {
+        *ppool = av_mallocz(sizeof(**ppool));
+        if (*ppool)
+            (*ppool)->type = AVMEDIA_TYPE_UNKNOWN;
+    }
+    return *ppool;
+}
+
+static int update_video_pool(FFFramePool *pool, int format,
+                             int width, int height, int align)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int i, ret;
+
+    if (pool->type == AVMEDIA_TYPE_VIDEO && pool->format == format &&
+        pool->width == width && pool->height == height && pool->align == align)
+        return 0;
+
+    pool_reset(pool);
+
+    if (!desc)
+        return AVERROR(EINVAL);
+    if ((ret = av_image_check_size(width, height, 0, NULL)) < 0)
+        return ret;
+
+    memset(pool->linesize, 0, sizeof(pool->linesize));
+    ret = av_image_fill_linesizes(pool->linesize, format, width);
+    if (ret < 0)
+        return ret;
+
+    /* same layout as av_frame_get_buffer() */
+    for (i = 0; i < 4 && pool->linesize[i]; i++) {
+        int h = height;
+        if (i == 1 || i == 2)
+            h = AV_CEIL_RSHIFT(h, desc->log2_chroma_h);
+
+        pool->linesize[i] = FFALIGN(pool->linesize[i], align);
+        pool->pools[i]    = av_buffer_pool_init(pool->linesize[i] * h, NULL);
+        if (!pool->pools[i])
+            goto fail;
+    }
+    if (desc->flags & AV_PIX_FMT_FLAG_PAL || desc->flags & AV_PIX_FMT_FLAG_PSEUDOPAL) {
+        av_buffer_pool_uninit(&pool->pools[1]);
+        pool->pools[1] = av_buffer_pool_init(1024, NULL);
+        if (!pool->pools[1])
+            goto fail;
+    }
+
+    pool->type   = AVMEDIA_TYPE_VIDEO;
+    pool->format = format;
+    pool->width  = width;
+    pool->height = height;
+    pool->align  = align;
+
+    return 0;
+fail:
+    pool_reset(pool);
+    return AVERROR(ENOMEM);
+}
+
+AVFrame *ff_frame_pool_get_video(FFFramePool **ppool, int format,
+                                 int width, int height, int align)
+{
+    FFFramePool *pool = pool_get(ppool);
+    AVFrame *frame;
+    int i;
+
+    if (!pool || update_video_pool(pool, format, width, height, align) < 0)
+        return NULL;
+
+    frame = av_frame_alloc();
+    if (!frame)
+        return NULL;
+
+    frame->format = format;
+    frame->width  = width;
+    frame->height = height;
+
+    for (i = 0; i < 4 && pool->pools[i]; i++) {
+        frame->linesize[i] = pool->linesize[i];
+
+        frame->buf[i] = av_buffer_pool_get(pool->pools[i]);
+        if (!frame->buf[i]) {
+            av_frame_free(&frame);
+            return NULL;
+        }
+        frame->data[i] = frame->buf[i]->data;
+    }
+    frame->extended_data = frame->data;
+
+    return frame;
+}
+
+static int update_audio_pool(FFFramePool *pool, int format, int channels,
+                             int size)
+{
+    if (pool->type == AVMEDIA_TYPE_AUDIO && pool->format == format &&
+        pool->channels == channels && pool->buf_size >= size)
+        return 0;
+
+    pool_reset(pool);
+
+    pool->pools[0] = av_buffer_pool_init(size, NULL);
+    if (!pool->pools[0])
+        return AVERROR(ENOMEM);
+
+    pool->type     = AVMEDIA_TYPE_AUDIO;
+    pool->format   = format;
+    pool->channels = channels;
+    pool->buf_size = size;
+
+    return 0;
+}
+
+AVFrame *ff_frame_pool_get_audio(FFFramePool **ppool, int format,
+                                 uint64_t channel_layout, int nb_samples)
+{
+    FFFramePool *pool = pool_get(ppool);
+    int channels = av_get_channel_layout_nb_channels(channel_layout);
+    int planes   = av_sample_fmt_is_planar(format) ? channels : 1;
+    AVFrame *frame;
+    int linesize, i;
+
+    if (!pool)
+        return NULL;
+    if (av_samples_get_buffer_size(&linesize, channels, nb_samples,
+                                   format, 0) < 0)
+        return NULL;
+    if (update_audio_pool(pool, format, channels, linesize) < 0)
+        return NULL;
+
+    frame = av_frame_alloc();
+    if (!frame)
+        return NULL;
+
+    frame->format         = format;
+    frame->channel_layout = channel_layout;
+    frame->nb_samples     = nb_samples;
+    frame->linesize[0]    = linesize;
+
+    if (planes > AV_NUM_DATA_POINTERS) {
+        frame->extended_data = av_mallocz(planes *
+                                          sizeof(*frame->extended_data));
+        frame->extended_buf  = av_mallocz((planes - AV_NUM_DATA_POINTERS) *
+                                          sizeof(*frame->extended_buf));
+        if (!frame->extended_data || !frame->extended_buf) {
+            av_freep(&frame->extended_data);
+            av_freep(&frame->extended_buf);
+            av_frame_free(&frame);
+            return NULL;
+        }
+        frame->nb_extended_buf = planes - AV_NUM_DATA_POINTERS;
+    } else
+        frame->extended_data = frame->data;
+
+    for (i = 0; i < FFMIN(planes, AV_NUM_DATA_POINTERS); i++) {
+        frame->buf[i] = av_buffer_pool_get(pool->pools[0]);
+        if (!frame->buf[i])
+            goto fail;
+        frame->extended_data[i] = frame->data[i] = frame->buf[i]->data;
+    }
+    for (i = 0; i < frame->nb_extended_buf; i++) {
+        frame->extended_buf[i] = av_buffer_pool_get(pool->pools[0]);
+        if (!frame->extended_buf[i])
+            goto fail;
+        frame->extended_data[i + AV_NUM_DATA_POINTERS] = frame->extended_buf[i]->data;
+    }
+
+    return frame;
+fail:
+    av_frame_free(&frame);
+    return NULL;
+}
+
+void ff_frame_pool_uninit(FFFramePool **ppool)
+{
+    if (!*ppool)
+        return;
+
+    pool_reset(*ppool);
+    av_freep(ppool);
+}
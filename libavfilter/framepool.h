@@ -0,0 +1,67 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_FRAMEPOOL_H
+#define AVFILTER_FRAMEPOOL_H
+
+#include <stdint.h>
+
+#include "libavutil/frame.h"
+
+/**
+ * Pools of buffers backing the frames allocated on a link.
+ *
+ * The pools are created for the parameters of the first frame requested and
+ * recreated whenever different parameters are requested, so that filtering a
+ * stream with constant parameters does not allocate any memory once enough
+ * frames are in flight.
+ */
+typedef struct FFFramePool FFFramePool;
+
+/**
+ * Get a video frame with buffers of the given parameters from the pool,
+ * laid out as av_frame_get_buffer() would do.
+ *
+ * @param pool  pointer to the pool, allocated if NULL and recreated if its
+ *              parameters do not match
+ * @param align linesize alignment, as in av_frame_get_buffer()
+ * @return a new frame or NULL on failure
+ */
+AVFrame *ff_frame_pool_get_video(FFFramePool **pool, int format,
+                                 int width, int height, int align);
+
+/**
+ * Get an audio frame with buffers of the given parameters from the pool.
+ * The buffers are kept as large as the largest frame requested since the
+ * pool was created, so that a varying number of samples does not recreate
+ * it.
+ *
+ * @param pool  pointer to the pool, allocated if NULL and recreated if its
+ *              parameters do not match
+ * @return a new frame or NULL on failure
+ */
+AVFrame *ff_frame_pool_get_audio(FFFramePool **pool, int format,
+                                 uint64_t channel_layout, int nb_samples);
+
+/**
+ * Free a pool and set the pointer to NULL. The frames obtained from it
+ * remain valid.
+ */
+void ff_frame_pool_uninit(FFFramePool **pool);
+
+#endif /* AVFILTER_FRAMEPOOL_H */
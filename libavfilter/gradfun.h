@@ -33,7 +33,9 @@ typedef struct GradFunContext {
     int chroma_w;  ///< width of the chroma planes
     int chroma_h;  ///< weight of the chroma planes
     int chroma_r;  ///< blur radius for the chroma planes
-    uint16_t *buf; ///< holds image data for blur algorithm passed into filter.
+    uint16_t *buf; ///< holds image data for blur algorithm passed into filter, one block per thread.
+    int buf_size;  ///< size of the block of each thread in buf
+    int nb_threads;
     /// DSP functions.
     void (*filter_line) (uint8_t *dst, uint8_t *src, uint16_t *dc, int width, int thresh, const uint16_t *dithers);
     void (*blur_line) (uint16_t *dc, uint16_t *buf, uint16_t *buf1, uint8_t *src, int src_linesize, int width);
@@ -23,9 +23,11 @@
 
 #include "config.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/common.h"
 #include "libavutil/cpu.h"
 #include "libavutil/mem.h"
+#include "libavutil/threadpool.h"
 
 #include "avfilter.h"
 #include "internal.h"
@@ -39,6 +41,7 @@
 
 typedef struct ThreadContext {
     AVFilterGraph *graph;
+    AVBufferRef *pool;      ///< shared thread pool used instead of the own workers
 
     int nb_threads;
     pthread_t *workers;
@@ -47,8 +50,7 @@ typedef struct ThreadContext {
     /* per-execute parameters */
     AVFilterContext *ctx;
     void *arg;
-    int   *rets;
-    int nb_rets;
+    int   *rets;        ///< may be NULL, then the return values are dropped
     int nb_jobs;
 
     pthread_cond_t last_job_cond;
@@ -65,7 +67,7 @@ static void* attribute_align_arg worker(void *v)
     int our_job      = c->nb_jobs;
     int nb_threads   = c->nb_threads;
     unsigned int last_execute = 0;
-    int self_id;
+    int self_id, ret;
 
     pthread_mutex_lock(&c->current_job_lock);
     self_id = c->current_job++;
@@ -86,7 +88,9 @@ static void* attribute_align_arg worker(void *v)
         }
         pthread_mutex_unlock(&c->current_job_lock);
 
-        c->rets[our_job % c->nb_rets] = c->func(c->ctx, c->arg, our_job, c->nb_jobs);
+        ret = c->func(c->ctx, c->arg, our_job, c->nb_jobs);
+        if (c->rets)
+            c->rets[our_job] = ret;
 
         pthread_mutex_lock(&c->current_job_lock);
         our_job = c->current_job++;
@@ -122,7 +126,6 @@ static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
                           void *arg, int *ret, int nb_jobs)
 {
     ThreadContext *c = ctx->graph->internal->thread;
-    int dummy_ret;
 
     if (nb_jobs <= 0)
         return 0;
@@ -134,13 +137,7 @@ static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
     c->ctx         = ctx;
     c->arg         = arg;
     c->func        = func;
-    if (ret) {
-        c->rets    = ret;
-        c->nb_rets = nb_jobs;
-    } else {
-        c->rets    = &dummy_ret;
-        c->nb_rets = 1;
-    }
+    c->rets        = ret;
     c->current_execute++;
 
     pthread_cond_broadcast(&c->current_job_cond);
@@ -150,6 +147,47 @@ static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
     return 0;
 }
 
+typedef struct PoolExecuteContext {
+    AVFilterContext      *ctx;
+    avfilter_action_func *func;
+    void                 *arg;
+    int                   nb_jobs;
+} PoolExecuteContext;
+
+static int pool_job(void *arg, int jobnr, int threadnr)
+{
+    PoolExecuteContext *e = arg;
+
+    return e->func(e->ctx, e->arg, jobnr, e->nb_jobs);
+}
+
+static int pool_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                        void *arg, int *ret, int nb_jobs)
+{
+    ThreadContext *c     = ctx->graph->internal->thread;
+    PoolExecuteContext e = { ctx, func, arg, nb_jobs };
+
+    return av_thread_pool_execute(c->pool, pool_job, &e, ret, nb_jobs,
+                                  c->nb_threads);
+}
+
+static int pool_init_internal(ThreadContext *c, AVBufferRef *pool,
+                              int nb_threads)
+{
+    if (!nb_threads)
+        nb_threads = av_thread_pool_nb_threads(pool) + 1;
+
+    if (nb_threads <= 1)
+        return 1;
+
+    c->pool = av_buffer_ref(pool);
+    if (!c->pool)
+        return AVERROR(ENOMEM);
+    c->nb_threads = nb_threads;
+
+    return nb_threads;
+}
+
 static int thread_init_internal(ThreadContext *c, int nb_threads)
 {
     int i, ret;
@@ -213,7 +251,11 @@ int ff_graph_thread_init(AVFilterGraph *graph)
     if (!graph->internal->thread)
         return AVERROR(ENOMEM);
 
-    ret = thread_init_internal(graph->internal->thread, graph->nb_threads);
+    if (graph->thread_pool)
+        ret = pool_init_internal(graph->internal->thread, graph->thread_pool,
+                                 graph->nb_threads);
+    else
+        ret = thread_init_internal(graph->internal->thread, graph->nb_threads);
     if (ret <= 1) {
         av_freep(&graph->internal->thread);
         graph->thread_type = 0;
@@ -222,14 +264,19 @@ int ff_graph_thread_init(AVFilterGraph *graph)
     }
     graph->nb_threads = ret;
 
-    graph->internal->thread_execute = thread_execute;
+    graph->internal->thread_execute = graph->thread_pool ? pool_execute :
+                                                           thread_execute;
 
     return 0;
 }
 
 void ff_graph_thread_free(AVFilterGraph *graph)
 {
-    if (graph->internal->thread)
-        slice_thread_uninit(graph->internal->thread);
+    ThreadContext *c = graph->internal->thread;
+
+    if (c && c->pool)
+        av_buffer_unref(&c->pool);
+    else if (c)
+        slice_thread_uninit(c);
     av_freep(&graph->internal->thread);
 }
@@ -72,9 +72,16 @@ typedef struct BoxBlurContext {
     int hsub, vsub;
     int radius[4];
     int power[4];
-    uint8_t *temp[2]; ///< temporary buffer used in blur_power()
+    uint8_t *temp;    ///< temporary buffers used in blur_power(), two per thread
+    int temp_size;    ///< size of one temporary buffer
+    int nb_threads;
 } BoxBlurContext;
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int w[4], h[4];
+} ThreadData;
+
 #define Y 0
 #define U 1
 #define V 2
@@ -109,8 +116,7 @@ static av_cold void uninit(AVFilterContext *ctx)
 {
     BoxBlurContext *s = ctx->priv;
 
-    av_freep(&s->temp[0]);
-    av_freep(&s->temp[1]);
+    av_freep(&s->temp);
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -139,14 +145,11 @@ static int config_input(AVFilterLink *inlink)
     char *expr;
     int ret;
 
-    av_freep(&s->temp[0]);
-    av_freep(&s->temp[1]);
-    if (!(s->temp[0] = av_malloc(FFMAX(w, h))))
+    s->nb_threads = ctx->graph->nb_threads;
+    s->temp_size  = FFMAX(w, h);
+    av_freep(&s->temp);
+    if (!(s->temp = av_malloc_array(s->nb_threads * 2, s->temp_size)))
        return AVERROR(ENOMEM);
-    if (!(s->temp[1] = av_malloc(FFMAX(w, h)))) {
-        av_freep(&s->temp[0]);
-        return AVERROR(ENOMEM);
-    }
 
     s->hsub = desc->log2_chroma_w;
     s->vsub = desc->log2_chroma_h;
@@ -273,41 +276,83 @@ static inline void blur_power(uint8_t *dst, int dst_step, const uint8_t *src, in
 }
 
 static void hblur(uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
-                  int w, int h, int radius, int power, uint8_t *temp[2])
+                  int w, int y0, int y1, int radius, int power, uint8_t *temp[2])
 {
     int y;
 
     if (radius == 0 && dst == src)
         return;
 
-    for (y = 0; y < h; y++)
+    for (y = y0; y < y1; y++)
         blur_power(dst + y*dst_linesize, 1, src + y*src_linesize, 1,
                    w, radius, power, temp);
 }
 
 static void vblur(uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
-                  int w, int h, int radius, int power, uint8_t *temp[2])
+                  int x0, int x1, int h, int radius, int power, uint8_t *temp[2])
 {
     int x;
 
     if (radius == 0 && dst == src)
         return;
 
-    for (x = 0; x < w; x++)
+    for (x = x0; x < x1; x++)
         blur_power(dst + x, dst_linesize, src + x, src_linesize,
                    h, radius, power, temp);
 }
 
+/* The horizontal pass is split in bands of rows and the vertical pass, which
+ * needs whole columns, in bands of columns, so that neither needs any
+ * overlap between the bands. */
+static int hblur_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    BoxBlurContext *s = ctx->priv;
+    ThreadData    *td = arg;
+    uint8_t *temp[2]  = { s->temp + 2 * jobnr * s->temp_size,
+                          s->temp + (2 * jobnr + 1) * s->temp_size };
+    int plane;
+
+    for (plane = 0; td->in->data[plane] && plane < 4; plane++)
+        hblur(td->out->data[plane], td->out->linesize[plane],
+              td->in ->data[plane], td->in ->linesize[plane],
+              td->w[plane],
+              (td->h[plane] *  jobnr     ) / nb_jobs,
+              (td->h[plane] * (jobnr + 1)) / nb_jobs,
+              s->radius[plane], s->power[plane], temp);
+
+    return 0;
+}
+
+static int vblur_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    BoxBlurContext *s = ctx->priv;
+    ThreadData    *td = arg;
+    uint8_t *temp[2]  = { s->temp + 2 * jobnr * s->temp_size,
+                          s->temp + (2 * jobnr + 1) * s->temp_size };
+    int plane;
+
+    for (plane = 0; td->in->data[plane] && plane < 4; plane++)
+        vblur(td->out->data[plane], td->out->linesize[plane],
+              td->out->data[plane], td->out->linesize[plane],
+              (td->w[plane] *  jobnr     ) / nb_jobs,
+              (td->w[plane] * (jobnr + 1)) / nb_jobs,
+              td->h[plane], s->radius[plane], s->power[plane], temp);
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
     BoxBlurContext *s = ctx->priv;
     AVFilterLink *outlink = inlink->dst->outputs[0];
     AVFrame *out;
-    int plane;
     int cw = inlink->w >> s->hsub, ch = in->height >> s->vsub;
-    int w[4] = { inlink->w, cw, cw, inlink->w };
-    int h[4] = { in->height, ch, ch, in->height };
+    ThreadData td = {
+        .in = in,
+        .w  = { inlink->w, cw, cw, inlink->w },
+        .h  = { in->height, ch, ch, in->height },
+    };
 
     out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
     if (!out) {
@@ -316,17 +361,11 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     }
     av_frame_copy_props(out, in);
 
-    for (plane = 0; in->data[plane] && plane < 4; plane++)
-        hblur(out->data[plane], out->linesize[plane],
-              in ->data[plane], in ->linesize[plane],
-              w[plane], h[plane], s->radius[plane], s->power[plane],
-              s->temp);
-
-    for (plane = 0; in->data[plane] && plane < 4; plane++)
-        vblur(out->data[plane], out->linesize[plane],
-              out->data[plane], out->linesize[plane],
-              w[plane], h[plane], s->radius[plane], s->power[plane],
-              s->temp);
+    td.out = out;
+    ctx->internal->execute(ctx, hblur_slice, &td, NULL,
+                           FFMIN(in->height, s->nb_threads));
+    ctx->internal->execute(ctx, vblur_slice, &td, NULL,
+                           FFMIN(inlink->w, s->nb_threads));
 
     av_frame_free(&in);
 
@@ -384,4 +423,5 @@ AVFilter ff_vf_boxblur = {
 
     .inputs    = avfilter_vf_boxblur_inputs,
     .outputs   = avfilter_vf_boxblur_outputs,
+    .flags     = AVFILTER_FLAG_SLICE_THREADS,
 };
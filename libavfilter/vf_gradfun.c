@@ -79,20 +79,38 @@ void ff_gradfun_blur_line_c(uint16_t *dc, uint16_t *buf, uint16_t *buf1, uint8_t
     }
 }
 
-static void filter(GradFunContext *ctx, uint8_t *dst, uint8_t *src, int width, int height, int dst_linesize, int src_linesize, int r)
+typedef struct ThreadData {
+    AVFrame *in, *out;
+} ThreadData;
+
+/**
+ * Filter the rows slice_start..slice_end-1 of a plane, slice_start being
+ * even. The rows of the frame are filtered in pairs with the blur of the
+ * 2 * r rows around them, the first and last pairs using the blur of the
+ * closest pair it is computed for. The running sums are primed with the r
+ * block rows preceding the first pair of the slice, so that the output does
+ * not depend on the slicing.
+ */
+static void filter(GradFunContext *ctx, uint8_t *dst, uint8_t *src, int width, int height,
+                   int dst_linesize, int src_linesize, int r,
+                   int slice_start, int slice_end, uint16_t *tmp)
 {
     int bstride = FFALIGN(width, 16) / 2;
-    int y;
+    int y_last  = r + ((height - 2 * r - 1) & ~1);
+    int y0      = av_clip(slice_start, r, y_last);
+    int y, i;
     uint32_t dc_factor = (1 << 21) / (r * r);
-    uint16_t *dc = ctx->buf + 16;
-    uint16_t *buf = ctx->buf + bstride + 32;
+    uint16_t *dc = tmp + 16;
+    uint16_t *buf = tmp + bstride + 32;
     int thresh = ctx->thresh;
 
     memset(dc, 0, (bstride + 16) * sizeof(*buf));
-    for (y = 0; y < r; y++)
-        ctx->blur_line(dc, buf + y * bstride, buf + (y - 1) * bstride, src + 2 * y * src_linesize, src_linesize, width / 2);
-    for (;;) {
-        if (y < height - r) {
+    for (i = (y0 + r) / 2 - r; i < (y0 + r) / 2; i++)
+        ctx->blur_line(dc, buf + (i % r) * bstride,
+                       i == (y0 + r) / 2 - r ? buf - bstride : buf + ((i + r - 1) % r) * bstride,
+                       src + 2 * i * src_linesize, src_linesize, width / 2);
+    for (y = y0; ; y += 2) {
+        if (y <= y_last) {
             int mod = ((y + r) / 2) % r;
             uint16_t *buf0 = buf + mod * bstride;
             uint16_t *buf1 = buf + (mod ? mod - 1 : r - 1) * bstride;
@@ -109,18 +127,53 @@ static void filter(GradFunContext *ctx, uint8_t *dst, uint8_t *src, int width, i
             for (x = -r / 2; x < 0; x++)
                 dc[x] = dc[0];
         }
-        if (y == r) {
-            for (y = 0; y < r; y++)
-                ctx->filter_line(dst + y * dst_linesize, src + y * src_linesize, dc - r / 2, width, thresh, dither[y & 7]);
+        if (y == y0) {
+            for (i = slice_start; i < FFMIN(y0, slice_end); i++)
+                ctx->filter_line(dst + i * dst_linesize, src + i * src_linesize, dc - r / 2, width, thresh, dither[i & 7]);
         }
-        ctx->filter_line(dst + y * dst_linesize, src + y * src_linesize, dc - r / 2, width, thresh, dither[y & 7]);
-        if (++y >= height) break;
-        ctx->filter_line(dst + y * dst_linesize, src + y * src_linesize, dc - r / 2, width, thresh, dither[y & 7]);
-        if (++y >= height) break;
+        for (i = FFMAX(y, slice_start); i < FFMIN(y + 2, slice_end); i++)
+            ctx->filter_line(dst + i * dst_linesize, src + i * src_linesize, dc - r / 2, width, thresh, dither[i & 7]);
+        if (y + 2 >= slice_end)
+            break;
     }
     emms_c();
 }
 
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    GradFunContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in, *out = td->out;
+    int p;
+
+    for (p = 0; p < 4 && in->data[p]; p++) {
+        int w = ctx->inputs[0]->w;
+        int h = ctx->inputs[0]->h;
+        int r = s->radius;
+        int slice_start, slice_end;
+        if (p) {
+            w = s->chroma_w;
+            h = s->chroma_h;
+            r = s->chroma_r;
+        }
+        /* the rows are filtered in pairs */
+        slice_start = ((h *  jobnr     ) / nb_jobs) & ~1;
+        slice_end   = jobnr == nb_jobs - 1 ? h : ((h * (jobnr + 1)) / nb_jobs) & ~1;
+        if (slice_start == slice_end)
+            continue;
+
+        if (FFMIN(w, h) > 2 * r)
+            filter(s, out->data[p], in->data[p], w, h, out->linesize[p], in->linesize[p], r,
+                   slice_start, slice_end, s->buf + jobnr * s->buf_size);
+        else if (out->data[p] != in->data[p])
+            av_image_copy_plane(out->data[p] + slice_start * out->linesize[p], out->linesize[p],
+                                in->data[p]  + slice_start * in->linesize[p],  in->linesize[p],
+                                w, slice_end - slice_start);
+    }
+
+    return 0;
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     GradFunContext *s = ctx->priv;
@@ -167,8 +220,10 @@ static int config_input(AVFilterLink *inlink)
     int hsub = desc->log2_chroma_w;
     int vsub = desc->log2_chroma_h;
 
+    s->nb_threads = inlink->dst->graph->nb_threads;
+    s->buf_size   = FFALIGN(inlink->w, 16) * (s->radius + 1) / 2 + 32;
     av_freep(&s->buf);
-    s->buf = av_mallocz((FFALIGN(inlink->w, 16) * (s->radius + 1) / 2 + 32) * sizeof(uint16_t));
+    s->buf = av_mallocz_array(s->nb_threads, s->buf_size * sizeof(uint16_t));
     if (!s->buf)
         return AVERROR(ENOMEM);
 
@@ -181,12 +236,17 @@ static int config_input(AVFilterLink *inlink)
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
-    GradFunContext *s = inlink->dst->priv;
-    AVFilterLink *outlink = inlink->dst->outputs[0];
+    AVFilterContext *ctx = inlink->dst;
+    GradFunContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    ThreadData td;
     AVFrame *out;
-    int p, direct;
+    int nb_jobs = FFMIN((inlink->h + 1) / 2, s->nb_threads);
+    int direct;
 
-    if (av_frame_is_writable(in)) {
+    /* the blur of a slice reads rows of the neighbouring slices, so the
+     * filtering can only be done in place with a single slice */
+    if (nb_jobs == 1 && av_frame_is_writable(in)) {
         direct = 1;
         out = in;
     } else {
@@ -202,21 +262,9 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         out->height = outlink->h;
     }
 
-    for (p = 0; p < 4 && in->data[p]; p++) {
-        int w = inlink->w;
-        int h = inlink->h;
-        int r = s->radius;
-        if (p) {
-            w = s->chroma_w;
-            h = s->chroma_h;
-            r = s->chroma_r;
-        }
-
-        if (FFMIN(w, h) > 2 * r)
-            filter(s, out->data[p], in->data[p], w, h, out->linesize[p], in->linesize[p], r);
-        else if (out->data[p] != in->data[p])
-            av_image_copy_plane(out->data[p], out->linesize[p], in->data[p], in->linesize[p], w, h);
-    }
+    td.in  = in;
+    td.out = out;
+    ctx->internal->execute(ctx, filter_slice, &td, NULL, nb_jobs);
 
     if (!direct)
         av_frame_free(&in);
@@ -268,4 +316,5 @@ AVFilter ff_vf_gradfun = {
 
     .inputs    = avfilter_vf_gradfun_inputs,
     .outputs   = avfilter_vf_gradfun_outputs,
+    .flags     = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -237,11 +237,33 @@ static int config_props(AVFilterLink *outlink)
         inlink->format == outlink->format)
         scale->sws = NULL;
     else {
-        scale->sws = sws_getContext(inlink ->w, inlink ->h, inlink ->format,
-                                    outlink->w, outlink->h, outlink->format,
-                                    scale->flags, NULL, NULL, scale->param);
+        scale->sws = sws_alloc_context();
         if (!scale->sws)
+            return AVERROR(ENOMEM);
+
+        av_opt_set_int(scale->sws, "srcw",       inlink ->w,      0);
+        av_opt_set_int(scale->sws, "srch",       inlink ->h,      0);
+        av_opt_set_int(scale->sws, "src_format", inlink ->format, 0);
+        av_opt_set_int(scale->sws, "dstw",       outlink->w,      0);
+        av_opt_set_int(scale->sws, "dsth",       outlink->h,      0);
+        av_opt_set_int(scale->sws, "dst_format", outlink->format, 0);
+        av_opt_set_int(scale->sws, "sws_flags",  scale->flags,    0);
+        av_opt_set_double(scale->sws, "param0",  scale->param[0], 0);
+        av_opt_set_double(scale->sws, "param1",  scale->param[1], 0);
+        av_opt_set_int(scale->sws, "threads",    ctx->graph->nb_threads, 0);
+        if (ctx->graph->thread_pool &&
+            (ret = sws_set_thread_pool(scale->sws, ctx->graph->thread_pool)) < 0) {
+            sws_freeContext(scale->sws);
+            scale->sws = NULL;
+            return ret;
+        }
+
+        ret = sws_init_context(scale->sws, NULL, NULL);
+        if (ret < 0) {
+            sws_freeContext(scale->sws);
+            scale->sws = NULL;
             return AVERROR(EINVAL);
+        }
     }
 
 
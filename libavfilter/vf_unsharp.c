@@ -56,7 +56,8 @@ typedef struct FilterParam {
     int steps_y;                             ///< vertical step count
     int scalebits;                           ///< bits to shift pixel
     int32_t halfscale;                       ///< amount to add to pixel
-    uint32_t *sc[(MAX_SIZE * MAX_SIZE) - 1]; ///< finite state machine storage
+    uint32_t *sc;                            ///< finite state machine storage, one set of rows per thread
+    int sc_stride;                           ///< size of one row of sc
 } FilterParam;
 
 typedef struct UnsharpContext {
@@ -66,34 +67,43 @@ typedef struct UnsharpContext {
     FilterParam luma;   ///< luma parameters (width, height, amount)
     FilterParam chroma; ///< chroma parameters (width, height, amount)
     int hsub, vsub;
+    int nb_threads;     ///< number of sets of rows allocated in FilterParam.sc
 } UnsharpContext;
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+} ThreadData;
+
+/**
+ * Filter the rows slice_start..slice_end-1 of a plane. The vertical finite
+ * state machine is restarted for each slice and primed with the steps_y
+ * rows above the slice, so that the output does not depend on the slicing.
+ */
 static void apply_unsharp(      uint8_t *dst, int dst_stride,
                           const uint8_t *src, int src_stride,
-                          int width, int height, FilterParam *fp)
+                          int width, int height, int slice_start, int slice_end,
+                          FilterParam *fp, uint32_t *sc_buf)
 {
-    uint32_t **sc = fp->sc;
-    uint32_t sr[(MAX_SIZE * MAX_SIZE) - 1], tmp1, tmp2;
+    uint32_t *sc[MAX_SIZE - 1];
+    uint32_t sr[MAX_SIZE - 1], tmp1, tmp2;
 
     int32_t res;
     int x, y, z;
     const uint8_t *src2;
 
     if (!fp->amount) {
-        if (dst_stride == src_stride)
-            memcpy(dst, src, src_stride * height);
-        else
-            for (y = 0; y < height; y++, dst += dst_stride, src += src_stride)
-                memcpy(dst, src, width);
+        for (y = slice_start; y < slice_end; y++)
+            memcpy(dst + y * dst_stride, src + y * src_stride, width);
         return;
     }
 
-    for (y = 0; y < 2 * fp->steps_y; y++)
+    for (y = 0; y < 2 * fp->steps_y; y++) {
+        sc[y] = sc_buf + y * fp->sc_stride;
         memset(sc[y], 0, sizeof(sc[y][0]) * (width + 2 * fp->steps_x));
+    }
 
-    for (y = -fp->steps_y; y < height + fp->steps_y; y++) {
-        if (y < height)
-            src2 = src;
+    for (y = slice_start - fp->steps_y; y < slice_end + fp->steps_y; y++) {
+        src2 = src + av_clip(y, 0, height - 1) * src_stride;
 
         memset(sr, 0, sizeof(sr[0]) * (2 * fp->steps_x - 1));
         for (x = -fp->steps_x; x < width + fp->steps_x; x++) {
@@ -106,21 +116,45 @@ static void apply_unsharp(      uint8_t *dst, int dst_stride,
                 tmp2 = sc[z + 0][x + fp->steps_x] + tmp1; sc[z + 0][x + fp->steps_x] = tmp1;
                 tmp1 = sc[z + 1][x + fp->steps_x] + tmp2; sc[z + 1][x + fp->steps_x] = tmp2;
             }
-            if (x >= fp->steps_x && y >= fp->steps_y) {
-                const uint8_t *srx = src - fp->steps_y * src_stride + x - fp->steps_x;
-                uint8_t *dsx       = dst - fp->steps_y * dst_stride + x - fp->steps_x;
+            if (x >= fp->steps_x && y >= slice_start + fp->steps_y) {
+                const uint8_t *srx = src + (y - fp->steps_y) * src_stride + x - fp->steps_x;
+                uint8_t *dsx       = dst + (y - fp->steps_y) * dst_stride + x - fp->steps_x;
 
                 res = (int32_t)*srx + ((((int32_t) * srx - (int32_t)((tmp1 + fp->halfscale) >> fp->scalebits)) * fp->amount) >> 16);
                 *dsx = av_clip_uint8(res);
             }
         }
-        if (y >= 0) {
-            dst += dst_stride;
-            src += src_stride;
-        }
     }
 }
 
+static int unsharp_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    UnsharpContext *unsharp = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in, *out = td->out;
+    int w  = ctx->inputs[0]->w, h = ctx->inputs[0]->h;
+    int cw = AV_CEIL_RSHIFT(w, unsharp->hsub);
+    int ch = AV_CEIL_RSHIFT(h, unsharp->vsub);
+    int slice_start  = (h  *  jobnr     ) / nb_jobs;
+    int slice_end    = (h  * (jobnr + 1)) / nb_jobs;
+    int cslice_start = (ch *  jobnr     ) / nb_jobs;
+    int cslice_end   = (ch * (jobnr + 1)) / nb_jobs;
+    FilterParam *luma = &unsharp->luma, *chroma = &unsharp->chroma;
+    uint32_t *lsc = luma->sc   + jobnr * 2 * luma->steps_y   * luma->sc_stride;
+    uint32_t *csc = chroma->sc + jobnr * 2 * chroma->steps_y * chroma->sc_stride;
+
+    apply_unsharp(out->data[0], out->linesize[0], in->data[0], in->linesize[0],
+                  w, h, slice_start, slice_end, luma, lsc);
+    if (cslice_start == cslice_end)
+        return 0;
+    apply_unsharp(out->data[1], out->linesize[1], in->data[1], in->linesize[1],
+                  cw, ch, cslice_start, cslice_end, chroma, csc);
+    apply_unsharp(out->data[2], out->linesize[2], in->data[2], in->linesize[2],
+                  cw, ch, cslice_start, cslice_end, chroma, csc);
+
+    return 0;
+}
+
 static void set_filter_param(FilterParam *fp, int msize_x, int msize_y, float amount)
 {
     fp->msize_x = msize_x;
@@ -156,9 +190,9 @@ static int query_formats(AVFilterContext *ctx)
     return 0;
 }
 
-static void init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char *effect_type, int width)
+static int init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char *effect_type,
+                             int width, int nb_threads)
 {
-    int z;
     const char *effect;
 
     effect = fp->amount == 0 ? "none" : fp->amount < 0 ? "blur" : "sharpen";
@@ -166,30 +200,42 @@ static void init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char
     av_log(ctx, AV_LOG_VERBOSE, "effect:%s type:%s msize_x:%d msize_y:%d amount:%0.2f\n",
            effect, effect_type, fp->msize_x, fp->msize_y, fp->amount / 65535.0);
 
-    for (z = 0; z < 2 * fp->steps_y; z++)
-        fp->sc[z] = av_malloc(sizeof(*(fp->sc[z])) * (width + 2 * fp->steps_x));
+    fp->sc_stride = width + 2 * fp->steps_x;
+    av_freep(&fp->sc);
+    fp->sc = av_malloc_array(nb_threads * 2 * fp->steps_y * fp->sc_stride,
+                             sizeof(*fp->sc));
+    if (!fp->sc)
+        return AVERROR(ENOMEM);
+
+    return 0;
 }
 
 static int config_props(AVFilterLink *link)
 {
     UnsharpContext *unsharp = link->dst->priv;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(link->format);
+    int ret;
 
     unsharp->hsub = desc->log2_chroma_w;
     unsharp->vsub = desc->log2_chroma_h;
-
-    init_filter_param(link->dst, &unsharp->luma,   "luma",   link->w);
-    init_filter_param(link->dst, &unsharp->chroma, "chroma", AV_CEIL_RSHIFT(link->w, unsharp->hsub));
+    unsharp->nb_threads = link->dst->graph->nb_threads;
+
+    ret = init_filter_param(link->dst, &unsharp->luma, "luma", link->w,
+                            unsharp->nb_threads);
+    if (ret < 0)
+        return ret;
+    ret = init_filter_param(link->dst, &unsharp->chroma, "chroma",
+                            AV_CEIL_RSHIFT(link->w, unsharp->hsub),
+                            unsharp->nb_threads);
+    if (ret < 0)
+        return ret;
 
     return 0;
 }
 
 static void free_filter_param(FilterParam *fp)
 {
-    int z;
-
-    for (z = 0; z < 2 * fp->steps_y; z++)
-        av_free(fp->sc[z]);
+    av_freep(&fp->sc);
 }
 
 static av_cold void uninit(AVFilterContext *ctx)
@@ -202,11 +248,11 @@ static av_cold void uninit(AVFilterContext *ctx)
 
 static int filter_frame(AVFilterLink *link, AVFrame *in)
 {
-    UnsharpContext *unsharp = link->dst->priv;
-    AVFilterLink *outlink   = link->dst->outputs[0];
+    AVFilterContext *ctx    = link->dst;
+    UnsharpContext *unsharp = ctx->priv;
+    AVFilterLink *outlink   = ctx->outputs[0];
+    ThreadData td;
     AVFrame *out;
-    int cw = AV_CEIL_RSHIFT(link->w, unsharp->hsub);
-    int ch = AV_CEIL_RSHIFT(link->h, unsharp->vsub);
 
     out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
     if (!out) {
@@ -215,9 +261,10 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
     }
     av_frame_copy_props(out, in);
 
-    apply_unsharp(out->data[0], out->linesize[0], in->data[0], in->linesize[0], link->w, link->h, &unsharp->luma);
-    apply_unsharp(out->data[1], out->linesize[1], in->data[1], in->linesize[1], cw,      ch,      &unsharp->chroma);
-    apply_unsharp(out->data[2], out->linesize[2], in->data[2], in->linesize[2], cw,      ch,      &unsharp->chroma);
+    td.in  = in;
+    td.out = out;
+    ctx->internal->execute(ctx, unsharp_slice, &td, NULL,
+                           FFMIN(link->h, unsharp->nb_threads));
 
     av_frame_free(&in);
     return ff_filter_frame(outlink, out);
@@ -274,4 +321,6 @@ AVFilter ff_vf_unsharp = {
     .inputs    = avfilter_vf_unsharp_inputs,
 
     .outputs   = avfilter_vf_unsharp_outputs,
+
+    .flags     = AVFILTER_FLAG_SLICE_THREADS,
 };
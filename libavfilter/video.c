@@ -25,6 +25,7 @@
 #include "libavutil/mem.h"
 
 #include "avfilter.h"
+#include "framepool.h"
 #include "internal.h"
 #include "video.h"
 
@@ -33,27 +34,20 @@ AVFrame *ff_null_get_video_buffer(AVFilterLink *link, int w, int h)
     return ff_get_video_buffer(link->dst->outputs[0], w, h);
 }
 
-/* TODO: set the buffer's priv member to a context structure for the whole
- * filter chain.  This will allow for a buffer pool instead of the constant
- * alloc & free cycle currently implemented. */
 AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
 {
-    AVFrame *frame = av_frame_alloc();
+    AVFrame *frame;
     int ret;
 
+    if (!(link->hw_frames_ctx &&
+          ((AVHWFramesContext*)link->hw_frames_ctx->data)->format == link->format))
+        return ff_frame_pool_get_video(&link->frame_pool, link->format, w, h, 32);
+
+    frame = av_frame_alloc();
     if (!frame)
         return NULL;
 
-    if (link->hw_frames_ctx &&
-        ((AVHWFramesContext*)link->hw_frames_ctx->data)->format == link->format) {
-        ret = av_hwframe_get_buffer(link->hw_frames_ctx, frame, 0);
-    } else {
-        frame->width  = w;
-        frame->height = h;
-        frame->format = link->format;
-
-        ret = av_frame_get_buffer(frame, 32);
-    }
+    ret = av_hwframe_get_buffer(link->hw_frames_ctx, frame, 0);
     if (ret < 0)
         av_frame_free(&frame);
 
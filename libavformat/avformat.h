@@ -1059,6 +1059,12 @@ typedef struct AVFormatContext {
  * This flag is mainly intended for testing.
  */
 #define AVFMT_FLAG_BITEXACT         0x0400
+/**
+ * Return packets referencing the I/O buffer instead of copying their data,
+ * when they fit in it. The padding after such packets is readable but not
+ * necessarily zeroed.
+ */
+#define AVFMT_FLAG_ZEROCOPY         0x0800
 
     /**
      * Maximum size of the data read from input for determining
@@ -371,6 +371,22 @@ int ffurl_shutdown(URLContext *h, int flags)
     return h->prot->url_shutdown(h, flags);
 }
 
+int ffurl_flush(URLContext *h)
+{
+    if (!h->prot->url_flush)
+        return 0;
+    return h->prot->url_flush(h);
+}
+
+int ffurl_read_mapped(URLContext *h, const uint8_t **data, int size)
+{
+    if (!(h->flags & AVIO_FLAG_READ))
+        return AVERROR(EIO);
+    if (!h->prot->url_read_mapped)
+        return AVERROR(ENOSYS);
+    return h->prot->url_read_mapped(h, data, size);
+}
+
 int ff_check_interrupt(AVIOInterruptCB *cb)
 {
     int ret;
@@ -22,6 +22,7 @@
 #include "avio.h"
 #include "url.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/log.h"
 
 extern const AVClass ff_avio_class;
@@ -53,6 +54,27 @@ int ffio_init_context(AVIOContext *s,
  */
 int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data);
 
+/**
+ * Read size bytes by taking a reference to the underlying buffer instead
+ * of copying them. Only works on contexts set up with
+ * ffio_enable_buffer_refs() and for sizes not larger than the buffer.
+ *
+ * @param buf set to a new reference whose data points to the bytes read;
+ *            its size includes AV_INPUT_BUFFER_PADDING_SIZE readable, but
+ *            not necessarily zeroed, bytes, which are not modified while
+ *            the reference exists
+ * @return size on success, 0 if the data must be read with avio_read()
+ *         instead, a negative AVERROR code on failure
+ */
+int ffio_read_ref(AVIOContext *s, int size, AVBufferRef **buf);
+
+/**
+ * Allocate the buffer of a read-only context created by ffio_fdopen() in
+ * refcounted blocks, so that ffio_read_ref() can be used on it. A block is
+ * not reused while references to it exist. Does nothing for other contexts.
+ */
+void ffio_enable_buffer_refs(AVIOContext *s);
+
 /**
  * Read size bytes from AVIOContext into buf.
  * This reads at most 1 packet. If that is not enough fewer bytes will be
@@ -127,6 +149,14 @@ int ffio_open_dyn_packet_buf(AVIOContext **s, int max_packet_size);
  */
 int ffio_fdopen(AVIOContext **s, URLContext *h);
 
+/**
+ * Flush the buffer like avio_flush() and, for contexts created by
+ * ffio_fdopen(), also make the protocol send out the data it has queued.
+ * Muxers call this at the end of each packet so that protocols batching
+ * their writes emit one burst per packet.
+ */
+void ffio_flush_url(AVIOContext *s);
+
 /**
  * Open a write-only fake memory stream. The written data is not stored
  * anywhere - this is only used for measuring the amount of data
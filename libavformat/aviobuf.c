@@ -19,6 +19,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "libavutil/buffer.h"
 #include "libavutil/crc.h"
 #include "libavutil/dict.h"
 #include "libavutil/intreadwrite.h"
@@ -33,6 +34,12 @@
 
 #define IO_BUFFER_SIZE 32768
 
+/**
+ * Amount of a memory-mapped resource exposed as buffer at once; seeks
+ * within it do not reach the protocol.
+ */
+#define IO_MAP_WINDOW_SIZE (1 << 20)
+
 /**
  * Do seeks within this distance ahead of the current buffer by skipping
  * data instead of calling the protocol seek function, for seekable
@@ -48,6 +55,28 @@ typedef struct AVIOInternal {
 
     URLContext *h;
     const URLProtocol **protocols;
+
+    /**
+     * Set if the protocol may support url_read_mapped; cleared once it
+     * reports that the resource is not mapped.
+     */
+    int map;
+    /**
+     * Set while s->buffer points into the mapping of the protocol rather
+     * than to an allocation of our own.
+     */
+    int mapped;
+
+    /**
+     * Set by ffio_enable_buffer_refs(); the buffer is then allocated in
+     * refcounted blocks which packets may reference.
+     */
+    int buffer_refs;
+    /**
+     * The block s->buffer points into, or NULL if s->buffer is a plain
+     * allocation.
+     */
+    AVBufferRef *buffer_ref;
 } AVIOInternal;
 
 static void *io_priv_child_next(void *obj, void *prev)
@@ -105,6 +134,42 @@ const AVClass ff_avio_class = {
 
 static void fill_buffer(AVIOContext *s);
 static int url_resetbuf(AVIOContext *s, int flags);
+static int io_read_packet(void *opaque, uint8_t *buf, int buf_size);
+
+static AVIOInternal *io_internal(AVIOContext *s)
+{
+    return s->read_packet == io_read_packet ? s->opaque : NULL;
+}
+
+static AVIOInternal *buffer_refs_internal(AVIOContext *s)
+{
+    AVIOInternal *internal = io_internal(s);
+
+    if (!internal || s->write_flag || internal->map)
+        return NULL;
+    return internal->buffer_refs ? internal : NULL;
+}
+
+static AVBufferRef *alloc_buffer_block(int size)
+{
+    AVBufferRef *ref = av_buffer_alloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (ref)
+        memset(ref->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    return ref;
+}
+
+static void free_buffer(AVIOContext *s)
+{
+    AVIOInternal *internal = io_internal(s);
+
+    if (internal && internal->mapped)
+        internal->mapped = 0;
+    else if (internal && internal->buffer_ref)
+        av_buffer_unref(&internal->buffer_ref);
+    else
+        av_free(s->buffer);
+    s->buffer = NULL;
+}
 
 int ffio_init_context(AVIOContext *s,
                   unsigned char *buffer,
@@ -459,8 +524,53 @@ void avio_write_marker(AVIOContext *s, int64_t time, enum AVIODataMarkerType typ
 
 /* Input stream */
 
+/**
+ * Point the buffer to the next window of a memory-mapped resource.
+ *
+ * @return 0 on success or EOF, AVERROR(ENOSYS) if the resource is not mapped
+ */
+static int fill_buffer_mapped(AVIOContext *s)
+{
+    AVIOInternal *internal = io_internal(s);
+    const uint8_t *data;
+    int len;
+
+    if (!internal || !internal->map || s->write_flag)
+        return AVERROR(ENOSYS);
+
+    len = ffurl_read_mapped(internal->h, &data, IO_MAP_WINDOW_SIZE);
+
+    if (len == AVERROR(ENOSYS)) {
+        internal->map = 0;
+        return len;
+    }
+    if (len <= 0) {
+        s->eof_reached = 1;
+        if (len < 0)
+            s->error = len;
+        return 0;
+    }
+
+    if (s->update_checksum && s->buf_end > s->checksum_ptr)
+        s->checksum = s->update_checksum(s->checksum, s->checksum_ptr,
+                                         s->buf_end - s->checksum_ptr);
+    if (!internal->mapped) {
+        free_buffer(s);
+        internal->mapped = 1;
+    }
+    s->buffer       = (uint8_t *)data;
+    s->buf_ptr      = s->buffer;
+    s->buf_end      = s->buffer + len;
+    s->checksum_ptr = s->buffer;
+    s->pos         += len;
+    return 0;
+}
+
 static void fill_buffer(AVIOContext *s)
 {
+    AVIOInternal *internal = buffer_refs_internal(s);
+    AVBufferRef *ref       = NULL;
+    int unread             = 0;
     uint8_t *dst        = !s->max_packet_size &&
                           s->buf_end - s->buffer < s->buffer_size ?
                           s->buf_end : s->buffer;
@@ -476,6 +586,9 @@ static void fill_buffer(AVIOContext *s)
     if (s->eof_reached)
         return;
 
+    if (fill_buffer_mapped(s) != AVERROR(ENOSYS))
+        return;
+
     if (s->update_checksum && dst == s->buffer) {
         if (s->buf_end > s->checksum_ptr)
             s->checksum = s->update_checksum(s->checksum, s->checksum_ptr,
@@ -491,6 +604,29 @@ static void fill_buffer(AVIOContext *s)
         len = s->buffer_size;
     }
 
+    /* Packets may still point into the current block, read into a new one.
+     * Appending would overwrite the padding behind the last packet, so the
+     * unread data is moved to the start of the new block instead. */
+    if (internal && (internal->buffer_ref ?
+                     !av_buffer_is_writable(internal->buffer_ref) :
+                     dst == s->buffer)) {
+        ref = alloc_buffer_block(s->buffer_size);
+        if (!ref) {
+            s->eof_reached = 1;
+            s->error       = AVERROR(ENOMEM);
+            return;
+        }
+        if (dst != s->buffer) {
+            if (s->update_checksum && s->buf_ptr > s->checksum_ptr)
+                s->checksum = s->update_checksum(s->checksum, s->checksum_ptr,
+                                                 s->buf_ptr - s->checksum_ptr);
+            unread = FFMAX(s->buf_end - s->buf_ptr, 0);
+            memcpy(ref->data, s->buf_ptr, unread);
+        }
+        dst = ref->data + unread;
+        len = s->buffer_size - unread;
+    }
+
     if (s->read_packet)
         len = s->read_packet(s->opaque, dst, len);
     else
@@ -498,10 +634,16 @@ static void fill_buffer(AVIOContext *s)
     if (len <= 0) {
         /* do not modify buffer if EOF reached so that a seek back can
            be done without rereading data */
+        av_buffer_unref(&ref);
         s->eof_reached = 1;
         if (len < 0)
             s->error = len;
     } else {
+        if (ref) {
+            free_buffer(s);
+            internal->buffer_ref = ref;
+            s->checksum_ptr = s->buffer = ref->data;
+        }
         s->pos += len;
         s->buf_ptr = dst;
         s->buf_end = dst + len;
@@ -616,6 +758,58 @@ int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsig
     }
 }
 
+int ffio_read_ref(AVIOContext *s, int size, AVBufferRef **buf)
+{
+    AVIOInternal *internal = buffer_refs_internal(s);
+    int len = s->buf_end - s->buf_ptr;
+
+    if (!internal || s->update_checksum || s->max_packet_size ||
+        size <= 0 || size > s->buffer_size || s->buffer_size > IO_BUFFER_SIZE)
+        return 0;
+
+    /* Move the unread data to the start of a new block if the buffer is
+     * not refcounted yet or the requested data would not fit behind it. */
+    if (!internal->buffer_ref ||
+        (len < size && s->buf_ptr + size > s->buffer + s->buffer_size)) {
+        AVBufferRef *ref = alloc_buffer_block(s->buffer_size);
+        if (!ref)
+            return AVERROR(ENOMEM);
+        memcpy(ref->data, s->buf_ptr, len);
+        free_buffer(s);
+        internal->buffer_ref = ref;
+        s->buffer  = s->buf_ptr = ref->data;
+        s->buf_end = s->buffer + len;
+    }
+
+    if (len < size) {
+        while (s->buf_end - s->buf_ptr < size && !s->eof_reached) {
+            /* fill_buffer() keeps the unread data right before the new
+             * data, but points buf_ptr at the latter */
+            int unread = s->buf_end - s->buf_ptr;
+            fill_buffer(s);
+            if (!s->eof_reached)
+                s->buf_ptr -= unread;
+        }
+        if (s->buf_end - s->buf_ptr < size)
+            return 0;
+    }
+
+    *buf = av_buffer_ref(internal->buffer_ref);
+    if (!*buf)
+        return AVERROR(ENOMEM);
+    (*buf)->data = s->buf_ptr;
+    (*buf)->size = size + AV_INPUT_BUFFER_PADDING_SIZE;
+    s->buf_ptr  += size;
+    return size;
+}
+
+void ffio_enable_buffer_refs(AVIOContext *s)
+{
+    if (s->read_packet == io_read_packet && !s->write_flag &&
+        !s->max_packet_size)
+        ((AVIOInternal *)s->opaque)->buffer_refs = 1;
+}
+
 int ffio_read_partial(AVIOContext *s, unsigned char *buf, int size)
 {
     int len;
@@ -818,6 +1012,19 @@ static int64_t io_read_seek(void *opaque, int stream_index, int64_t timestamp, i
     return internal->h->prot->url_read_seek(internal->h, stream_index, timestamp, flags);
 }
 
+void ffio_flush_url(AVIOContext *s)
+{
+    int ret;
+
+    avio_flush(s);
+    if (s->write_packet != io_write_packet)
+        return;
+
+    ret = ffurl_flush(((AVIOInternal *)s->opaque)->h);
+    if (ret < 0)
+        s->error = ret;
+}
+
 int ffio_fdopen(AVIOContext **s, URLContext *h)
 {
     AVIOInternal *internal = NULL;
@@ -840,6 +1047,7 @@ int ffio_fdopen(AVIOContext **s, URLContext *h)
 
     internal->class = &io_priv_class;
     internal->h = h;
+    internal->map = h->prot->url_read_mapped && !(h->flags & AVIO_FLAG_WRITE);
 
     av_opt_set_defaults(internal);
 
@@ -874,7 +1082,7 @@ int ffio_set_buf_size(AVIOContext *s, int buf_size)
     if (!buffer)
         return AVERROR(ENOMEM);
 
-    av_free(s->buffer);
+    free_buffer(s);
     s->buffer = buffer;
     s->buffer_size = buf_size;
     s->buf_ptr = buffer;
@@ -898,6 +1106,7 @@ static int url_resetbuf(AVIOContext *s, int flags)
 
 int ffio_rewind_with_probe_data(AVIOContext *s, unsigned char *buf, int buf_size)
 {
+    AVIOInternal *internal = io_internal(s);
     int64_t buffer_start;
     int buffer_size;
     int overlap, new_size, alloc_size;
@@ -905,6 +1114,15 @@ int ffio_rewind_with_probe_data(AVIOContext *s, unsigned char *buf, int buf_size
     if (s->write_flag)
         return AVERROR(EINVAL);
 
+    /* the probed data is still mapped, just go back to it */
+    if (internal && internal->mapped) {
+        int64_t ret;
+
+        av_free(buf);
+        ret = avio_seek(s, 0, SEEK_SET);
+        return ret < 0 ? ret : 0;
+    }
+
     buffer_size = s->buf_end - s->buffer;
 
     /* the buffers must touch or overlap */
@@ -924,7 +1142,7 @@ int ffio_rewind_with_probe_data(AVIOContext *s, unsigned char *buf, int buf_size
         buf_size = new_size;
     }
 
-    av_free(s->buffer);
+    free_buffer(s);
     s->buf_ptr = s->buffer = buf;
     s->buffer_size = alloc_size;
     s->pos = buf_size;
@@ -1004,9 +1222,9 @@ int avio_close(AVIOContext *s)
 
     av_opt_free(internal);
 
+    free_buffer(s);
     av_freep(&internal->protocols);
     av_freep(&s->opaque);
-    av_freep(&s->buffer);
     av_free(s);
     return ffurl_close(h);
 }
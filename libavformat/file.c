@@ -30,11 +30,21 @@
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <sys/stat.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "os_support.h"
 #include "url.h"
 
+/**
+ * Number of contiguous reads after a seek before the mapping is advised
+ * for sequential access again.
+ */
+#define MAP_SEQUENTIAL_READS 8
 
 /* standard file protocol */
 
@@ -43,11 +53,20 @@ typedef struct FileContext {
     int fd;
     int trunc;
     int follow;
+    int use_mmap;
+
+    uint8_t *map;
+    int64_t map_size;
+    int64_t map_pos;
+    int map_random;     ///< the mapping is currently advised for random access
+    int seq_reads;      ///< contiguous reads since the last seek
+    int page_size;
 } FileContext;
 
 static const AVOption file_options[] = {
     { "truncate", "Truncate existing files on write", offsetof(FileContext, trunc), AV_OPT_TYPE_INT, { .i64 = 1 }, 0, 1, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "mmap", "Map regular files in memory instead of reading them", offsetof(FileContext, use_mmap), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -58,10 +77,64 @@ static const AVClass file_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#if HAVE_MMAP
+static void file_advise(FileContext *c, int random, int64_t pos, int size)
+{
+#if HAVE_POSIX_MADVISE
+    if (random != c->map_random)
+        posix_madvise(c->map, c->map_size,
+                      random ? POSIX_MADV_RANDOM : POSIX_MADV_SEQUENTIAL);
+    /* readahead is off for random access, fetch the pages about to be
+     * used in one go rather than one fault at a time */
+    if (random && size > 0) {
+        int64_t start = pos & ~(int64_t)(c->page_size - 1);
+        posix_madvise(c->map + start, pos + size - start, POSIX_MADV_WILLNEED);
+    }
+#endif
+    c->map_random = random;
+}
+#endif /* HAVE_MMAP */
+
+static int file_read_mapped(URLContext *h, const uint8_t **data, int size)
+{
+#if HAVE_MMAP
+    FileContext *c = h->priv_data;
+
+    if (!c->map)
+        return AVERROR(ENOSYS);
+
+    size = FFMIN(size, c->map_size - c->map_pos);
+    if (size <= 0)
+        return 0;
+
+    if (c->map_random)
+        file_advise(c, ++c->seq_reads < MAP_SEQUENTIAL_READS, c->map_pos, size);
+
+    *data       = c->map + c->map_pos;
+    c->map_pos += size;
+    return size;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
-    int ret = read(c->fd, buf, size);
+    int ret;
+
+#if HAVE_MMAP
+    if (c->map) {
+        const uint8_t *data;
+
+        ret = file_read_mapped(h, &data, size);
+        if (ret > 0)
+            memcpy(buf, data, ret);
+        return ret;
+    }
+#endif
+
+    ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
     return (ret == -1) ? AVERROR(errno) : ret;
@@ -100,6 +173,33 @@ static int file_check(URLContext *h, int mask)
 
 #if CONFIG_FILE_PROTOCOL
 
+#if HAVE_MMAP
+static void file_map(FileContext *c)
+{
+    struct stat st;
+    void *map;
+
+    if (fstat(c->fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        (uint64_t)st.st_size > SIZE_MAX)
+        return;
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, c->fd, 0);
+    if (map == MAP_FAILED)
+        return;
+
+    c->map       = map;
+    c->map_size  = st.st_size;
+    c->map_pos   = 0;
+    c->page_size = 4096;
+#if HAVE_SYSCONF && defined(_SC_PAGESIZE)
+    c->page_size = sysconf(_SC_PAGESIZE);
+#endif
+#if HAVE_POSIX_MADVISE
+    posix_madvise(c->map, c->map_size, POSIX_MADV_SEQUENTIAL);
+#endif
+}
+#endif
+
 static int file_open(URLContext *h, const char *filename, int flags)
 {
     FileContext *c = h->priv_data;
@@ -126,6 +226,13 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (fd == -1)
         return AVERROR(errno);
     c->fd = fd;
+
+#if HAVE_MMAP
+    /* on failure, fall back to plain reads */
+    if (c->use_mmap && !(flags & AVIO_FLAG_WRITE) && !c->follow)
+        file_map(c);
+#endif
+
     return 0;
 }
 
@@ -142,6 +249,26 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
         return ret < 0 ? AVERROR(errno) : st.st_size;
     }
 
+#if HAVE_MMAP
+    if (c->map) {
+        if (whence == SEEK_CUR)
+            pos += c->map_pos;
+        else if (whence == SEEK_END)
+            pos += c->map_size;
+        else if (whence != SEEK_SET)
+            return AVERROR(EINVAL);
+        if (pos < 0)
+            return AVERROR(EINVAL);
+
+        if (pos != c->map_pos) {
+            c->seq_reads = 0;
+            file_advise(c, 1, pos, 0);
+        }
+        c->map_pos = pos;
+        return pos;
+    }
+#endif
+
     ret = lseek(c->fd, pos, whence);
 
     return ret < 0 ? AVERROR(errno) : ret;
@@ -150,6 +277,10 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
+#if HAVE_MMAP
+    if (c->map)
+        munmap(c->map, c->map_size);
+#endif
     return close(c->fd);
 }
 
@@ -162,6 +293,7 @@ const URLProtocol ff_file_protocol = {
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
     .url_check           = file_check,
+    .url_read_mapped     = file_read_mapped,
     .priv_data_size      = sizeof(FileContext),
     .priv_data_class     = &file_class,
 };
@@ -30,12 +30,16 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/dict.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "avformat.h"
 #include "internal.h"
 #include "avio_internal.h"
 
 #define INITIAL_BUFFER_SIZE 32768
+#define FETCH_CHUNK_SIZE    65536
+/* milliseconds to wait before checking the interrupt callback */
+#define POLLING_TIME        100
 
 /*
  * An apple http stream consists of a playlist with media segment files,
@@ -62,6 +66,21 @@ struct segment {
     uint8_t iv[16];
 };
 
+/*
+ * A segment downloaded by the background fetcher. The fetcher appends
+ * data to the last buffer of the queue while the demuxer consumes the
+ * first one.
+ */
+struct segment_buffer {
+    int seq_no;
+    uint8_t *data;
+    unsigned int allocated;
+    int size;
+    int pos;
+    int complete;
+    struct segment_buffer *next;
+};
+
 /*
  * Each variant has its own demuxer. If it currently is active,
  * it has an open AVIOContext too, and potentially an AVPacket
@@ -90,9 +109,29 @@ struct variant {
 
     char key_url[MAX_URL_SIZE];
     uint8_t key[16];
+
+#if HAVE_PTHREADS
+    /* background fetcher, downloading the segments following cur_seq_no
+     * and reloading live playlists; it owns the segment list, the
+     * playlist state and the key while it runs */
+    pthread_t fetch_thread;
+    pthread_mutex_t fetch_lock;
+    pthread_cond_t fetch_cond;
+    int fetch_started;
+    int fetch_abort;
+    int fetch_seq_no;
+    int fetch_error;
+    struct segment_buffer *queue, *queue_tail;
+    int nb_queued;
+    int64_t queued_size;
+    /* bytes of segment cur_seq_no already read before the fetcher was
+     * stopped, to be skipped once it is downloaded again */
+    int resume_pos;
+#endif
 };
 
 typedef struct HLSContext {
+    const AVClass *class;
     AVFormatContext *ctx;
     int n_variants;
     struct variant **variants;
@@ -104,6 +143,8 @@ typedef struct HLSContext {
     int seek_flags;
     AVIOInterruptCB *interrupt_callback;
     AVDictionary *avio_opts;
+    int prefetch_segments;
+    int prefetch_max_size;
 } HLSContext;
 
 static int read_chomp_line(AVIOContext *s, char *buf, int maxlen)
@@ -123,11 +164,41 @@ static void free_segment_list(struct variant *var)
     var->n_segments = 0;
 }
 
+static void stop_fetcher(struct variant *var)
+{
+#if HAVE_PTHREADS
+    struct segment_buffer *buf, *next;
+
+    if (!var->fetch_started)
+        return;
+
+    pthread_mutex_lock(&var->fetch_lock);
+    var->fetch_abort = 1;
+    pthread_cond_broadcast(&var->fetch_cond);
+    pthread_mutex_unlock(&var->fetch_lock);
+
+    pthread_join(var->fetch_thread, NULL);
+    pthread_cond_destroy(&var->fetch_cond);
+    pthread_mutex_destroy(&var->fetch_lock);
+
+    for (buf = var->queue; buf; buf = next) {
+        next = buf->next;
+        av_free(buf->data);
+        av_free(buf);
+    }
+    var->queue         = var->queue_tail = NULL;
+    var->nb_queued     = 0;
+    var->queued_size   = 0;
+    var->fetch_started = 0;
+#endif
+}
+
 static void free_variant_list(HLSContext *c)
 {
     int i;
     for (i = 0; i < c->n_variants; i++) {
         struct variant *var = c->variants[i];
+        stop_fetcher(var);
         free_segment_list(var);
         av_packet_unref(&var->pkt);
         av_free(var->pb.buffer);
@@ -358,12 +429,12 @@ fail:
     return ret;
 }
 
-static int open_input(struct variant *var)
+static int open_input(struct variant *var, struct segment *seg,
+                      AVIOContext **in)
 {
     HLSContext *c = var->parent->priv_data;
-    struct segment *seg = var->segments[var->cur_seq_no - var->start_seq_no];
     if (seg->key_type == KEY_NONE) {
-        return open_url(var->parent, &var->input, seg->url, c->avio_opts);
+        return open_url(var->parent, in, seg->url, c->avio_opts);
     } else if (seg->key_type == KEY_AES_128) {
         AVDictionary *opts = NULL;
         char iv[33], key[33], url[MAX_URL_SIZE];
@@ -395,13 +466,242 @@ static int open_input(struct variant *var)
         av_dict_set(&opts, "key", key, 0);
         av_dict_set(&opts, "iv", iv, 0);
 
-        ret = open_url(var->parent, &var->input, url, opts);
+        ret = open_url(var->parent, in, url, opts);
         av_dict_free(&opts);
         return ret;
     }
     return AVERROR(ENOSYS);
 }
 
+#if HAVE_PTHREADS
+static int64_t reload_interval(struct variant *v)
+{
+    return v->n_segments > 0 ? v->segments[v->n_segments - 1]->duration :
+                               v->target_duration;
+}
+
+/**
+ * Download one segment into a new buffer at the end of the queue, waiting
+ * for the demuxer whenever the memory cap is reached.
+ */
+static int fetch_segment(struct variant *v, struct segment *seg)
+{
+    HLSContext *c = v->parent->priv_data;
+    struct segment_buffer *buf;
+    AVIOContext *in;
+    int ret;
+
+    if (!(buf = av_mallocz(sizeof(*buf))))
+        return AVERROR(ENOMEM);
+    buf->seq_no = v->fetch_seq_no;
+
+    ret = open_input(v, seg, &in);
+    if (ret < 0) {
+        av_free(buf);
+        return ret;
+    }
+
+    pthread_mutex_lock(&v->fetch_lock);
+    if (v->queue_tail)
+        v->queue_tail->next = buf;
+    else
+        v->queue = buf;
+    v->queue_tail = buf;
+    v->nb_queued++;
+
+    while (!v->fetch_abort) {
+        uint8_t *data;
+
+        /* the segment being read is always downloaded completely */
+        if (v->queued_size >= c->prefetch_max_size && v->queue != buf) {
+            pthread_cond_wait(&v->fetch_cond, &v->fetch_lock);
+            continue;
+        }
+
+        data = av_fast_realloc(buf->data, &buf->allocated,
+                               buf->size + FETCH_CHUNK_SIZE);
+        if (!data) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        buf->data = data;
+        pthread_mutex_unlock(&v->fetch_lock);
+
+        /* the demuxer only reads below buf->size, and only this thread
+         * reallocates the buffer */
+        ret = avio_read(in, buf->data + buf->size, FETCH_CHUNK_SIZE);
+
+        pthread_mutex_lock(&v->fetch_lock);
+        if (ret <= 0)
+            break;
+        buf->size      += ret;
+        v->queued_size += ret;
+        pthread_cond_broadcast(&v->fetch_cond);
+    }
+    /* a read error ends the segment, like on the direct path */
+    buf->complete = 1;
+    pthread_cond_broadcast(&v->fetch_cond);
+    pthread_mutex_unlock(&v->fetch_lock);
+
+    ff_format_io_close(c->ctx, &in);
+    return ret == AVERROR(ENOMEM) ? ret : 0;
+}
+
+static void *fetch_thread(void *arg)
+{
+    struct variant *v = arg;
+    HLSContext *c = v->parent->priv_data;
+    int64_t interval = reload_interval(v);
+    int ret = 0;
+
+    pthread_mutex_lock(&v->fetch_lock);
+    while (!v->fetch_abort) {
+        if (v->nb_queued > c->prefetch_segments ||
+            (v->nb_queued && v->queued_size >= c->prefetch_max_size)) {
+            pthread_cond_wait(&v->fetch_cond, &v->fetch_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&v->fetch_lock);
+
+        if (!v->finished &&
+            av_gettime_relative() - v->last_load_time >= interval) {
+            if ((ret = parse_playlist(c, v->url, v, NULL)) < 0)
+                goto fail;
+            /* If there still are no new segments after this reload, try
+             * again after half the target duration. */
+            interval = v->target_duration / 2;
+        }
+        if (v->fetch_seq_no < v->start_seq_no) {
+            av_log(v->parent, AV_LOG_WARNING,
+                   "skipping %d segments ahead, expired from playlists\n",
+                   v->start_seq_no - v->fetch_seq_no);
+            v->fetch_seq_no = v->start_seq_no;
+        }
+        if (v->fetch_seq_no >= v->start_seq_no + v->n_segments) {
+            int64_t t = av_gettime() + POLLING_TIME * 1000;
+            struct timespec tv = { .tv_sec  =  t / 1000000,
+                                   .tv_nsec = (t % 1000000) * 1000 };
+
+            if (v->finished) {
+                ret = AVERROR_EOF;
+                goto fail;
+            }
+            pthread_mutex_lock(&v->fetch_lock);
+            if (!v->fetch_abort)
+                pthread_cond_timedwait(&v->fetch_cond, &v->fetch_lock, &tv);
+            continue;
+        }
+
+        ret = fetch_segment(v, v->segments[v->fetch_seq_no - v->start_seq_no]);
+        if (ret < 0)
+            goto fail;
+        v->fetch_seq_no++;
+        interval = reload_interval(v);
+
+        pthread_mutex_lock(&v->fetch_lock);
+    }
+    pthread_mutex_unlock(&v->fetch_lock);
+    return NULL;
+
+fail:
+    pthread_mutex_lock(&v->fetch_lock);
+    v->fetch_error = ret;
+    pthread_cond_broadcast(&v->fetch_cond);
+    pthread_mutex_unlock(&v->fetch_lock);
+    return NULL;
+}
+
+static int start_fetcher(struct variant *v)
+{
+    int ret;
+
+    v->fetch_abort  = 0;
+    v->fetch_error  = 0;
+    v->fetch_seq_no = v->cur_seq_no;
+
+    if ((ret = pthread_mutex_init(&v->fetch_lock, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&v->fetch_cond, NULL))) {
+        pthread_mutex_destroy(&v->fetch_lock);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_create(&v->fetch_thread, NULL, fetch_thread, v))) {
+        pthread_cond_destroy(&v->fetch_cond);
+        pthread_mutex_destroy(&v->fetch_lock);
+        return AVERROR(ret);
+    }
+    v->fetch_started = 1;
+
+    return 0;
+}
+
+/**
+ * Read from the segments downloaded by the fetcher.
+ *
+ * @return the number of bytes read, 0 at the end of a segment or a
+ * negative AVERROR code
+ */
+static int read_prefetched(struct variant *v, uint8_t *buf, int buf_size)
+{
+    HLSContext *c = v->parent->priv_data;
+    struct segment_buffer *seg;
+    int ret;
+
+    if (!v->fetch_started && (ret = start_fetcher(v)) < 0)
+        return ret;
+
+    pthread_mutex_lock(&v->fetch_lock);
+    for (;;) {
+        int64_t t;
+        struct timespec tv;
+
+        if ((seg = v->queue)) {
+            v->cur_seq_no = seg->seq_no;
+            if (v->resume_pos) {
+                int skip = FFMIN(v->resume_pos, seg->size - seg->pos);
+                seg->pos      += skip;
+                v->resume_pos -= skip;
+                if (seg->complete)
+                    v->resume_pos = 0;
+            }
+            if (seg->pos < seg->size && !v->resume_pos) {
+                ret = FFMIN(buf_size, seg->size - seg->pos);
+                memcpy(buf, seg->data + seg->pos, ret);
+                seg->pos += ret;
+                break;
+            }
+            if (seg->complete) {
+                v->queue = seg->next;
+                if (!v->queue)
+                    v->queue_tail = NULL;
+                v->nb_queued--;
+                v->queued_size -= seg->size;
+                av_free(seg->data);
+                av_free(seg);
+                pthread_cond_broadcast(&v->fetch_cond);
+                ret = 0;
+                break;
+            }
+        } else if (v->fetch_error) {
+            ret = v->fetch_error;
+            break;
+        }
+
+        if (ff_check_interrupt(c->interrupt_callback)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+        t  = av_gettime() + POLLING_TIME * 1000;
+        tv = (struct timespec){ .tv_sec  =  t / 1000000,
+                                .tv_nsec = (t % 1000000) * 1000 };
+        pthread_cond_timedwait(&v->fetch_cond, &v->fetch_lock, &tv);
+    }
+    pthread_mutex_unlock(&v->fetch_lock);
+
+    return ret;
+}
+#endif
+
 static int read_data(void *opaque, uint8_t *buf, int buf_size)
 {
     struct variant *v = opaque;
@@ -409,6 +709,14 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     int ret, i;
 
 restart:
+#if HAVE_PTHREADS
+    if (c->prefetch_segments) {
+        ret = read_prefetched(v, buf, buf_size);
+        if (ret != 0)
+            return ret;
+        goto next_segment;
+    }
+#endif
     if (!v->input) {
         /* If this is a live stream and the reload interval has elapsed since
          * the last playlist reload, reload the variant playlists now. */
@@ -444,7 +752,8 @@ reload:
             goto reload;
         }
 
-        ret = open_input(v);
+        ret = open_input(v, v->segments[v->cur_seq_no - v->start_seq_no],
+                         &v->input);
         if (ret < 0)
             return ret;
     }
@@ -452,6 +761,9 @@ reload:
     if (ret > 0)
         return ret;
     ff_format_io_close(c->ctx, &v->input);
+#if HAVE_PTHREADS
+next_segment:
+#endif
     v->cur_seq_no++;
 
     c->end_of_segment = 1;
@@ -469,6 +781,7 @@ reload:
     if (!v->needed) {
         av_log(v->parent, AV_LOG_INFO, "No longer receiving variant %d\n",
                v->index);
+        stop_fetcher(v);
         return AVERROR_EOF;
     }
     goto restart;
@@ -519,6 +832,10 @@ static int hls_read_header(AVFormatContext *s)
     if ((ret = save_avio_options(s)) < 0)
         goto fail;
 
+    /* keep the HTTP connections open for the following segments */
+    if ((ret = av_dict_set(&c->avio_opts, "multiple_requests", "1", 0)) < 0)
+        goto fail;
+
     if (c->n_variants == 0) {
         av_log(NULL, AV_LOG_WARNING, "Empty playlist\n");
         ret = AVERROR_EOF;
@@ -553,7 +870,7 @@ static int hls_read_header(AVFormatContext *s)
     for (i = 0; i < c->n_variants; i++) {
         struct variant *v = c->variants[i];
         AVInputFormat *in_fmt = NULL;
-        char bitrate_str[20];
+        char bitrate_str[20], url[MAX_URL_SIZE];
         AVProgram *program;
 
         if (v->n_segments == 0)
@@ -574,11 +891,14 @@ static int hls_read_header(AVFormatContext *s)
         if (!v->finished && v->n_segments > 3)
             v->cur_seq_no = v->start_seq_no + v->n_segments - 3;
 
+        /* the segment list belongs to the fetcher once reading starts */
+        av_strlcpy(url, v->segments[0]->url, sizeof(url));
+
         v->read_buffer = av_malloc(INITIAL_BUFFER_SIZE);
         ffio_init_context(&v->pb, v->read_buffer, INITIAL_BUFFER_SIZE, 0, v,
                           read_data, NULL, NULL);
         v->pb.seekable = 0;
-        ret = av_probe_input_buffer(&v->pb, &in_fmt, v->segments[0]->url,
+        ret = av_probe_input_buffer(&v->pb, &in_fmt, url,
                                     NULL, 0, 0);
         if (ret < 0) {
             /* Free the ctx - it isn't initialized properly at this point,
@@ -592,7 +912,7 @@ static int hls_read_header(AVFormatContext *s)
         v->ctx->pb       = &v->pb;
         v->ctx->io_open  = nested_io_open;
         v->stream_offset = stream_offset;
-        ret = avformat_open_input(&v->ctx, v->segments[0]->url, in_fmt, NULL);
+        ret = avformat_open_input(&v->ctx, url, in_fmt, NULL);
         if (ret < 0)
             goto fail;
 
@@ -658,10 +978,14 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             changed = 1;
             v->cur_seq_no = c->cur_seq_no;
             v->pb.eof_reached = 0;
+#if HAVE_PTHREADS
+            v->resume_pos = 0;
+#endif
             av_log(s, AV_LOG_INFO, "Now receiving variant %d\n", i);
         } else if (first && !v->cur_needed && v->needed) {
             if (v->input)
                 ff_format_io_close(s, &v->input);
+            stop_fetcher(v);
             v->needed = 0;
             changed = 1;
             av_log(s, AV_LOG_INFO, "No longer receiving variant %d\n", i);
@@ -784,6 +1108,19 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
     HLSContext *c = s->priv_data;
     int i, j, ret;
 
+    /* The fetchers reload the live playlists, stop them before looking at
+     * the playlist state. If the seek fails, the fetchers are restarted by
+     * the next read, which resumes where the demuxer stopped reading. */
+    for (i = 0; i < c->n_variants; i++) {
+        struct variant *var = c->variants[i];
+#if HAVE_PTHREADS
+        if (var->fetch_started && var->queue &&
+            var->queue->seq_no == var->cur_seq_no)
+            var->resume_pos = var->queue->pos;
+#endif
+        stop_fetcher(var);
+    }
+
     if ((flags & AVSEEK_FLAG_BYTE) || !c->variants[0]->finished)
         return AVERROR(ENOSYS);
 
@@ -810,6 +1147,9 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
                       0 : c->first_timestamp;
         if (var->input)
             ff_format_io_close(s, &var->input);
+#if HAVE_PTHREADS
+        var->resume_pos = 0;
+#endif
         av_packet_unref(&var->pkt);
         reset_packet(&var->pkt);
         var->pb.eof_reached = 0;
@@ -847,6 +1187,23 @@ static int hls_probe(AVProbeData *p)
     return 0;
 }
 
+#define OFFSET(x) offsetof(HLSContext, x)
+#define D AV_OPT_FLAG_DECODING_PARAM
+static const AVOption hls_options[] = {
+    { "prefetch_segments", "Number of segments to download ahead of the one being read, 0 to disable the background fetcher",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D },
+    { "prefetch_max_size", "Maximum amount of memory (in bytes) used by the prefetched segments of each variant",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT, { .i64 = 32 << 20 }, 0, INT_MAX, D },
+    { NULL }
+};
+
+static const AVClass hls_class = {
+    .class_name = "hls demuxer",
+    .item_name  = av_default_item_name,
+    .option     = hls_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 AVInputFormat ff_hls_demuxer = {
     .name           = "hls,applehttp",
     .long_name      = NULL_IF_CONFIG_SMALL("Apple HTTP Live Streaming"),
@@ -856,4 +1213,5 @@ AVInputFormat ff_hls_demuxer = {
     .read_packet    = hls_read_packet,
     .read_close     = hls_close,
     .read_seek      = hls_read_seek,
+    .priv_class     = &hls_class,
 };
@@ -345,7 +345,7 @@ static int hls_start(AVFormatContext *s)
     }
 
     if ((err = s->io_open(s, &oc->pb, oc->filename, AVIO_FLAG_WRITE, &opts)) < 0)
-        return err;
+        goto fail;
 
     if (oc->oformat->priv_class && oc->priv_data)
         av_opt_set(oc->priv_data, "mpegts_flags", "resend_headers", 0);
@@ -27,6 +27,8 @@
 
 #include "libavutil/avstring.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
 
 #include "avformat.h"
 #include "http.h"
@@ -45,6 +47,12 @@
 #define BUFFER_SIZE   MAX_URL_SIZE
 #define MAX_REDIRECTS 8
 
+/* idle persistent connections kept for later requests */
+#define POOL_MAX_CONNECTIONS 16
+#define POOL_MAX_IDLE_TIME   (30 * 1000000)
+/* reply data skipped at most to make a connection reusable */
+#define MAX_DRAIN_SIZE       65536
+
 typedef struct HTTPContext {
     const AVClass *class;
     URLContext *hd;
@@ -71,6 +79,10 @@ typedef struct HTTPContext {
     int end_header;
     /* A flag which indicates if we use persistent connections. */
     int multiple_requests;
+    /* Set once the last chunk of a chunked reply has been read. */
+    int end_chunked_reply;
+    /* The pool key of the connection, empty if it cannot be pooled. */
+    char pool_key[MAX_URL_SIZE];
     uint8_t *post_data;
     int post_datalen;
     int icy;
@@ -124,6 +136,132 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
                         const char *hoststr, const char *auth,
                         const char *proxyauth, int *new_location);
 
+/*
+ * Process-wide pool of idle persistent connections, keyed by their lower
+ * level URL (protocol, host and port) and the options they were opened
+ * with, such as the TLS certificate checks. A connection is only handed to
+ * a request with the same interrupt callback, since the lower level
+ * URLContexts keep the one they were opened with.
+ */
+typedef struct HTTPPoolEntry {
+    char key[MAX_URL_SIZE];
+    AVIOInterruptCB int_cb;
+    URLContext *hd;
+    int64_t idle_since;
+} HTTPPoolEntry;
+
+static HTTPPoolEntry pool[POOL_MAX_CONNECTIONS];
+static int pool_size;
+static AVMutex pool_lock;
+static AVOnce pool_once = AV_ONCE_INIT;
+
+static void pool_init(void)
+{
+    ff_mutex_init(&pool_lock, NULL);
+}
+
+/* An idle connection has nothing to read until the server closes it. */
+static int connection_alive(URLContext *hd)
+{
+    int fd = ffurl_get_file_handle(hd);
+    struct pollfd p = { .fd = fd, .events = POLLIN, .revents = 0 };
+
+    /* TLS connections do not expose their socket, rely on the idle time */
+    if (fd < 0)
+        return 1;
+
+    return !poll(&p, 1, 0);
+}
+
+/**
+ * Build the pool key of a connection to url opened with options. The key is
+ * left empty if it does not fit, so that the connection is not pooled.
+ */
+static void pool_make_key(char *key, int key_size, const char *url,
+                          AVDictionary *options)
+{
+    AVDictionaryEntry *e = NULL;
+    size_t len = av_strlcpy(key, url, key_size);
+
+    while ((e = av_dict_get(options, "", e, AV_DICT_IGNORE_SUFFIX)))
+        len = av_strlcatf(key, key_size, "|%s=%s", e->key, e->value);
+
+    if (len >= key_size)
+        key[0] = '\0';
+}
+
+static URLContext *pool_get(const char *key, const AVIOInterruptCB *int_cb)
+{
+    for (;;) {
+        URLContext *hd = NULL;
+        int64_t idle_since = 0;
+        int i;
+
+        ff_thread_once(&pool_once, pool_init);
+        ff_mutex_lock(&pool_lock);
+        for (i = pool_size - 1; i >= 0; i--) {
+            if (!strcmp(pool[i].key, key) &&
+                pool[i].int_cb.callback == int_cb->callback &&
+                pool[i].int_cb.opaque   == int_cb->opaque) {
+                hd         = pool[i].hd;
+                idle_since = pool[i].idle_since;
+                memmove(&pool[i], &pool[i + 1],
+                        (pool_size - i - 1) * sizeof(*pool));
+                pool_size--;
+                break;
+            }
+        }
+        ff_mutex_unlock(&pool_lock);
+
+        if (!hd)
+            return NULL;
+        if (av_gettime_relative() - idle_since < POOL_MAX_IDLE_TIME &&
+            connection_alive(hd))
+            return hd;
+        ffurl_close(hd);
+    }
+}
+
+static void pool_put(const char *key, const AVIOInterruptCB *int_cb,
+                     URLContext *hd)
+{
+    URLContext *evicted = NULL;
+
+    ff_thread_once(&pool_once, pool_init);
+    ff_mutex_lock(&pool_lock);
+    if (pool_size == POOL_MAX_CONNECTIONS) {
+        evicted = pool[0].hd;
+        memmove(&pool[0], &pool[1], (pool_size - 1) * sizeof(*pool));
+        pool_size--;
+    }
+    av_strlcpy(pool[pool_size].key, key, sizeof(pool[pool_size].key));
+    pool[pool_size].int_cb     = *int_cb;
+    pool[pool_size].hd         = hd;
+    pool[pool_size].idle_since = av_gettime_relative();
+    pool_size++;
+    ff_mutex_unlock(&pool_lock);
+
+    if (evicted)
+        ffurl_close(evicted);
+}
+
+void ff_http_close_idle_connections(void)
+{
+    URLContext *hd[POOL_MAX_CONNECTIONS];
+    int i, nb_entries;
+
+    ff_thread_once(&pool_once, pool_init);
+    ff_mutex_lock(&pool_lock);
+    for (i = 0; i < pool_size; i++)
+        hd[i] = pool[i].hd;
+    nb_entries = pool_size;
+    pool_size  = 0;
+    ff_mutex_unlock(&pool_lock);
+
+    for (i = 0; i < nb_entries; i++)
+        ffurl_close(hd[i]);
+}
+
 void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
 {
     memcpy(&((HTTPContext *)dest->priv_data)->auth_state,
@@ -141,8 +279,12 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
     char auth[1024], proxyauth[1024] = "";
     char path1[MAX_URL_SIZE];
     char buf[1024], urlbuf[MAX_URL_SIZE];
-    int port, use_proxy, err, location_changed = 0;
+    int port, use_proxy, err, location_changed = 0, reused = 0;
+    int64_t off;
     HTTPContext *s = h->priv_data;
+    /* a streamed upload cannot be retried if the connection turns out to
+     * be closed, so it always gets a new one */
+    int upload = h->flags & AVIO_FLAG_WRITE && !s->post_data;
 
     av_url_split(proto, sizeof(proto), auth, sizeof(auth),
                  hostname, sizeof(hostname), &port,
@@ -179,6 +321,18 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
 
     ff_url_join(buf, sizeof(buf), lower_proto, NULL, hostname, port, NULL);
 
+    if (!s->hd) {
+        s->pool_key[0] = '\0';
+        if (s->multiple_requests && !upload)
+            pool_make_key(s->pool_key, sizeof(s->pool_key), buf,
+                          options ? *options : NULL);
+        if (s->pool_key[0] &&
+            (s->hd = pool_get(s->pool_key, &h->interrupt_callback))) {
+            /* the protocol list of the previous owner may be gone */
+            s->hd->protocols = h->protocols;
+            reused = 1;
+        }
+    }
     if (!s->hd) {
         err = ffurl_open(&s->hd, buf, AVIO_FLAG_READ_WRITE,
                          &h->interrupt_callback, options, h->protocols, h);
@@ -186,8 +340,22 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
             return err;
     }
 
+    off = s->off;
     err = http_connect(h, path, local_path, hoststr,
                        auth, proxyauth, &location_changed);
+    if (err < 0 && reused) {
+        /* The server may have closed the idle connection in the meantime,
+         * retry once with a new one. */
+        ffurl_close(s->hd);
+        s->hd  = NULL;
+        s->off = off;
+        err = ffurl_open(&s->hd, buf, AVIO_FLAG_READ_WRITE,
+                         &h->interrupt_callback, options, h->protocols, h);
+        if (err < 0)
+            return err;
+        err = http_connect(h, path, local_path, hoststr,
+                           auth, proxyauth, &location_changed);
+    }
     if (err < 0)
         return err;
 
@@ -285,7 +453,9 @@ static int http_open(URLContext *h, const char *uri, int flags,
     if (options)
         av_dict_copy(&s->chained_options, *options, 0);
 
-    if (s->headers) {
+    /* an empty string, as returned by av_opt_get() for unset headers, would
+     * end the request early with a stray CRLF */
+    if (s->headers && s->headers[0]) {
         int len = strlen(s->headers);
         if (len < 2 || strcmp("\r\n", s->headers + len - 2)) {
             av_log(h, AV_LOG_WARNING,
@@ -673,15 +843,16 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
             return err;
 
     /* init input buffer */
-    s->buf_ptr          = s->buffer;
-    s->buf_end          = s->buffer;
-    s->line_count       = 0;
-    s->off              = 0;
-    s->icy_data_read    = 0;
-    s->filesize         = -1;
-    s->willclose        = 0;
-    s->end_chunked_post = 0;
-    s->end_header       = 0;
+    s->buf_ptr           = s->buffer;
+    s->buf_end           = s->buffer;
+    s->line_count        = 0;
+    s->off               = 0;
+    s->icy_data_read     = 0;
+    s->filesize          = -1;
+    s->willclose         = 0;
+    s->end_chunked_post  = 0;
+    s->end_chunked_reply = 0;
+    s->end_header        = 0;
     if (post && !s->post_data && !send_expect_100) {
         /* Pretend that it did work. We didn't read any header yet, since
          * we've still to send the POST data, but the code calling this
@@ -771,6 +942,8 @@ static int http_read_stream(URLContext *h, uint8_t *buf, int size)
     }
 
     if (s->chunksize >= 0) {
+        if (s->end_chunked_reply)
+            return 0;
         if (!s->chunksize) {
             char line[32];
 
@@ -786,8 +959,10 @@ static int http_read_stream(URLContext *h, uint8_t *buf, int size)
                         s->chunksize);
                 if (s->chunksize < 0)
                     return AVERROR_INVALIDDATA;
-                else if (!s->chunksize)
+                else if (!s->chunksize) {
+                    s->end_chunked_reply = 1;
                     return 0;
+                }
                 break;
             }
         }
@@ -934,6 +1109,54 @@ static int http_shutdown(URLContext *h, int flags)
     return ret;
 }
 
+/**
+ * Finish reading the reply to the current request, so that the connection
+ * can serve another one.
+ *
+ * @return 1 if the connection can be reused, 0 otherwise
+ */
+static int http_finish_reply(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    char line[MAX_URL_SIZE];
+    int ret, drained = 0;
+
+    /* Nobody reads the reply to a streamed upload, and waiting for it here
+     * would block the caller, so such connections are not reused. */
+    if (!s->multiple_requests || !s->pool_key[0] || s->end_off ||
+        !s->end_header)
+        return 0;
+
+    if (s->willclose || s->http_code < 200 || s->http_code >= 300)
+        return 0;
+    if (s->http_code == 204)
+        return s->buf_ptr == s->buf_end;
+    /* without a length the reply ends when the connection is closed */
+    if (s->chunksize < 0 && s->filesize < 0)
+        return 0;
+
+#if CONFIG_ZLIB
+    s->compressed = 0;
+#endif /* CONFIG_ZLIB */
+    while ((ret = http_read_stream(h, line, sizeof(line))) > 0) {
+        drained += ret;
+        if (drained > MAX_DRAIN_SIZE)
+            return 0;
+    }
+    if (ret < 0 && ret != AVERROR_EOF)
+        return 0;
+
+    /* skip the trailer following the last chunk */
+    if (s->end_chunked_reply) {
+        do {
+            if (http_get_line(s, line, sizeof(line)) < 0)
+                return 0;
+        } while (line[0]);
+    }
+
+    return s->buf_ptr == s->buf_end;
+}
+
 static int http_close(URLContext *h)
 {
     int ret = 0;
@@ -948,8 +1171,12 @@ static int http_close(URLContext *h)
         /* Close the write direction by sending the end of chunked encoding. */
         ret = http_shutdown(h, h->flags);
 
-    if (s->hd)
-        ffurl_close(s->hd);
+    if (s->hd) {
+        if (!ret && http_finish_reply(h))
+            pool_put(s->pool_key, &h->interrupt_callback, s->hd);
+        else
+            ffurl_close(s->hd);
+    }
     av_dict_free(&s->chained_options);
     return ret;
 }
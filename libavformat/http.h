@@ -47,4 +47,9 @@ void ff_http_init_auth_state(URLContext *dest, const URLContext *src);
  */
 int ff_http_do_new_request(URLContext *h, const char *uri);
 
+/**
+ * Close the idle persistent connections kept for later requests.
+ */
+void ff_http_close_idle_connections(void);
+
 #endif /* AVFORMAT_HTTP_H */
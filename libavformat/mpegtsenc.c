@@ -706,7 +706,7 @@ static int mpegts_write_header(AVFormatContext *s)
         }
     }
 
-    avio_flush(s->pb);
+    ffio_flush_url(s->pb);
 
     return 0;
 
@@ -1033,7 +1033,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
         mpegts_prefix_m2ts_header(s);
         avio_write(s->pb, buf, TS_PACKET_SIZE);
     }
-    avio_flush(s->pb);
+    ffio_flush_url(s->pb);
 }
 
 static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
@@ -1187,7 +1187,7 @@ static void mpegts_write_flush(AVFormatContext *s)
             ts_st->payload_size = 0;
         }
     }
-    avio_flush(s->pb);
+    ffio_flush_url(s->pb);
 }
 
 static int mpegts_write_packet(AVFormatContext *s, AVPacket *pkt)
@@ -57,6 +57,8 @@ typedef struct RTPContext {
     int pkt_size;
     char *sources;
     char *block;
+    int tx_batch;
+    int64_t bitrate;
 } RTPContext;
 
 #define OFFSET(x) offsetof(RTPContext, x)
@@ -73,6 +75,8 @@ static const AVOption options[] = {
     { "pkt_size",           "Maximum packet size",                                              OFFSET(pkt_size),        AV_OPT_TYPE_INT,    { .i64 = -1 },    -1, INT_MAX, .flags = D|E },
     { "sources",            "Source list",                                                      OFFSET(sources),         AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",              "Block list",                                                       OFFSET(block),           AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "tx_batch",           "Number of RTP packets queued and sent together",                   OFFSET(tx_batch),        AV_OPT_TYPE_INT,    { .i64 =  0 },     0, 1024,    .flags = E },
+    { "bitrate",            "Maximum RTP output bitrate (in bits per second), 0 for no pacing", OFFSET(bitrate),         AV_OPT_TYPE_INT64,  { .i64 =  0 },     0, INT64_MAX, .flags = E },
     { NULL }
 };
 
@@ -298,6 +302,8 @@ static void rtp_parse_addr_list(URLContext *h, char *buf,
  *         'sources=ip[,ip]'  : list allowed source IP addresses
  *         'block=ip[,ip]'    : list disallowed source IP addresses
  *         'write_to_source=0/1' : send packets to the source address of the latest received packet
+ *         'tx_batch=n'       : queue up to n rtp packets and send them together
+ *         'bitrate=n'        : pace the rtp packets to at most n bits per second
  * deprecated option:
  *         'localport=n'      : set the local port to n
  *
@@ -349,6 +355,12 @@ static int rtp_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "write_to_source", p)) {
             s->write_to_source = strtol(buf, NULL, 10);
         }
+        if (av_find_info_tag(buf, sizeof(buf), "tx_batch", p)) {
+            s->tx_batch = strtol(buf, NULL, 10);
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "bitrate", p)) {
+            s->bitrate = strtoll(buf, NULL, 10);
+        }
         if (av_find_info_tag(buf, sizeof(buf), "sources", p)) {
             av_strlcpy(include_sources, buf, sizeof(include_sources));
 
@@ -368,6 +380,11 @@ static int rtp_open(URLContext *h, const char *uri, int flags)
 
     build_udp_url(s, buf, sizeof(buf),
                   hostname, rtp_port, s->local_rtpport, sources, block);
+    /* only the media packets are batched, RTCP is sent right away */
+    if (s->tx_batch > 1)
+        url_add_option(buf, sizeof(buf), "tx_batch=%d", s->tx_batch);
+    if (s->bitrate > 0)
+        url_add_option(buf, sizeof(buf), "bitrate=%"PRId64, s->bitrate);
     if (ffurl_open(&s->rtp_hd, buf, flags, &h->interrupt_callback, NULL,
                    h->protocols, h) < 0)
         goto fail;
@@ -514,6 +531,13 @@ static int rtp_write(URLContext *h, const uint8_t *buf, int size)
     return ret;
 }
 
+static int rtp_flush(URLContext *h)
+{
+    RTPContext *s = h->priv_data;
+
+    return ffurl_flush(s->rtp_hd);
+}
+
 static int rtp_close(URLContext *h)
 {
     RTPContext *s = h->priv_data;
@@ -582,6 +606,7 @@ const URLProtocol ff_rtp_protocol = {
     .url_close                 = rtp_close,
     .url_get_file_handle       = rtp_get_file_handle,
     .url_get_multi_file_handle = rtp_get_multi_file_handle,
+    .url_flush                 = rtp_flush,
     .priv_data_size            = sizeof(RTPContext),
     .flags                     = URL_PROTOCOL_FLAG_NETWORK,
     .priv_data_class           = &rtp_class,
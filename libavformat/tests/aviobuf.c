@@ -0,0 +1,313 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/dict.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+
+#include "libavcodec/avcodec.h"
+
+#include "libavformat/avio_internal.h"
+#include "libavformat/url.h"
+
+#define TOTAL_SIZE (1 << 20)
+#define NB_REFS    8
+
+/* memory-mapped files are exposed in windows of 1 MiB, read across a few */
+#define MAP_WINDOW_SIZE (1 << 20)
+#define MAP_FILE_SIZE   (3 * MAP_WINDOW_SIZE + 12345)
+#define MAP_MAX_READ    (MAP_WINDOW_SIZE + MAP_WINDOW_SIZE / 2)
+#define MAP_NB_OPS      300
+
+/* Protocol returning a known pattern in short reads of varying sizes, so
+ * that the I/O buffer is refilled both in place and behind its end. */
+typedef struct PatternContext {
+    AVLFG lfg;
+    int pos;
+} PatternContext;
+
+static uint8_t pattern(int pos)
+{
+    return pos * 7 + (pos >> 8);
+}
+
+static int pattern_open(URLContext *h, const char *url, int flags)
+{
+    PatternContext *p = h->priv_data;
+
+    av_lfg_init(&p->lfg, 0xdeadbeef);
+    h->is_streamed = 1;
+    return 0;
+}
+
+static int pattern_read(URLContext *h, unsigned char *buf, int size)
+{
+    PatternContext *p = h->priv_data;
+    int max_size = 1 + av_lfg_get(&p->lfg) % 4096;
+    int i;
+
+    size = FFMIN(size, TOTAL_SIZE - p->pos);
+    if (!size)
+        return AVERROR_EOF;
+    size = FFMIN(size, max_size);
+    for (i = 0; i < size; i++)
+        buf[i] = pattern(p->pos++);
+    return size;
+}
+
+static const URLProtocol pattern_protocol = {
+    .name           = "pattern",
+    .url_open       = pattern_open,
+    .url_read       = pattern_read,
+    .priv_data_size = sizeof(PatternContext),
+};
+
+static const URLProtocol *protocols[] = { &pattern_protocol, NULL };
+
+typedef struct Ref {
+    AVBufferRef *buf;
+    int pos, size;
+    uint8_t padding[AV_INPUT_BUFFER_PADDING_SIZE];
+} Ref;
+
+/* The data and the padding must not change while the reference is held. */
+static int check_ref(const Ref *ref)
+{
+    int i;
+
+    for (i = 0; i < ref->size; i++)
+        if (ref->buf->data[i] != pattern(ref->pos + i))
+            return AVERROR_BUG;
+    return memcmp(ref->buf->data + ref->size, ref->padding,
+                  AV_INPUT_BUFFER_PADDING_SIZE) ? AVERROR_BUG : 0;
+}
+
+static int test_buffer_refs(void)
+{
+    Ref refs[NB_REFS] = { { 0 } };
+    URLContext *h = NULL;
+    AVIOContext *pb = NULL;
+    uint8_t *buf = NULL;
+    AVLFG lfg;
+    int pos = 0, nb_refs = 0, nb_copies = 0, max_read, i, ret;
+
+    av_lfg_init(&lfg, 1);
+
+    ret = ffurl_open(&h, "pattern:", AVIO_FLAG_READ, NULL, NULL, protocols,
+                     NULL);
+    if (ret < 0)
+        goto end;
+    ret = ffio_fdopen(&pb, h);
+    if (ret < 0) {
+        ffurl_close(h);
+        goto end;
+    }
+    ffio_enable_buffer_refs(pb);
+
+    /* also request more than fits the buffer */
+    max_read = pb->buffer_size + 1024;
+    buf      = av_malloc(max_read);
+    if (!buf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    while (pos < TOTAL_SIZE) {
+        int size = 1 + av_lfg_get(&lfg) % max_read;
+        Ref *ref = &refs[nb_refs % NB_REFS];
+
+        /* end every other packet with the buffered data, so that the next
+         * refill goes right behind its padding */
+        if (nb_refs & 1 && pb->buf_end > pb->buf_ptr)
+            size = pb->buf_end - pb->buf_ptr;
+        size = FFMIN(size, TOTAL_SIZE - pos);
+        av_buffer_unref(&ref->buf);
+        ret = ffio_read_ref(pb, size, &ref->buf);
+        if (ret < 0)
+            goto end;
+
+        if (ret) {
+            ref->pos  = pos;
+            ref->size = size;
+            memcpy(ref->padding, ref->buf->data + size,
+                   AV_INPUT_BUFFER_PADDING_SIZE);
+            nb_refs++;
+        } else {
+            ret = avio_read(pb, buf, size);
+            if (ret != size) {
+                ret = AVERROR_BUG;
+                goto end;
+            }
+            for (i = 0; i < size; i++)
+                if (buf[i] != pattern(pos + i)) {
+                    ret = AVERROR_BUG;
+                    goto end;
+                }
+            nb_copies++;
+        }
+        pos += size;
+
+        for (i = 0; i < NB_REFS; i++) {
+            if (refs[i].buf && (ret = check_ref(&refs[i])) < 0) {
+                printf("reference to %d bytes at %d was overwritten\n",
+                       refs[i].size, refs[i].pos);
+                goto end;
+            }
+        }
+    }
+
+    printf("read %d bytes, %d references, %d copies\n",
+           pos, nb_refs, nb_copies);
+
+end:
+    for (i = 0; i < NB_REFS; i++)
+        av_buffer_unref(&refs[i].buf);
+    av_free(buf);
+    avio_close(pb);
+    return ret;
+}
+
+static int check_pattern(const uint8_t *buf, int64_t pos, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++)
+        if (buf[i] != pattern(pos + i))
+            return AVERROR_BUG;
+    return 0;
+}
+
+/* Read a file through the file protocol in mmap mode, with reads smaller
+ * and larger than a window, and seeks back and forth across windows. */
+static int test_mapped(const char *filename)
+{
+    AVDictionary *opts = NULL;
+    AVIOContext *pb    = NULL;
+    uint8_t *buf;
+    AVLFG lfg;
+    int64_t pos = 0;
+    int nb_reads = 0, nb_seeks = 0, i, ret;
+
+    buf = av_malloc(MAP_MAX_READ);
+    if (!buf)
+        return AVERROR(ENOMEM);
+
+    ret = avio_open(&pb, filename, AVIO_FLAG_WRITE);
+    if (ret < 0)
+        goto end;
+    for (; pos < MAP_FILE_SIZE; pos += ret) {
+        ret = FFMIN(MAP_FILE_SIZE - pos, 65536);
+        for (i = 0; i < ret; i++)
+            buf[i] = pattern(pos + i);
+        avio_write(pb, buf, ret);
+    }
+    ret = avio_closep(&pb);
+    if (ret < 0)
+        goto end;
+
+    av_dict_set(&opts, "mmap", "1", 0);
+    ret = avio_open2(&pb, filename, AVIO_FLAG_READ, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+    if (avio_size(pb) != MAP_FILE_SIZE) {
+        ret = AVERROR_BUG;
+        goto end;
+    }
+
+    /* a small read maps the whole first window */
+    ret = avio_read(pb, buf, 1);
+    if (ret != 1 || (ret = check_pattern(buf, 0, 1)) < 0)
+        goto end;
+#if HAVE_MMAP
+    if (pb->buf_end - pb->buffer != MAP_WINDOW_SIZE) {
+        printf("file not mapped\n");
+        ret = AVERROR_BUG;
+        goto end;
+    }
+#endif
+    pos = 1;
+
+    av_lfg_init(&lfg, 2);
+    for (i = 0; i < MAP_NB_OPS; i++) {
+        unsigned op = av_lfg_get(&lfg) % 8;
+
+        if (op < 2 || pos == MAP_FILE_SIZE) {
+            /* back anywhere before, or forward anywhere inside the file */
+            int64_t target = op || pos == MAP_FILE_SIZE ?
+                             av_lfg_get(&lfg) % pos :
+                             pos + av_lfg_get(&lfg) % (MAP_FILE_SIZE - pos);
+            if (avio_seek(pb, target, SEEK_SET) != target) {
+                printf("seek to %"PRId64" failed\n", target);
+                ret = AVERROR_BUG;
+                goto end;
+            }
+            pos = target;
+            nb_seeks++;
+        } else {
+            int size = 1 + av_lfg_get(&lfg) % (op == 2 ? MAP_MAX_READ : 65536);
+            int len  = FFMIN(size, MAP_FILE_SIZE - pos);
+
+            ret = avio_read(pb, buf, size);
+            if (ret != len || check_pattern(buf, pos, len) < 0) {
+                printf("read of %d bytes at %"PRId64" failed\n", size, pos);
+                ret = AVERROR_BUG;
+                goto end;
+            }
+            pos += len;
+            nb_reads++;
+        }
+        if (avio_tell(pb) != pos) {
+            ret = AVERROR_BUG;
+            goto end;
+        }
+    }
+
+    printf("mapped %d bytes, %d reads, %d seeks\n",
+           MAP_FILE_SIZE, nb_reads, nb_seeks);
+    ret = 0;
+
+end:
+    avio_closep(&pb);
+    av_free(buf);
+    remove(filename);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    ret = test_buffer_refs();
+    /* the mmap mode of the file protocol needs a scratch file */
+    if (ret >= 0 && argc > 1)
+        ret = test_mapped(argv[1]);
+
+    if (ret < 0)
+        printf("error %d\n", ret);
+    return ret < 0;
+}
@@ -25,12 +25,17 @@
  */
 
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() */
 
 #include "avformat.h"
 #include "avio_internal.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/avstring.h"
+#include "libavutil/fifo.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
 #include "internal.h"
 #include "network.h"
 #include "os_support.h"
@@ -56,10 +61,37 @@ typedef struct UDPContext {
     char *localaddr;
     char *sources;
     char *block;
+
+    /* receive thread and ring buffer */
+    int fifo_size;
+    int overrun_nonfatal;
+    AVFifoBuffer *fifo;
+    uint8_t *rx_buf;
+    int circular_buffer_error;
+#if HAVE_PTHREADS
+    pthread_t receiver_thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int thread_started;
+    int close_req;
+#endif
+
+    /* batched, paced output */
+    int tx_batch;
+    int64_t bitrate;
+    uint8_t *tx_buf;
+    int *tx_len;
+    int tx_count;
+    int64_t tx_next;
+#if HAVE_SENDMMSG
+    struct mmsghdr *tx_msgs;
+    struct iovec *tx_iov;
+#endif
 } UDPContext;
 
 #define UDP_TX_BUF_SIZE 32768
 #define UDP_MAX_PKT_SIZE 65536
+#define UDP_RX_BATCH 8
 
 #define OFFSET(x) offsetof(UDPContext, x)
 #define D AV_OPT_FLAG_DECODING_PARAM
@@ -74,6 +106,10 @@ static const AVOption options[] = {
     { "localaddr",      "Local address",                                   OFFSET(localaddr),      AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",          "Block list",                                      OFFSET(block),          AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "fifo_size",      "Receive ring buffer size (in bytes), 0 to disable the receive thread", OFFSET(fifo_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, .flags = D },
+    { "overrun_nonfatal", "Drop packets instead of failing when the receive ring buffer overruns", OFFSET(overrun_nonfatal), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, .flags = D },
+    { "tx_batch",       "Number of datagrams queued and sent together",    OFFSET(tx_batch),       AV_OPT_TYPE_INT,    { .i64 =  0 },     0, 1024,    .flags = E },
+    { "bitrate",        "Maximum output bitrate (in bits per second), 0 for no pacing", OFFSET(bitrate), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, .flags = E },
     { NULL }
 };
 
@@ -84,6 +120,8 @@ static const AVClass udp_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+static int udp_drain(URLContext *h);
+
 static void log_net_error(void *ctx, int level, const char* prefix)
 {
     char errbuf[100];
@@ -366,6 +404,10 @@ int ff_udp_set_remote_url(URLContext *h, const char *uri)
     int port;
     const char *p;
 
+    /* datagrams already queued belong to the previous destination */
+    if (s->tx_count)
+        udp_drain(h);
+
     av_url_split(NULL, 0, NULL, 0, hostname, sizeof(hostname), &port, NULL, 0, uri);
 
     /* set the destination address */
@@ -436,6 +478,347 @@ static int parse_source_list(char *buf, char **sources, int *num_sources,
     return 0;
 }
 
+#if HAVE_PTHREADS
+/**
+ * Receive the datagrams currently queued on the socket, in batches of up to
+ * UDP_RX_BATCH, into s->rx_buf.
+ *
+ * @return the number of datagrams received, their sizes in len
+ */
+static int udp_recv_batch(UDPContext *s, int len[UDP_RX_BATCH])
+{
+#if HAVE_RECVMMSG
+    struct mmsghdr msgs[UDP_RX_BATCH] = { { { 0 } } };
+    struct iovec iov[UDP_RX_BATCH];
+    int i, ret;
+
+    for (i = 0; i < UDP_RX_BATCH; i++) {
+        iov[i].iov_base             = s->rx_buf + i * UDP_MAX_PKT_SIZE;
+        iov[i].iov_len              = UDP_MAX_PKT_SIZE;
+        msgs[i].msg_hdr.msg_iov     = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    ret = recvmmsg(s->udp_fd, msgs, UDP_RX_BATCH, MSG_DONTWAIT, NULL);
+    if (ret < 0)
+        return ff_neterrno();
+
+    for (i = 0; i < ret; i++)
+        len[i] = msgs[i].msg_len;
+    return ret;
+#else
+    int ret = recv(s->udp_fd, s->rx_buf, UDP_MAX_PKT_SIZE, 0);
+    if (ret < 0)
+        return ff_neterrno();
+
+    len[0] = ret;
+    return 1;
+#endif
+}
+
+static void *circular_buffer_task(void *arg)
+{
+    URLContext *h = arg;
+    UDPContext *s = h->priv_data;
+    int len[UDP_RX_BATCH];
+    int i, ret;
+
+    for (;;) {
+        pthread_mutex_lock(&s->mutex);
+        if (s->close_req) {
+            pthread_mutex_unlock(&s->mutex);
+            break;
+        }
+        pthread_mutex_unlock(&s->mutex);
+
+        ret = ff_network_wait_fd(s->udp_fd, 0);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR(EINTR))
+            continue;
+        if (ret >= 0)
+            ret = udp_recv_batch(s, len);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR(EINTR))
+            continue;
+
+        pthread_mutex_lock(&s->mutex);
+        if (ret < 0) {
+            s->circular_buffer_error = ret;
+            pthread_cond_signal(&s->cond);
+            pthread_mutex_unlock(&s->mutex);
+            break;
+        }
+        for (i = 0; i < ret; i++) {
+            uint8_t hdr[4];
+
+            if (av_fifo_space(s->fifo) < len[i] + 4) {
+                if (s->overrun_nonfatal) {
+                    av_log(h, AV_LOG_WARNING,
+                           "Circular buffer overrun, dropping packet.\n");
+                    continue;
+                }
+                av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                       "Surviving with overrun_nonfatal=1 is possible, "
+                       "or increase fifo_size.\n");
+                s->circular_buffer_error = AVERROR(EIO);
+                break;
+            }
+            AV_WL32(hdr, len[i]);
+            av_fifo_generic_write(s->fifo, hdr, 4, NULL);
+            av_fifo_generic_write(s->fifo, s->rx_buf + i * UDP_MAX_PKT_SIZE,
+                                  len[i], NULL);
+        }
+        pthread_cond_signal(&s->cond);
+        ret = s->circular_buffer_error;
+        pthread_mutex_unlock(&s->mutex);
+        if (ret < 0)
+            break;
+    }
+
+    return NULL;
+}
+
+static int udp_start_receiver(URLContext *h)
+{
+    UDPContext *s = h->priv_data;
+    int ret;
+
+    s->fifo   = av_fifo_alloc(s->fifo_size);
+    s->rx_buf = av_malloc((HAVE_RECVMMSG ? UDP_RX_BATCH : 1) * UDP_MAX_PKT_SIZE);
+    if (!s->fifo || !s->rx_buf)
+        return AVERROR(ENOMEM);
+
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    ret = pthread_create(&s->receiver_thread, NULL, circular_buffer_task, h);
+    if (ret) {
+        av_log(h, AV_LOG_ERROR, "pthread_create failed: %s\n", strerror(ret));
+        pthread_cond_destroy(&s->cond);
+        pthread_mutex_destroy(&s->mutex);
+        return AVERROR(ret);
+    }
+    s->thread_started = 1;
+
+    return 0;
+}
+
+static void udp_stop_receiver(URLContext *h)
+{
+    UDPContext *s = h->priv_data;
+
+    if (s->thread_started) {
+        pthread_mutex_lock(&s->mutex);
+        s->close_req = 1;
+        pthread_mutex_unlock(&s->mutex);
+        pthread_join(s->receiver_thread, NULL);
+        pthread_cond_destroy(&s->cond);
+        pthread_mutex_destroy(&s->mutex);
+        s->thread_started = 0;
+    }
+    av_fifo_free(s->fifo);
+    s->fifo = NULL;
+    av_freep(&s->rx_buf);
+}
+
+static int udp_read_fifo(URLContext *h, uint8_t *buf, int size)
+{
+    UDPContext *s = h->priv_data;
+    int ret;
+
+    pthread_mutex_lock(&s->mutex);
+    for (;;) {
+        if (av_fifo_size(s->fifo)) {
+            uint8_t hdr[4];
+            int len;
+
+            av_fifo_generic_read(s->fifo, hdr, 4, NULL);
+            len = AV_RL32(hdr);
+            if (len > size) {
+                av_log(h, AV_LOG_WARNING,
+                       "Part of datagram lost due to insufficient buffer size\n");
+                av_fifo_generic_read(s->fifo, buf, size, NULL);
+                av_fifo_drain(s->fifo, len - size);
+                len = size;
+            } else {
+                av_fifo_generic_read(s->fifo, buf, len, NULL);
+            }
+            ret = len;
+            break;
+        } else if (s->circular_buffer_error) {
+            ret = s->circular_buffer_error;
+            break;
+        } else if (h->flags & AVIO_FLAG_NONBLOCK) {
+            ret = AVERROR(EAGAIN);
+            break;
+        } else {
+            /* wake up regularly so that the caller can check its
+             * interrupt callback */
+            int64_t t = av_gettime() + POLLING_TIME * 1000;
+            struct timespec tv = { .tv_sec  =  t / 1000000,
+                                   .tv_nsec = (t % 1000000) * 1000 };
+            if (pthread_cond_timedwait(&s->cond, &s->mutex, &tv) == ETIMEDOUT &&
+                !av_fifo_size(s->fifo) && !s->circular_buffer_error) {
+                ret = AVERROR(EAGAIN);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s->mutex);
+
+    return ret;
+}
+#endif
+
+static int udp_alloc_tx_queue(URLContext *h)
+{
+    UDPContext *s = h->priv_data;
+
+    s->tx_batch = FFMAX(s->tx_batch, 1);
+    s->tx_buf   = av_malloc_array(s->tx_batch, h->max_packet_size);
+    s->tx_len   = av_malloc_array(s->tx_batch, sizeof(*s->tx_len));
+    if (!s->tx_buf || !s->tx_len)
+        return AVERROR(ENOMEM);
+#if HAVE_SENDMMSG
+    s->tx_msgs = av_mallocz_array(s->tx_batch, sizeof(*s->tx_msgs));
+    s->tx_iov  = av_mallocz_array(s->tx_batch, sizeof(*s->tx_iov));
+    if (!s->tx_msgs || !s->tx_iov)
+        return AVERROR(ENOMEM);
+#endif
+
+    return 0;
+}
+
+static void udp_free_tx_queue(UDPContext *s)
+{
+    av_freep(&s->tx_buf);
+    av_freep(&s->tx_len);
+#if HAVE_SENDMMSG
+    av_freep(&s->tx_msgs);
+    av_freep(&s->tx_iov);
+#endif
+}
+
+/**
+ * Send the queued datagrams starting at index first.
+ *
+ * @return the number of datagrams sent, or a negative error code
+ */
+static int udp_send_queued(URLContext *h, int first)
+{
+    UDPContext *s = h->priv_data;
+    int ret;
+#if HAVE_SENDMMSG
+    int i;
+
+    for (i = first; i < s->tx_count; i++) {
+        struct msghdr *hdr = &s->tx_msgs[i].msg_hdr;
+
+        s->tx_iov[i].iov_base = s->tx_buf + i * h->max_packet_size;
+        s->tx_iov[i].iov_len  = s->tx_len[i];
+        hdr->msg_iov     = &s->tx_iov[i];
+        hdr->msg_iovlen  = 1;
+        hdr->msg_name    = s->is_connected ? NULL : &s->dest_addr;
+        hdr->msg_namelen = s->is_connected ? 0    : s->dest_addr_len;
+    }
+    ret = sendmmsg(s->udp_fd, s->tx_msgs + first, s->tx_count - first, 0);
+#else
+    const uint8_t *buf = s->tx_buf + first * h->max_packet_size;
+
+    if (!s->is_connected)
+        ret = sendto(s->udp_fd, buf, s->tx_len[first], 0,
+                     (struct sockaddr *) &s->dest_addr, s->dest_addr_len);
+    else
+        ret = send(s->udp_fd, buf, s->tx_len[first], 0);
+    if (ret >= 0)
+        ret = 1;
+#endif
+
+    return ret < 0 ? ff_neterrno() : ret;
+}
+
+/**
+ * Wait until the configured bitrate allows sending more data.
+ *
+ * @return 0, or AVERROR(EAGAIN) in non-blocking mode if it is too early
+ */
+static int udp_pace(URLContext *h)
+{
+    UDPContext *s = h->priv_data;
+    int64_t now = av_gettime_relative();
+
+    if (s->tx_next > now) {
+        if (h->flags & AVIO_FLAG_NONBLOCK)
+            return AVERROR(EAGAIN);
+        av_usleep(s->tx_next - now);
+    } else {
+        /* do not let idle periods build up credit for a later burst */
+        s->tx_next = now;
+    }
+    return 0;
+}
+
+static int udp_flush(URLContext *h)
+{
+    UDPContext *s = h->priv_data;
+    int64_t bytes = 0;
+    int sent = 0, ret = 0, i;
+
+    if (!s->tx_count)
+        return 0;
+
+    if (s->bitrate && (ret = udp_pace(h)) < 0)
+        return ret;
+
+    while (sent < s->tx_count) {
+        if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
+            ret = ff_network_wait_fd(s->udp_fd, 1);
+            if (ret == AVERROR(EAGAIN)) {
+                if (ff_check_interrupt(&h->interrupt_callback)) {
+                    ret = AVERROR_EXIT;
+                    break;
+                }
+                continue;
+            }
+            if (ret < 0)
+                break;
+        }
+        ret = udp_send_queued(h, sent);
+        if (ret < 0)
+            break;
+        for (i = sent; i < sent + ret; i++)
+            bytes += s->tx_len[i];
+        sent += ret;
+    }
+
+    if (s->bitrate)
+        s->tx_next += bytes * 8 * 1000000 / s->bitrate;
+
+    if (ret == AVERROR(EAGAIN) && sent < s->tx_count) {
+        /* keep what is left for the next call in non-blocking mode */
+        memmove(s->tx_buf, s->tx_buf + sent * h->max_packet_size,
+                (s->tx_count - sent) * h->max_packet_size);
+        memmove(s->tx_len, s->tx_len + sent,
+                (s->tx_count - sent) * sizeof(*s->tx_len));
+        s->tx_count -= sent;
+        return ret;
+    }
+
+    s->tx_count = 0;
+    return ret < 0 ? ret : 0;
+}
+
+/**
+ * Send all the queued datagrams, waiting for them even in non-blocking
+ * mode, before they would go to another destination or be dropped.
+ */
+static int udp_drain(URLContext *h)
+{
+    int flags = h->flags, ret;
+
+    h->flags &= ~AVIO_FLAG_NONBLOCK;
+    ret = udp_flush(h);
+    h->flags = flags;
+    return ret;
+}
+
 /* put it in UDP context */
 /* return non zero if error */
 static int udp_open(URLContext *h, const char *uri, int flags)
@@ -512,6 +895,18 @@ static int udp_open(URLContext *h, const char *uri, int flags)
                                   FF_ARRAY_ELEMS(exclude_sources)))
                 goto fail;
         }
+        if (av_find_info_tag(buf, sizeof(buf), "fifo_size", p)) {
+            s->fifo_size = strtol(buf, NULL, 10);
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "overrun_nonfatal", p)) {
+            s->overrun_nonfatal = strtol(buf, NULL, 10);
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "tx_batch", p)) {
+            s->tx_batch = strtol(buf, NULL, 10);
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "bitrate", p)) {
+            s->bitrate = strtoll(buf, NULL, 10);
+        }
     }
 
     /* fill the dest addr */
@@ -629,6 +1024,23 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         av_freep(&exclude_sources[i]);
 
     s->udp_fd = udp_fd;
+
+    if (is_output && (s->tx_batch > 1 || s->bitrate > 0)) {
+        if (udp_alloc_tx_queue(h) < 0) {
+            udp_free_tx_queue(s);
+            goto fail;
+        }
+    }
+
+#if HAVE_PTHREADS
+    if (!is_output && s->fifo_size > 0) {
+        if (udp_start_receiver(h) < 0) {
+            udp_stop_receiver(h);
+            goto fail;
+        }
+    }
+#endif
+
     return 0;
  fail:
     if (udp_fd >= 0)
@@ -645,6 +1057,11 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     UDPContext *s = h->priv_data;
     int ret;
 
+#if HAVE_PTHREADS
+    if (s->fifo)
+        return udp_read_fifo(h, buf, size);
+#endif
+
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 0);
         if (ret < 0)
@@ -659,6 +1076,25 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
     UDPContext *s = h->priv_data;
     int ret;
 
+    if (s->tx_buf) {
+        /* each queue slot holds at most max_packet_size bytes */
+        if (size > h->max_packet_size)
+            return AVERROR(EINVAL);
+        if (s->tx_count == s->tx_batch) {
+            ret = udp_flush(h);
+            if (ret < 0)
+                return ret;
+        }
+        memcpy(s->tx_buf + s->tx_count * h->max_packet_size, buf, size);
+        s->tx_len[s->tx_count++] = size;
+        if (s->tx_count == s->tx_batch) {
+            ret = udp_flush(h);
+            if (ret < 0 && ret != AVERROR(EAGAIN))
+                return ret;
+        }
+        return size;
+    }
+
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 1);
         if (ret < 0)
@@ -679,6 +1115,14 @@ static int udp_close(URLContext *h)
 {
     UDPContext *s = h->priv_data;
 
+#if HAVE_PTHREADS
+    udp_stop_receiver(h);
+#endif
+    if (s->tx_buf) {
+        udp_drain(h);
+        udp_free_tx_queue(s);
+    }
+
     if (s->is_multicast && (h->flags & AVIO_FLAG_READ))
         udp_leave_multicast_group(s->udp_fd, (struct sockaddr *)&s->dest_addr);
     closesocket(s->udp_fd);
@@ -692,6 +1136,7 @@ const URLProtocol ff_udp_protocol = {
     .url_write           = udp_write,
     .url_close           = udp_close,
     .url_get_file_handle = udp_get_file_handle,
+    .url_flush           = udp_flush,
     .priv_data_size      = sizeof(UDPContext),
     .flags               = URL_PROTOCOL_FLAG_NETWORK,
     .priv_data_class     = &udp_class,
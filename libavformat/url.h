@@ -85,6 +85,18 @@ typedef struct URLProtocol {
     int (*url_get_multi_file_handle)(URLContext *h, int **handles,
                                      int *numhandles);
     int (*url_shutdown)(URLContext *h, int flags);
+    /**
+     * Send out any data the protocol has queued internally, such as
+     * datagrams held back for a batched write.
+     */
+    int (*url_flush)(URLContext *h);
+    /**
+     * Read data without copying it: point *data to up to size bytes at the
+     * current position and advance past them. The data must stay valid
+     * until the context is closed. Return AVERROR(ENOSYS) if the resource
+     * is not mapped in memory.
+     */
+    int (*url_read_mapped)(URLContext *h, const uint8_t **data, int size);
     int priv_data_size;
     const AVClass *priv_data_class;
     int flags;
@@ -233,6 +245,25 @@ int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles);
  */
 int ffurl_shutdown(URLContext *h, int flags);
 
+/**
+ * Send out any data queued inside the protocol. Protocols that do not
+ * queue anything ignore this.
+ *
+ * @return a negative value if an error condition occurred, 0
+ * otherwise
+ */
+int ffurl_flush(URLContext *h);
+
+/**
+ * Read up to size bytes from a resource mapped in memory, without copying
+ * them.
+ *
+ * @param data set to the bytes read, valid until h is closed
+ * @return the number of bytes read, 0 at the end of the resource, or a
+ * negative AVERROR code; AVERROR(ENOSYS) if the resource is not mapped
+ */
+int ffurl_read_mapped(URLContext *h, const uint8_t **data, int size);
+
 /**
  * Check if the user has requested to interrupt a blocking function
  * associated with cb.
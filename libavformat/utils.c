@@ -41,6 +41,8 @@
 
 #include "audiointerleave.h"
 #include "avformat.h"
+#include "avio_internal.h"
+#include "http.h"
 #include "id3v2.h"
 #include "internal.h"
 #include "metadata.h"
@@ -116,11 +118,22 @@ static int append_packet_chunked(AVIOContext *s, AVPacket *pkt, int size)
 
 int av_get_packet(AVIOContext *s, AVPacket *pkt, int size)
 {
+    int ret;
+
     av_init_packet(pkt);
     pkt->data = NULL;
     pkt->size = 0;
     pkt->pos  = avio_tell(s);
 
+    ret = ffio_read_ref(s, size, &pkt->buf);
+    if (ret < 0)
+        return ret;
+    if (ret > 0) {
+        pkt->data = pkt->buf->data;
+        pkt->size = ret;
+        return ret;
+    }
+
     return append_packet_chunked(s, pkt, size);
 }
 
@@ -303,6 +316,10 @@ int avformat_open_input(AVFormatContext **ps, const char *filename,
     if ((ret = init_input(s, filename, &tmp)) < 0)
         goto fail;
 
+    if (s->pb && s->flags & AVFMT_FLAG_ZEROCOPY &&
+        !(s->flags & AVFMT_FLAG_CUSTOM_IO))
+        ffio_enable_buffer_refs(s->pb);
+
     /* Check filename in case an image number is expected. */
     if (s->iformat->flags & AVFMT_NEEDNUMBER) {
         if (!av_filename_number_test(filename)) {
@@ -3223,6 +3240,9 @@ int avformat_network_init(void)
 int avformat_network_deinit(void)
 {
 #if CONFIG_NETWORK
+#if CONFIG_HTTP_PROTOCOL || CONFIG_HTTPPROXY_PROTOCOL || CONFIG_HTTPS_PROTOCOL
+    ff_http_close_idle_connections();
+#endif
     ff_network_close();
     ff_tls_deinit();
 #endif
@@ -256,11 +256,16 @@ int avresample_set_compensation(AVAudioResampleContext *avr, int sample_delta,
     return 0;
 }
 
-static int resample(ResampleContext *c, void *dst, const void *src,
-                    int *consumed, int src_size, int dst_size, int update_ctx,
-                    int nearest_neighbour)
+/**
+ * Resample all the channels at once, so that the position in the source and
+ * the filter phase are computed once for each output sample and the taps of
+ * that phase are reused for every channel while they are in cache.
+ */
+static int resample(ResampleContext *c, uint8_t **dst, uint8_t * const *src,
+                    int channels, int *consumed, int src_size, int dst_size,
+                    int update_ctx, int nearest_neighbour)
 {
-    int dst_index;
+    int dst_index, ch;
     unsigned int index = c->index;
     int frac          = c->frac;
     int dst_incr_frac = c->dst_incr % c->src_incr;
@@ -279,7 +284,9 @@ static int resample(ResampleContext *c, void *dst, const void *src,
 
         if (dst) {
             for(dst_index = 0; dst_index < dst_size; dst_index++) {
-                c->resample_nearest(dst, dst_index, src, index2 >> 32);
+                for (ch = 0; ch < channels; ch++)
+                    c->resample_nearest(dst[ch], dst_index, src[ch],
+                                        index2 >> 32);
                 index2 += incr;
             }
         } else {
@@ -295,8 +302,11 @@ static int resample(ResampleContext *c, void *dst, const void *src,
             if (sample_index + c->filter_length > src_size)
                 break;
 
-            if (dst)
-                c->resample_one(c, dst, dst_index, src, index, frac);
+            if (dst) {
+                for (ch = 0; ch < channels; ch++)
+                    c->resample_one(c, dst[ch], dst_index, src[ch],
+                                    index, frac);
+            }
 
             frac  += dst_incr_frac;
             index += dst_incr;
@@ -403,7 +413,7 @@ int ff_audio_resample(ResampleContext *c, AudioData *dst, AudioData *src)
     /* calculate output size and reallocate output buffer if needed */
     /* TODO: try to calculate this without the dummy resample() run */
     if (!dst->read_only && dst->allow_realloc) {
-        out_samples = resample(c, NULL, NULL, NULL, c->buffer->nb_samples,
+        out_samples = resample(c, NULL, NULL, 0, NULL, c->buffer->nb_samples,
                                INT_MAX, 0, nearest_neighbour);
         ret = ff_audio_data_realloc(dst, out_samples);
         if (ret < 0) {
@@ -412,13 +422,10 @@ int ff_audio_resample(ResampleContext *c, AudioData *dst, AudioData *src)
         }
     }
 
-    /* resample each channel plane */
-    for (ch = 0; ch < c->buffer->channels; ch++) {
-        out_samples = resample(c, (void *)dst->data[ch],
-                               (const void *)c->buffer->data[ch], &consumed,
-                               c->buffer->nb_samples, dst->allocated_samples,
-                               ch + 1 == c->buffer->channels, nearest_neighbour);
-    }
+    /* resample all the channel planes */
+    out_samples = resample(c, dst->data, c->buffer->data, c->buffer->channels,
+                           &consumed, c->buffer->nb_samples,
+                           dst->allocated_samples, 1, nearest_neighbour);
     if (out_samples < 0) {
         av_log(c->avr, AV_LOG_ERROR, "error during resampling\n");
         return out_samples;
@@ -0,0 +1,290 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+/* the futex word must be a plain 32-bit integer, which the compat atomics
+ * do not provide */
+#define USE_FUTEX (HAVE_THREADS && HAVE_LINUX_FUTEX_H && HAVE_STDATOMIC_H)
+
+#if USE_FUTEX
+#define _GNU_SOURCE
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !USE_FUTEX
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
+#endif
+
+#include "common.h"
+#include "error.h"
+#include "mem.h"
+#include "spscqueue.h"
+
+/* keep the indices written by each side in separate cache lines */
+#define CACHE_LINE_SIZE 64
+
+/**
+ * The wakeup state of one side of the queue. The sleeping side raises
+ * waiting and sleeps as long as seq does not change; the other side only
+ * bumps seq and makes a system call when waiting is raised.
+ */
+typedef struct SPSCWaiter {
+    atomic_uint seq;
+    atomic_int  waiting;
+#if HAVE_THREADS && !USE_FUTEX
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+#endif
+} SPSCWaiter;
+
+struct AVSPSCQueue {
+    uint8_t *elems;
+    size_t   elem_size;
+    unsigned mask;
+    void   (*free_func)(void *elem);
+
+    atomic_int err_send;
+    atomic_int err_recv;
+
+    SPSCWaiter not_full;    ///< the sender waits here
+    SPSCWaiter not_empty;   ///< the receiver waits here
+
+    char pad0[CACHE_LINE_SIZE];
+    atomic_uint head;       ///< index of the next element to receive, written by the receiver
+    char pad1[CACHE_LINE_SIZE];
+    atomic_uint tail;       ///< index of the next element to send, written by the sender
+    char pad2[CACHE_LINE_SIZE];
+};
+
+#if HAVE_THREADS
+static void waiter_init(SPSCWaiter *w)
+{
+    atomic_init(&w->seq, 0);
+    atomic_init(&w->waiting, 0);
+#if !USE_FUTEX
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+#endif
+}
+
+static void waiter_uninit(SPSCWaiter *w)
+{
+#if !USE_FUTEX
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+#endif
+}
+
+/**
+ * Announce that the calling thread is about to sleep. The condition it
+ * waits for must be checked again after this, then waiter_wait() called with
+ * the returned value if it is still not met.
+ */
+static unsigned waiter_arm(SPSCWaiter *w)
+{
+    atomic_store(&w->waiting, 1);
+    return atomic_load(&w->seq);
+}
+
+static void waiter_wait(SPSCWaiter *w, unsigned seq)
+{
+#if USE_FUTEX
+    syscall(SYS_futex, &w->seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&w->lock);
+    while (atomic_load(&w->seq) == seq)
+        pthread_cond_wait(&w->cond, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+#endif
+}
+
+static void waiter_wake(SPSCWaiter *w)
+{
+    if (!atomic_load(&w->waiting))
+        return;
+
+    atomic_fetch_add(&w->seq, 1);
+#if USE_FUTEX
+    syscall(SYS_futex, &w->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+#endif
+}
+#else
+#define waiter_init(w)
+#define waiter_uninit(w)
+#define waiter_wake(w)
+#endif /* HAVE_THREADS */
+
+int av_spsc_queue_alloc(AVSPSCQueue **pq, unsigned nb_elems,
+                        size_t elem_size, void (*free_func)(void *elem))
+{
+    AVSPSCQueue *q;
+    unsigned size = 1;
+
+    if (!nb_elems || nb_elems > INT_MAX / 2 || !elem_size)
+        return AVERROR(EINVAL);
+    while (size < nb_elems)
+        size <<= 1;
+
+    q = av_mallocz(sizeof(*q));
+    if (!q)
+        return AVERROR(ENOMEM);
+
+    q->elems = av_malloc_array(size, elem_size);
+    if (!q->elems) {
+        av_free(q);
+        return AVERROR(ENOMEM);
+    }
+    q->elem_size = elem_size;
+    q->mask      = size - 1;
+    q->free_func = free_func;
+
+    atomic_init(&q->err_send, 0);
+    atomic_init(&q->err_recv, 0);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    waiter_init(&q->not_full);
+    waiter_init(&q->not_empty);
+
+    *pq = q;
+    return 0;
+}
+
+void av_spsc_queue_free(AVSPSCQueue **pq)
+{
+    AVSPSCQueue *q = *pq;
+
+    if (!q)
+        return;
+
+    av_spsc_queue_flush(q);
+    waiter_uninit(&q->not_full);
+    waiter_uninit(&q->not_empty);
+    av_freep(&q->elems);
+    av_freep(pq);
+}
+
+int av_spsc_queue_send(AVSPSCQueue *q, const void *elem, int flags)
+{
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned seq = 0;
+    int waiting = 0, ret = 0;
+
+    for (;;) {
+        if ((ret = atomic_load(&q->err_send)))
+            break;
+        if (tail - atomic_load(&q->head) <= q->mask)
+            break;
+        if (!HAVE_THREADS || flags & AV_SPSC_QUEUE_FLAG_NONBLOCK) {
+            ret = AVERROR(EAGAIN);
+            break;
+        }
+#if HAVE_THREADS
+        if (waiting)
+            waiter_wait(&q->not_full, seq);
+        seq     = waiter_arm(&q->not_full);
+        waiting = 1;
+#endif
+    }
+    if (waiting)
+        atomic_store(&q->not_full.waiting, 0);
+    if (ret)
+        return ret;
+
+    memcpy(q->elems + (tail & q->mask) * q->elem_size, elem, q->elem_size);
+    atomic_store(&q->tail, tail + 1);
+    waiter_wake(&q->not_empty);
+
+    return 0;
+}
+
+int av_spsc_queue_recv(AVSPSCQueue *q, void *elem, int flags)
+{
+    unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned seq = 0;
+    int waiting = 0, ret = 0;
+
+    for (;;) {
+        /* the sender sets the error after sending its last element, so
+         * loading it first guarantees that element is seen below */
+        int err = atomic_load(&q->err_recv);
+
+        if (atomic_load(&q->tail) != head)
+            break;
+        if ((ret = err))
+            break;
+        if (!HAVE_THREADS || flags & AV_SPSC_QUEUE_FLAG_NONBLOCK) {
+            ret = AVERROR(EAGAIN);
+            break;
+        }
+#if HAVE_THREADS
+        if (waiting)
+            waiter_wait(&q->not_empty, seq);
+        seq     = waiter_arm(&q->not_empty);
+        waiting = 1;
+#endif
+    }
+    if (waiting)
+        atomic_store(&q->not_empty.waiting, 0);
+    if (ret)
+        return ret;
+
+    memcpy(elem, q->elems + (head & q->mask) * q->elem_size, q->elem_size);
+    atomic_store(&q->head, head + 1);
+    waiter_wake(&q->not_full);
+
+    return 0;
+}
+
+void av_spsc_queue_set_err_send(AVSPSCQueue *q, int err)
+{
+    atomic_store(&q->err_send, err);
+    waiter_wake(&q->not_full);
+}
+
+void av_spsc_queue_set_err_recv(AVSPSCQueue *q, int err)
+{
+    atomic_store(&q->err_recv, err);
+    waiter_wake(&q->not_empty);
+}
+
+void av_spsc_queue_flush(AVSPSCQueue *q)
+{
+    unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned tail = atomic_load(&q->tail);
+
+    if (q->free_func)
+        for (; head != tail; head++)
+            q->free_func(q->elems + (head & q->mask) * q->elem_size);
+    atomic_store(&q->head, tail);
+    waiter_wake(&q->not_full);
+}
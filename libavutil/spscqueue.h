@@ -0,0 +1,126 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * @ingroup lavu_spscqueue
+ * Lock-free single-producer single-consumer queue
+ */
+
+#ifndef AVUTIL_SPSCQUEUE_H
+#define AVUTIL_SPSCQUEUE_H
+
+#include <stddef.h>
+
+/**
+ * @defgroup lavu_spscqueue SPSC queue
+ * @ingroup lavu_data
+ *
+ * A bounded queue of fixed-size elements, meant to hand packets, frames or
+ * references to them over from one thread to another.
+ *
+ * Exactly one thread may send elements and exactly one thread may receive
+ * them at any given time. Under that constraint, sending and receiving do not
+ * take any lock: a thread only sleeps when the queue is full (sender) or empty
+ * (receiver) and the other side then wakes it up, with a futex where
+ * available.
+ *
+ * Either side may terminate the queue by setting an error code for the other
+ * side, e.g. AVERROR_EOF for the receiver once the last element is sent.
+ *
+ * @{
+ */
+
+typedef struct AVSPSCQueue AVSPSCQueue;
+
+/**
+ * Do not wait when the queue is full (sending) or empty (receiving), return
+ * AVERROR(EAGAIN) instead.
+ */
+#define AV_SPSC_QUEUE_FLAG_NONBLOCK (1 << 0)
+
+/**
+ * Allocate a new queue.
+ *
+ * @param queue     on success, the newly allocated queue is written here
+ * @param nb_elems  the maximum number of elements in the queue, rounded up to
+ *                  a power of two
+ * @param elem_size the size in bytes of one element
+ * @param free_func if not NULL, a function called on the elements remaining
+ *                  in the queue when it is flushed or freed, e.g. to unref
+ *                  packets
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_spsc_queue_alloc(AVSPSCQueue **queue, unsigned nb_elems,
+                        size_t elem_size, void (*free_func)(void *elem));
+
+/**
+ * Free a queue and set the pointer to NULL. The elements remaining in the
+ * queue are passed to its free_func. No other thread may use the queue
+ * anymore.
+ */
+void av_spsc_queue_free(AVSPSCQueue **queue);
+
+/**
+ * Copy an element to the back of the queue. Must only be called by the
+ * sending thread.
+ *
+ * @param flags a combination of AV_SPSC_QUEUE_FLAG_*
+ * @return 0 on success, AVERROR(EAGAIN) if the queue is full and the
+ *         NONBLOCK flag was set or the build does not support threads, or
+ *         the error set by av_spsc_queue_set_err_send(), in which case the
+ *         element was not added
+ */
+int av_spsc_queue_send(AVSPSCQueue *queue, const void *elem, int flags);
+
+/**
+ * Move the element at the front of the queue to elem. Must only be called
+ * by the receiving thread.
+ *
+ * @param flags a combination of AV_SPSC_QUEUE_FLAG_*
+ * @return 0 on success, AVERROR(EAGAIN) if the queue is empty and the
+ *         NONBLOCK flag was set or the build does not support threads, or
+ *         the error set by av_spsc_queue_set_err_recv() once the queue is
+ *         empty
+ */
+int av_spsc_queue_recv(AVSPSCQueue *queue, void *elem, int flags);
+
+/**
+ * Make all the following sends fail with err and wake the sending thread up
+ * if it is waiting. Typically called by the receiving thread when it stops.
+ */
+void av_spsc_queue_set_err_send(AVSPSCQueue *queue, int err);
+
+/**
+ * Make the receiving thread get err once the queue is empty and wake it up
+ * if it is waiting. Typically called by the sending thread after sending the
+ * last element.
+ */
+void av_spsc_queue_set_err_recv(AVSPSCQueue *queue, int err);
+
+/**
+ * Remove all the elements of the queue, passing them to its free_func. Must
+ * only be called by the receiving thread.
+ */
+void av_spsc_queue_flush(AVSPSCQueue *queue);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_SPSCQUEUE_H */
@@ -0,0 +1,164 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This test program checks the capacity and the termination of a queue in a
+ * single thread, then streams elements from one thread to another through a
+ * small queue, so that both sides keep going to sleep, and checks that they
+ * arrive complete and in order.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/spscqueue.h"
+#include "libavutil/thread.h"
+
+#define NB_ELEMS 200000
+
+typedef struct Elem {
+    int index;
+    int check;
+} Elem;
+
+static int nb_freed;
+
+static void free_elem(void *elem)
+{
+    nb_freed++;
+}
+
+static int test_single_thread(void)
+{
+    AVSPSCQueue *q;
+    Elem e = { 0 };
+    int i, errors = 0;
+
+    if (av_spsc_queue_alloc(&q, 3, sizeof(e), free_elem) < 0)
+        return 1;
+
+    /* the capacity is rounded up to 4 */
+    for (i = 0; i < 4; i++) {
+        e.index = i;
+        if (av_spsc_queue_send(q, &e, AV_SPSC_QUEUE_FLAG_NONBLOCK) < 0)
+            errors++;
+    }
+    if (av_spsc_queue_send(q, &e, AV_SPSC_QUEUE_FLAG_NONBLOCK) != AVERROR(EAGAIN))
+        errors++;
+
+    if (av_spsc_queue_recv(q, &e, AV_SPSC_QUEUE_FLAG_NONBLOCK) < 0 || e.index)
+        errors++;
+
+    av_spsc_queue_set_err_recv(q, AVERROR_EOF);
+    for (i = 1; i < 4; i++)
+        if (av_spsc_queue_recv(q, &e, 0) < 0 || e.index != i)
+            errors++;
+    if (av_spsc_queue_recv(q, &e, 0) != AVERROR_EOF)
+        errors++;
+
+    av_spsc_queue_set_err_send(q, AVERROR_EXIT);
+    if (av_spsc_queue_send(q, &e, 0) != AVERROR_EXIT)
+        errors++;
+
+    av_spsc_queue_free(&q);
+
+    if (av_spsc_queue_alloc(&q, 8, sizeof(e), free_elem) < 0)
+        return 1;
+    for (i = 0; i < 5; i++)
+        av_spsc_queue_send(q, &e, 0);
+    av_spsc_queue_free(&q);
+    if (nb_freed != 5)
+        errors++;
+
+    return errors;
+}
+
+#if HAVE_THREADS
+static void *sender(void *arg)
+{
+    AVSPSCQueue *q = arg;
+    Elem e;
+    int i;
+
+    for (i = 0; i < NB_ELEMS; i++) {
+        e.index = i;
+        e.check = i * 7;
+        if (av_spsc_queue_send(q, &e, 0) < 0)
+            break;
+    }
+    av_spsc_queue_set_err_recv(q, AVERROR_EOF);
+
+    return i == NB_ELEMS ? NULL : q;
+}
+
+static int test_threads(int nonblock, int stop_after)
+{
+    AVSPSCQueue *q;
+    pthread_t thread;
+    void *res;
+    Elem e;
+    int ret, next = 0, errors = 0;
+
+    if (av_spsc_queue_alloc(&q, 4, sizeof(e), NULL) < 0)
+        return 1;
+    if ((ret = pthread_create(&thread, NULL, sender, q))) {
+        fprintf(stderr, "pthread_create failed: %s.\n", strerror(ret));
+        av_spsc_queue_free(&q);
+        return 1;
+    }
+
+    while ((ret = av_spsc_queue_recv(q, &e, nonblock)) != AVERROR_EOF) {
+        if (ret == AVERROR(EAGAIN))
+            continue;
+        if (ret < 0 || e.index != next || e.check != next * 7)
+            errors++;
+        if (++next == stop_after) {
+            /* the sender must wake up and fail */
+            av_spsc_queue_set_err_send(q, AVERROR_EXIT);
+            break;
+        }
+    }
+    if (next != (stop_after ? stop_after : NB_ELEMS))
+        errors++;
+
+    pthread_join(thread, &res);
+    if (!res != !stop_after)
+        errors++;
+
+    av_spsc_queue_free(&q);
+    return errors;
+}
+#endif
+
+int main(void)
+{
+    int errors = test_single_thread();
+
+#if HAVE_THREADS
+    errors += test_threads(0, 0);
+    errors += test_threads(AV_SPSC_QUEUE_FLAG_NONBLOCK, 0);
+    errors += test_threads(0, 1000);
+#endif
+
+    if (errors) {
+        fprintf(stderr, "%d errors.\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This test program runs batches of jobs on a thread pool from several
+ * threads at once, including batches submitted from inside jobs, and checks
+ * that every job runs exactly once with a valid and exclusive thread index.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/thread.h"
+#include "libavutil/threadpool.h"
+
+#define NB_SUBMITTERS 3
+#define NB_JOBS       64
+#define NB_INNER_JOBS 8
+#define MAX_THREADS   3
+
+typedef struct Batch {
+    AVBufferRef *pool;
+    atomic_int   busy[MAX_THREADS];
+    atomic_int   progress;
+    atomic_int   errors;
+    int          rets[NB_JOBS];
+    int          level;
+} Batch;
+
+static int job(void *arg, int jobnr, int threadnr)
+{
+    Batch *b = arg;
+
+    if (threadnr < 0 || threadnr >= MAX_THREADS) {
+        atomic_fetch_add(&b->errors, 1);
+        return -1;
+    }
+    if (atomic_exchange(&b->busy[threadnr], 1))
+        atomic_fetch_add(&b->errors, 1);
+
+    /* jobs are started in order, so waiting for the previous one is safe */
+    if (!b->level)
+        while (atomic_load(&b->progress) < jobnr)
+            ;
+
+    if (!b->level && !(jobnr % 16)) {
+        Batch inner = { .pool = b->pool, .level = 1 };
+        int i;
+
+        av_thread_pool_execute(b->pool, job, &inner, inner.rets,
+                               NB_INNER_JOBS, MAX_THREADS);
+        for (i = 0; i < NB_INNER_JOBS; i++)
+            if (inner.rets[i] != i * 3)
+                atomic_fetch_add(&b->errors, 1);
+        atomic_fetch_add(&b->errors, atomic_load(&inner.errors));
+    }
+
+    atomic_store(&b->busy[threadnr], 0);
+    if (!b->level)
+        atomic_store(&b->progress, jobnr + 1);
+    return jobnr * 3;
+}
+
+static int run_batches(AVBufferRef *pool)
+{
+    int i, k, errors = 0;
+
+    for (k = 0; k < 20; k++) {
+        Batch b = { .pool = pool };
+
+        av_thread_pool_execute(pool, job, &b, b.rets, NB_JOBS, MAX_THREADS);
+        for (i = 0; i < NB_JOBS; i++)
+            if (b.rets[i] != i * 3)
+                errors++;
+        errors += atomic_load(&b.errors);
+    }
+    return errors;
+}
+
+#if HAVE_THREADS
+static void *thread_main(void *arg)
+{
+    AVBufferRef *pool = arg;
+
+    return run_batches(pool) ? pool : NULL;
+}
+#endif
+
+int main(void)
+{
+    AVBufferRef *pool;
+    int ret, errors;
+
+    if ((ret = av_thread_pool_create(&pool, 4, 0)) < 0) {
+        fprintf(stderr, "Could not create the thread pool.\n");
+        return 1;
+    }
+
+#if HAVE_THREADS
+    {
+        pthread_t threads[NB_SUBMITTERS];
+        int i;
+
+        for (i = 0; i < NB_SUBMITTERS; i++) {
+            if ((ret = pthread_create(&threads[i], NULL, thread_main, pool))) {
+                fprintf(stderr, "pthread_create failed: %s.\n", strerror(ret));
+                return 1;
+            }
+        }
+        errors = run_batches(pool);
+        for (i = 0; i < NB_SUBMITTERS; i++) {
+            void *res;
+            pthread_join(threads[i], &res);
+            if (res)
+                errors++;
+        }
+    }
+#else
+    errors = run_batches(pool);
+#endif
+
+    av_buffer_unref(&pool);
+
+    if (errors) {
+        fprintf(stderr, "%d errors.\n", errors);
+        return 2;
+    }
+    return 0;
+}
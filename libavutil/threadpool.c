@@ -0,0 +1,366 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#if HAVE_SCHED_GETAFFINITY
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
+
+#include "buffer.h"
+#include "common.h"
+#include "cpu.h"
+#include "error.h"
+#include "internal.h"
+#include "mem.h"
+#include "threadpool.h"
+
+/**
+ * A batch of jobs submitted by one av_thread_pool_execute() call. It lives
+ * on the stack of the submitting thread.
+ */
+typedef struct ThreadPoolBatch {
+    AVThreadPoolFunc *func;
+    void *arg;
+    int  *rets;
+    int   nb_jobs;
+    atomic_int next_job;
+
+    /* the fields below are protected by the pool lock */
+    int max_threads;
+    int next_slot;          ///< threadnr given to the next worker joining the batch
+    int nb_active;          ///< number of workers running jobs of the batch
+    int queue;              ///< index of the queue holding the batch, -1 if none
+    struct ThreadPoolBatch *prev, *next;
+} ThreadPoolBatch;
+
+typedef struct ThreadPoolWorker {
+    struct AVThreadPool *pool;
+    int index;
+    int cpu;                ///< CPU to pin the thread to, -1 for none
+
+    /* batches queued on this worker, oldest first, protected by the pool lock */
+    ThreadPoolBatch *head, *tail;
+
+#if HAVE_THREADS
+    pthread_t thread;
+#endif
+} ThreadPoolWorker;
+
+typedef struct AVThreadPool {
+    ThreadPoolWorker *workers;
+    int nb_workers;
+    int next_queue;
+    int done;
+
+#if HAVE_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cond;
+    pthread_cond_t  done_cond;
+#endif
+} AVThreadPool;
+
+static void run_jobs(ThreadPoolBatch *b, int threadnr)
+{
+    int job;
+
+    while ((job = atomic_fetch_add_explicit(&b->next_job, 1,
+                                            memory_order_relaxed)) < b->nb_jobs) {
+        int ret = b->func(b->arg, job, threadnr);
+        if (b->rets)
+            b->rets[job] = ret;
+    }
+}
+
+#if HAVE_THREADS
+static void queue_push(AVThreadPool *pool, int queue, ThreadPoolBatch *b)
+{
+    ThreadPoolWorker *w = &pool->workers[queue];
+
+    b->queue = queue;
+    b->prev  = w->tail;
+    b->next  = NULL;
+    if (w->tail)
+        w->tail->next = b;
+    else
+        w->head = b;
+    w->tail = b;
+}
+
+static void queue_remove(AVThreadPool *pool, ThreadPoolBatch *b)
+{
+    ThreadPoolWorker *w = &pool->workers[b->queue];
+
+    if (b->prev)
+        b->prev->next = b->next;
+    else
+        w->head = b->next;
+    if (b->next)
+        b->next->prev = b->prev;
+    else
+        w->tail = b->prev;
+    b->queue = -1;
+    b->prev  = b->next = NULL;
+}
+
+static int batch_exhausted(ThreadPoolBatch *b)
+{
+    return atomic_load_explicit(&b->next_job, memory_order_relaxed) >= b->nb_jobs;
+}
+
+/**
+ * Find a batch for a worker to join: the most recent one of its own queue,
+ * or else the oldest one of the other queues. Batches without any job left
+ * are dropped on the way. Must be called with the pool lock held.
+ */
+static ThreadPoolBatch *find_batch(AVThreadPool *pool, int self)
+{
+    int i;
+
+    for (i = 0; i < pool->nb_workers; i++) {
+        ThreadPoolWorker *w = &pool->workers[(self + i) % pool->nb_workers];
+
+        while (w->head) {
+            ThreadPoolBatch *b = i ? w->head : w->tail;
+            if (!batch_exhausted(b))
+                return b;
+            queue_remove(pool, b);
+        }
+    }
+    return NULL;
+}
+
+static void* attribute_align_arg worker(void *v)
+{
+    ThreadPoolWorker *w = v;
+    AVThreadPool  *pool = w->pool;
+
+#if HAVE_SCHED_GETAFFINITY && defined(CPU_SET)
+    if (w->cpu >= 0) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(w->cpu, &mask);
+        sched_setaffinity(0, sizeof(mask), &mask);
+    }
+#endif
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        ThreadPoolBatch *b;
+        int threadnr;
+
+        while (!pool->done && !(b = find_batch(pool, w->index)))
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        if (pool->done)
+            break;
+
+        threadnr = b->next_slot++;
+        b->nb_active++;
+        if (b->next_slot >= b->max_threads)
+            queue_remove(pool, b);
+        pthread_mutex_unlock(&pool->lock);
+
+        run_jobs(b, threadnr);
+
+        pthread_mutex_lock(&pool->lock);
+        if (b->queue >= 0)
+            queue_remove(pool, b);
+        if (!--b->nb_active)
+            pthread_cond_broadcast(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static void pool_stop(AVThreadPool *pool, int nb_started)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->done = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < nb_started; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+static void set_affinity(AVThreadPool *pool)
+{
+#if HAVE_SCHED_GETAFFINITY && defined(CPU_COUNT)
+    cpu_set_t mask;
+    int i, cpu = 0, nb_cpus;
+
+    if (sched_getaffinity(0, sizeof(mask), &mask))
+        return;
+    nb_cpus = CPU_COUNT(&mask);
+    if (!nb_cpus)
+        return;
+
+    for (i = 0; i < pool->nb_workers; i++) {
+        if (i % nb_cpus == 0)
+            cpu = 0;
+        while (!CPU_ISSET(cpu, &mask))
+            cpu++;
+        pool->workers[i].cpu = cpu++;
+    }
+#endif
+}
+#endif /* HAVE_THREADS */
+
+static void pool_free(void *opaque, uint8_t *data)
+{
+    AVThreadPool *pool = (AVThreadPool *)data;
+
+#if HAVE_THREADS
+    pool_stop(pool, pool->nb_workers);
+#endif
+    av_freep(&pool->workers);
+    av_freep(&pool);
+}
+
+int av_thread_pool_create(AVBufferRef **ppool, int nb_threads, int flags)
+{
+    AVThreadPool *pool;
+    AVBufferRef *buf;
+    int i;
+
+    if (nb_threads < 0)
+        return AVERROR(EINVAL);
+    if (!nb_threads)
+        nb_threads = av_cpu_count();
+#if !HAVE_THREADS
+    nb_threads = 0;
+#endif
+
+    pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return AVERROR(ENOMEM);
+
+    if (nb_threads) {
+        pool->workers = av_mallocz_array(nb_threads, sizeof(*pool->workers));
+        if (!pool->workers) {
+            av_free(pool);
+            return AVERROR(ENOMEM);
+        }
+    }
+    pool->nb_workers = nb_threads;
+    for (i = 0; i < nb_threads; i++) {
+        pool->workers[i].pool  = pool;
+        pool->workers[i].index = i;
+        pool->workers[i].cpu   = -1;
+    }
+
+#if HAVE_THREADS
+#if HAVE_W32THREADS
+    w32thread_init();
+#endif
+    if (flags & AV_THREAD_POOL_FLAG_AFFINITY)
+        set_affinity(pool);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    for (i = 0; i < nb_threads; i++) {
+        int ret = pthread_create(&pool->workers[i].thread, NULL, worker,
+                                 &pool->workers[i]);
+        if (ret) {
+            pool_stop(pool, i);
+            av_free(pool->workers);
+            av_free(pool);
+            return AVERROR(ret);
+        }
+    }
+#endif
+
+    buf = av_buffer_create((uint8_t *)pool, sizeof(*pool), pool_free, NULL, 0);
+    if (!buf) {
+        pool_free(NULL, (uint8_t *)pool);
+        return AVERROR(ENOMEM);
+    }
+
+    *ppool = buf;
+    return 0;
+}
+
+int av_thread_pool_nb_threads(AVBufferRef *ref)
+{
+    AVThreadPool *pool = (AVThreadPool *)ref->data;
+    return pool->nb_workers;
+}
+
+int av_thread_pool_execute(AVBufferRef *ref, AVThreadPoolFunc *func,
+                           void *arg, int *ret, int nb_jobs, int max_threads)
+{
+    AVThreadPool *pool = (AVThreadPool *)ref->data;
+    ThreadPoolBatch b = { 0 };
+
+    if (nb_jobs <= 0)
+        return 0;
+    if (max_threads <= 0 || max_threads > pool->nb_workers + 1)
+        max_threads = pool->nb_workers + 1;
+
+    b.func        = func;
+    b.arg         = arg;
+    b.rets        = ret;
+    b.nb_jobs     = nb_jobs;
+    b.max_threads = max_threads;
+    b.next_slot   = 1;
+    b.queue       = -1;
+    atomic_init(&b.next_job, 0);
+
+#if HAVE_THREADS
+    if (max_threads > 1 && nb_jobs > 1) {
+        pthread_mutex_lock(&pool->lock);
+        queue_push(pool, pool->next_queue, &b);
+        pool->next_queue = (pool->next_queue + 1) % pool->nb_workers;
+        pthread_cond_broadcast(&pool->work_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+#endif
+
+    run_jobs(&b, 0);
+
+#if HAVE_THREADS
+    if (max_threads > 1 && nb_jobs > 1) {
+        pthread_mutex_lock(&pool->lock);
+        if (b.queue >= 0)
+            queue_remove(pool, &b);
+        while (b.nb_active)
+            pthread_cond_wait(&pool->done_cond, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+    }
+#endif
+
+    return 0;
+}
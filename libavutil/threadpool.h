@@ -0,0 +1,112 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * @ingroup lavu_threadpool
+ * Shared pool of worker threads
+ */
+
+#ifndef AVUTIL_THREADPOOL_H
+#define AVUTIL_THREADPOOL_H
+
+#include "buffer.h"
+
+/**
+ * @defgroup lavu_threadpool Thread pool
+ * @ingroup lavu_data
+ *
+ * A pool of worker threads that can be shared by several codec contexts,
+ * filter graphs and scalers, so that the number of threads in a process
+ * stays bounded no matter how many of them are running.
+ *
+ * The pool is reference-counted with the AVBuffer mechanism: av_thread_pool_create()
+ * yields a reference, the users of the pool hold their own references and
+ * the worker threads are stopped once all of them have been released.
+ *
+ * Work is submitted in batches of jobs with av_thread_pool_execute(). Every
+ * worker keeps a queue of the batches submitted to it and idle workers take
+ * batches from the queues of busy ones, so several batches submitted
+ * concurrently from different threads share the pool. The submitting thread
+ * takes part in its own batch, so it is safe to submit a batch from inside
+ * a job.
+ *
+ * @{
+ */
+
+/**
+ * Pin each worker thread to one CPU of the process affinity mask. Only
+ * supported on some systems, ignored elsewhere.
+ */
+#define AV_THREAD_POOL_FLAG_AFFINITY (1 << 0)
+
+/**
+ * A job run by the thread pool.
+ *
+ * @param arg      the arg passed to av_thread_pool_execute()
+ * @param jobnr    the index of the job, 0 <= jobnr < nb_jobs
+ * @param threadnr the index of the thread running the job within the batch,
+ *                 0 <= threadnr < max_threads. No two jobs of a batch run
+ *                 concurrently with the same threadnr.
+ * @return a value stored in the ret array of av_thread_pool_execute()
+ */
+typedef int (AVThreadPoolFunc)(void *arg, int jobnr, int threadnr);
+
+/**
+ * Create a thread pool and start its worker threads.
+ *
+ * @param pool       on success, a reference to the newly created pool will be
+ *                   written here
+ * @param nb_threads the number of worker threads, 0 to use one per CPU
+ * @param flags      a combination of AV_THREAD_POOL_FLAG_*
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_thread_pool_create(AVBufferRef **pool, int nb_threads, int flags);
+
+/**
+ * @return the number of worker threads of the pool. It is 0 if the build
+ *         does not support threads.
+ */
+int av_thread_pool_nb_threads(AVBufferRef *pool);
+
+/**
+ * Run func nb_jobs times on the pool and wait for all the jobs to finish.
+ * The calling thread runs jobs too.
+ *
+ * Jobs are started in increasing jobnr order, so a job may wait for the
+ * progress of jobs with a lower jobnr.
+ *
+ * @param pool        a reference to the pool
+ * @param func        the function to run
+ * @param arg         an opaque pointer passed to func
+ * @param ret         if not NULL, an array of nb_jobs entries receiving the
+ *                    return value of each job
+ * @param nb_jobs     the number of jobs
+ * @param max_threads the maximum number of threads running the jobs of this
+ *                    batch concurrently, including the calling thread, or 0
+ *                    to allow all the worker threads of the pool
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_thread_pool_execute(AVBufferRef *pool, AVThreadPoolFunc *func,
+                           void *arg, int *ret, int nb_jobs, int max_threads);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_THREADPOOL_H */
@@ -31,6 +31,7 @@
 #include <stdint.h>
 
 #include "libavutil/avutil.h"
+#include "libavutil/buffer.h"
 #include "libavutil/log.h"
 #include "libavutil/pixfmt.h"
 #include "version.h"
@@ -152,6 +153,19 @@ struct SwsContext *sws_alloc_context(void);
  */
 int sws_init_context(struct SwsContext *sws_context, SwsFilter *srcFilter, SwsFilter *dstFilter);
 
+/**
+ * Make a threaded scaler context run its bands on a shared AVThreadPool
+ * (see libavutil/threadpool.h) instead of starting threads of its own.
+ * The "threads" option then limits the number of bands, zero meaning one
+ * more than the pool has threads.
+ *
+ * Must be called before sws_init_context(). The context takes a new
+ * reference to the pool.
+ *
+ * @return zero on success, a negative AVERROR code on failure
+ */
+int sws_set_thread_pool(struct SwsContext *c, AVBufferRef *pool);
+
 /**
  * Free the swscaler context swsContext.
  * If swsContext is NULL, then does nothing.
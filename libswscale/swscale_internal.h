@@ -25,6 +25,7 @@
 
 #include "libavutil/avassert.h"
 #include "libavutil/avutil.h"
+#include "libavutil/buffer.h"
 #include "libavutil/common.h"
 #include "libavutil/log.h"
 #include "libavutil/pixfmt.h"
@@ -537,6 +538,23 @@ typedef struct SwsContext {
     void (*chrConvertRange)(int16_t *dst1, int16_t *dst2, int width);
 
     int needs_hcscale; ///< Set if there are chroma planes to be converted.
+
+    /**
+     * @name Slice threading.
+     * A threaded context splits the destination into horizontal bands and
+     * hands each band to a child context, so that every worker has its own
+     * ring buffers and filter state.
+     */
+    //@{
+    int nb_threads;               ///< Number of threads requested by the user, 0 for autodetection.
+    struct SwsContext **slice_ctx; ///< Child contexts, one per destination band.
+    int nb_slice_ctx;             ///< Number of child contexts (and bands) in use.
+    int *slice_ret;               ///< sws_scale() return value of each child context.
+    struct SwsThreadContext *thread; ///< Worker threads driving the child contexts.
+    AVBufferRef *thread_pool;     ///< Shared thread pool used instead of the worker threads.
+    int dstSliceStart;            ///< First destination line output by this context.
+    int dstSliceEnd;              ///< Last destination line output by this context, plus one.
+    //@}
 } SwsContext;
 //FIXME check init (where 0)
 
@@ -734,4 +752,25 @@ void ff_sws_init_output_funcs(SwsContext *c,
 void ff_sws_init_swscale_ppc(SwsContext *c);
 void ff_sws_init_swscale_x86(SwsContext *c);
 
+typedef int (sws_action_func)(SwsContext *c, void *arg, int jobnr, int nb_jobs);
+
+/**
+ * Start the worker threads of a scaler context. Nothing is started if the
+ * context has a thread pool.
+ *
+ * @return the number of threads actually started, or a negative error code
+ */
+int ff_sws_thread_init(SwsContext *c, int nb_threads);
+
+/**
+ * Run func nb_jobs times, spreading the calls over the worker threads,
+ * and wait for all of them to finish.
+ *
+ * @param ret if not NULL, receives the return value of each job
+ */
+void ff_sws_thread_execute(SwsContext *c, sws_action_func *func, void *arg,
+                           int *ret, int nb_jobs);
+
+void ff_sws_thread_free(SwsContext *c);
+
 #endif /* SWSCALE_SWSCALE_INTERNAL_H */
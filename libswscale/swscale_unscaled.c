@@ -1205,6 +1205,21 @@ static int check_image_pointers(uint8_t *data[4], enum AVPixelFormat pix_fmt,
     return 1;
 }
 
+typedef struct SliceScaleArgs {
+    const uint8_t * const *src;
+    const int *srcStride;
+    uint8_t * const *dst;
+    const int *dstStride;
+} SliceScaleArgs;
+
+static int scale_band(SwsContext *c, void *arg, int jobnr, int nb_jobs)
+{
+    SliceScaleArgs *a = arg;
+
+    return sws_scale(c->slice_ctx[jobnr], a->src, a->srcStride, 0, c->srcH,
+                     a->dst, a->dstStride);
+}
+
 /**
  * swscale wrapper, so we don't need to export the SwsContext.
  * Assumes planar YUV to be in YUV order instead of YVU.
@@ -1232,6 +1247,19 @@ int attribute_align_arg sws_scale(struct SwsContext *c,
         return 0;
     }
 
+    /* whole frames are scaled band by band on the worker threads */
+    if (c->nb_slice_ctx && c->sliceDir == 0 &&
+        srcSliceY == 0 && srcSliceH == c->srcH) {
+        SliceScaleArgs args = { srcSlice, srcStride, dst, dstStride };
+
+        ff_sws_thread_execute(c, scale_band, &args, c->slice_ret,
+                              c->nb_slice_ctx);
+        for (i = 0; i < c->nb_slice_ctx; i++)
+            if (c->slice_ret[i] <= 0)
+                return c->slice_ret[i];
+        return c->dstH;
+    }
+
     if (c->sliceDir == 0 && srcSliceY != 0 && srcSliceY + srcSliceH != c->srcH) {
         av_log(c, AV_LOG_ERROR, "Slices start in the middle!\n");
         return 0;
@@ -46,6 +46,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/ppc/cpu.h"
+#include "libavutil/threadpool.h"
 #include "libavutil/x86/asm.h"
 #include "libavutil/x86/cpu.h"
 #include "rgb2rgb.h"
@@ -805,6 +806,12 @@ int sws_setColorspaceDetails(struct SwsContext *c, const int inv_table[4],
 {
     const AVPixFmtDescriptor *desc_dst = av_pix_fmt_desc_get(c->dstFormat);
     const AVPixFmtDescriptor *desc_src = av_pix_fmt_desc_get(c->srcFormat);
+    int i;
+
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_setColorspaceDetails(c->slice_ctx[i], inv_table, srcRange, table,
+                                 dstRange, brightness, contrast, saturation);
+
     memcpy(c->srcColorspaceTable, inv_table, sizeof(int) * 4);
     memcpy(c->dstColorspaceTable, table, sizeof(int) * 4);
 
@@ -879,6 +886,84 @@ SwsContext *sws_alloc_context(void)
     return c;
 }
 
+#if !HAVE_THREADS
+int ff_sws_thread_init(SwsContext *c, int nb_threads)
+{
+    return 1;
+}
+
+void ff_sws_thread_execute(SwsContext *c, sws_action_func *func, void *arg,
+                           int *ret, int nb_jobs)
+{
+}
+
+void ff_sws_thread_free(SwsContext *c)
+{
+}
+#endif
+
+/**
+ * Split the destination into bands and set up one child context per band.
+ * Band boundaries are aligned to the destination chroma subsampling so that
+ * each chroma line is written by exactly one child.
+ */
+static av_cold int init_slice_contexts(SwsContext *c, SwsFilter *srcFilter,
+                                       SwsFilter *dstFilter)
+{
+    int nb_threads = c->nb_threads;
+    int align      = 1 << c->chrDstVSubSample;
+    int i, ret;
+
+    if (!nb_threads)
+        nb_threads = c->thread_pool ? av_thread_pool_nb_threads(c->thread_pool) + 1 :
+                                      av_cpu_count();
+    /* keep bands tall enough that the overlapping filter taps do not
+     * dominate the work done per band */
+    nb_threads = FFMIN(nb_threads, c->dstH / 16);
+    if (nb_threads <= 1)
+        return 0;
+
+    ret = ff_sws_thread_init(c, nb_threads);
+    if (ret <= 1)
+        return ret < 0 ? ret : 0;
+    nb_threads = ret;
+
+    c->slice_ctx = av_mallocz(nb_threads * sizeof(*c->slice_ctx));
+    c->slice_ret = av_mallocz(nb_threads * sizeof(*c->slice_ret));
+    if (!c->slice_ctx || !c->slice_ret)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < nb_threads; i++) {
+        SwsContext *s = sws_alloc_context();
+        if (!s)
+            return AVERROR(ENOMEM);
+        c->slice_ctx[c->nb_slice_ctx++] = s;
+
+        s->flags     = c->flags;
+        s->srcW      = c->srcW;
+        s->srcH      = c->srcH;
+        s->dstW      = c->dstW;
+        s->dstH      = c->dstH;
+        s->srcFormat = c->srcFormat;
+        s->dstFormat = c->dstFormat;
+        s->param[0]  = c->param[0];
+        s->param[1]  = c->param[1];
+        sws_setColorspaceDetails(s, c->srcColorspaceTable, c->srcRange,
+                                 c->dstColorspaceTable, c->dstRange,
+                                 c->brightness, c->contrast, c->saturation);
+
+        ret = sws_init_context(s, srcFilter, dstFilter);
+        if (ret < 0)
+            return ret;
+
+        s->dstSliceStart = (int64_t)c->dstH *  i      / nb_threads & ~(align - 1);
+        s->dstSliceEnd   = i == nb_threads - 1 ? c->dstH :
+                           (int64_t)c->dstH * (i + 1) / nb_threads & ~(align - 1);
+    }
+
+    return 0;
+}
+
 av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
                              SwsFilter *dstFilter)
 {
@@ -893,10 +978,24 @@ av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
     int dst_stride        = FFALIGN(dstW * sizeof(int16_t) + 16, 16);
     int dst_stride_px     = dst_stride >> 1;
     int flags, cpu_flags;
-    enum AVPixelFormat srcFormat = c->srcFormat;
-    enum AVPixelFormat dstFormat = c->dstFormat;
-    const AVPixFmtDescriptor *desc_src = av_pix_fmt_desc_get(srcFormat);
-    const AVPixFmtDescriptor *desc_dst = av_pix_fmt_desc_get(dstFormat);
+    enum AVPixelFormat srcFormat, dstFormat;
+    const AVPixFmtDescriptor *desc_src, *desc_dst;
+
+    /* contexts configured through AVOptions do not go through
+     * sws_getContext(), so apply its setup here */
+    if (handle_jpeg(&c->srcFormat))
+        c->srcRange = 1;
+    if (handle_jpeg(&c->dstFormat))
+        c->dstRange = 1;
+    if (!c->contrast && !c->saturation)
+        sws_setColorspaceDetails(c, ff_yuv2rgb_coeffs[SWS_CS_DEFAULT], c->srcRange,
+                                 ff_yuv2rgb_coeffs[SWS_CS_DEFAULT],
+                                 c->dstRange, 0, 1 << 16, 1 << 16);
+
+    srcFormat = c->srcFormat;
+    dstFormat = c->dstFormat;
+    desc_src  = av_pix_fmt_desc_get(srcFormat);
+    desc_dst  = av_pix_fmt_desc_get(dstFormat);
 
     cpu_flags = av_get_cpu_flags();
     flags     = c->flags;
@@ -1323,7 +1422,12 @@ av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
                c->chrXInc, c->chrYInc);
     }
 
-    c->swscale = ff_getSwsFunc(c);
+    c->swscale       = ff_getSwsFunc(c);
+    c->dstSliceStart = 0;
+    c->dstSliceEnd   = dstH;
+
+    if (c->nb_threads != 1)
+        return init_slice_contexts(c, srcFilter, dstFilter);
     return 0;
 fail: // FIXME replace things by appropriate error codes
     return -1;
@@ -1689,12 +1793,30 @@ void sws_freeFilter(SwsFilter *filter)
     av_free(filter);
 }
 
+int sws_set_thread_pool(SwsContext *c, AVBufferRef *pool)
+{
+    av_buffer_unref(&c->thread_pool);
+    if (pool) {
+        c->thread_pool = av_buffer_ref(pool);
+        if (!c->thread_pool)
+            return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
 void sws_freeContext(SwsContext *c)
 {
     int i;
     if (!c)
         return;
 
+    ff_sws_thread_free(c);
+    av_buffer_unref(&c->thread_pool);
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_freeContext(c->slice_ctx[i]);
+    av_freep(&c->slice_ctx);
+    av_freep(&c->slice_ret);
+
     if (c->lumPixBuf) {
         for (i = 0; i < c->vLumBufSize; i++)
             av_freep(&c->lumPixBuf[i]);
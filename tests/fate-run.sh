@@ -83,7 +83,7 @@ probestream(){
 
 avconv(){
     dec_opts="-hwaccel $hwaccel -threads $threads -thread_type $thread_type"
-    avconv_args="-nostats -cpuflags $cpuflags"
+    avconv_args="-nostats -cpuflags $cpuflags -filter_threads $threads"
     for arg in $@; do
         [ x${arg} = x-i ] && avconv_args="${avconv_args} ${dec_opts}"
         avconv_args="${avconv_args} ${arg}"
@@ -7,6 +7,15 @@ fate-filter-yadif-mode0: CMD = framecrc -flags bitexact -idct simple -i $(TARGET
 FATE_YADIF += fate-filter-yadif-mode1
 fate-filter-yadif-mode1: CMD = framecrc -flags bitexact -idct simple -i $(TARGET_SAMPLES)/mpeg2/mpeg2_field_encoding.ts -vf yadif=1
 
+# slice threaded filters must give the same output as unthreaded ones
+FATE_YADIF += fate-filter-yadif-mode0-threads
+fate-filter-yadif-mode0-threads: CMD = framecrc -filter_threads 4 -flags bitexact -idct simple -i $(TARGET_SAMPLES)/mpeg2/mpeg2_field_encoding.ts -vf yadif=0
+fate-filter-yadif-mode0-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-yadif-mode0
+
+FATE_YADIF += fate-filter-yadif-mode1-threads
+fate-filter-yadif-mode1-threads: CMD = framecrc -filter_threads 4 -flags bitexact -idct simple -i $(TARGET_SAMPLES)/mpeg2/mpeg2_field_encoding.ts -vf yadif=1
+fate-filter-yadif-mode1-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-yadif-mode1
+
 FATE_FILTER-$(call FILTERDEMDEC, YADIF, MPEGTS, MPEG2VIDEO) += $(FATE_YADIF)
 
 FATE_SAMPLES_AVCONV += $(FATE_FILTER-yes)
@@ -15,12 +24,24 @@ FATE_SAMPLES_AVCONV += $(FATE_FILTER-yes)
 FATE_FILTER_VSYNTH-$(CONFIG_BOXBLUR_FILTER) += fate-filter-boxblur
 fate-filter-boxblur: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf boxblur=2:1
 
+FATE_FILTER_VSYNTH-$(CONFIG_BOXBLUR_FILTER) += fate-filter-boxblur-threads
+fate-filter-boxblur-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf boxblur=2:1
+fate-filter-boxblur-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-boxblur
+
 FATE_FILTER_VSYNTH-$(CONFIG_DRAWBOX_FILTER) += fate-filter-drawbox
 fate-filter-drawbox: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf drawbox=10:20:200:60:red@0.5
 
+FATE_FILTER_VSYNTH-$(CONFIG_DRAWBOX_FILTER) += fate-filter-drawbox-threads
+fate-filter-drawbox-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf drawbox=10:20:200:60:red@0.5
+fate-filter-drawbox-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-drawbox
+
 FATE_FILTER_VSYNTH-$(CONFIG_FADE_FILTER) += fate-filter-fade
 fate-filter-fade: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf fade=in:0:25,fade=out:25:25
 
+FATE_FILTER_VSYNTH-$(CONFIG_FADE_FILTER) += fate-filter-fade-threads
+fate-filter-fade-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf fade=in:0:25,fade=out:25:25
+fate-filter-fade-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-fade
+
 FATE_FILTER_VSYNTH-$(call ALLYES, INTERLACE_FILTER FIELDORDER_FILTER) += fate-filter-fieldorder
 fate-filter-fieldorder: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf interlace=tff,fieldorder=bff -sws_flags +accurate_rnd+bitexact
 
@@ -35,6 +56,10 @@ $(foreach MODE,$(FPMODES),$(eval $(call FATE_FPFILTER_SUITE,$(MODE))))
 FATE_FILTER_VSYNTH-$(CONFIG_GRADFUN_FILTER) += fate-filter-gradfun
 fate-filter-gradfun: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf gradfun
 
+FATE_FILTER_VSYNTH-$(CONFIG_GRADFUN_FILTER) += fate-filter-gradfun-threads
+fate-filter-gradfun-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf gradfun
+fate-filter-gradfun-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-gradfun
+
 FATE_FILTER_VSYNTH-$(CONFIG_HQDN3D_FILTER) += fate-filter-hqdn3d
 fate-filter-hqdn3d: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf hqdn3d
 
@@ -44,6 +69,10 @@ fate-filter-interlace: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf interlace
 FATE_FILTER_VSYNTH-$(CONFIG_NEGATE_FILTER) += fate-filter-negate
 fate-filter-negate: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf negate
 
+FATE_FILTER_VSYNTH-$(CONFIG_NEGATE_FILTER) += fate-filter-negate-threads
+fate-filter-negate-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf negate
+fate-filter-negate-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-negate
+
 FATE_FILTER_VSYNTH-$(CONFIG_OVERLAY_FILTER) += fate-filter-overlay
 fate-filter-overlay: tests/data/filtergraphs/overlay
 fate-filter-overlay: CMD = framecrc -c:v pgmyuv -i $(SRC) -c:v pgmyuv -i $(SRC) -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/overlay
@@ -84,6 +113,10 @@ FATE_FILTER_VSYNTH-$(CONFIG_TRIM_FILTER) += $(FATE_TRIM)
 FATE_FILTER_VSYNTH-$(CONFIG_UNSHARP_FILTER) += fate-filter-unsharp
 fate-filter-unsharp: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf unsharp
 
+FATE_FILTER_VSYNTH-$(CONFIG_UNSHARP_FILTER) += fate-filter-unsharp-threads
+fate-filter-unsharp-threads: CMD = framecrc -filter_threads 4 -c:v pgmyuv -i $(SRC) -vf unsharp
+fate-filter-unsharp-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-unsharp
+
 
 FATE_FILTER_VSYNTH-$(CONFIG_CROP_FILTER) += fate-filter-crop
 fate-filter-crop: CMD = video_filter "crop=iw-100:ih-100:100:100"
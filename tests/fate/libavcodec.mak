@@ -3,6 +3,10 @@ fate-golomb: libavcodec/tests/golomb$(EXESUF)
 fate-golomb: CMD = run libavcodec/tests/golomb
 fate-golomb: REF = /dev/null
 
+FATE_LIBAVCODEC-$(CONFIG_HUFFYUV_ENCODER) += fate-frame_thread_encoder
+fate-frame_thread_encoder: libavcodec/tests/frame_thread_encoder$(EXESUF)
+fate-frame_thread_encoder: CMD = run libavcodec/tests/frame_thread_encoder
+
 FATE_LIBAVCODEC-$(CONFIG_IDCTDSP) += fate-idct8x8
 fate-idct8x8: libavcodec/tests/dct$(EXESUF)
 fate-idct8x8: CMD = run libavcodec/tests/dct -i
@@ -1,3 +1,7 @@
+FATE_LIBAVFORMAT-yes += fate-aviobuf
+fate-aviobuf: libavformat/tests/aviobuf$(EXESUF)
+fate-aviobuf: CMD = run libavformat/tests/aviobuf $(TARGET_PATH)/tests/data/fate/aviobuf.data
+
 FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/tests/noproxy$(EXESUF)
 fate-noproxy: CMD = run libavformat/tests/noproxy
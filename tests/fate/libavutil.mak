@@ -69,6 +69,16 @@ FATE_LIBAVUTIL += fate-sha
 fate-sha: libavutil/tests/sha$(EXESUF)
 fate-sha: CMD = run libavutil/tests/sha
 
+FATE_LIBAVUTIL += fate-spscqueue
+fate-spscqueue: libavutil/tests/spscqueue$(EXESUF)
+fate-spscqueue: CMD = run libavutil/tests/spscqueue
+fate-spscqueue: REF = /dev/null
+
+FATE_LIBAVUTIL += fate-threadpool
+fate-threadpool: libavutil/tests/threadpool$(EXESUF)
+fate-threadpool: CMD = run libavutil/tests/threadpool
+fate-threadpool: REF = /dev/null
+
 FATE_LIBAVUTIL += fate-tree
 fate-tree: libavutil/tests/tree$(EXESUF)
 fate-tree: CMD = run libavutil/tests/tree